@@ -0,0 +1,284 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include "Benchmarks.h"
+#include "JobSystem.h"
+#include "FrameStats.h"
+#include "CpuTrace.h"
+#include "LightClustering.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+namespace Graphics
+{
+	static const uint32_t BenchmarkJobCount = 1 << 20;
+	static const uint32_t BenchmarkJobWork = 64;
+	static const uint32_t BenchmarkScopeCount = 1 << 22;
+	static const uint32_t BenchmarkWidth = 1920;
+	static const uint32_t BenchmarkHeight = 1080;
+
+	struct JobBenchmarkState
+	{
+		JobSystem* jobSystem;
+		JobCounter* counter;
+		std::atomic<uint32_t> checksum{ 0 };
+	};
+
+	//splits its range in half until one job is left, so every thread is submitting and the deques stay short
+	static void BenchmarkJob(void* data, uint32_t begin, uint32_t end)
+	{
+		JobBenchmarkState* state = static_cast<JobBenchmarkState*>(data);
+		while (end - begin > 1)
+		{
+			uint32_t middle = begin + (end - begin) / 2;
+			state->jobSystem->Run(BenchmarkJob, data, middle, end, state->counter);
+			end = middle;
+		}
+
+		uint32_t value = begin + 1;
+		for (uint32_t i = 0; i < BenchmarkJobWork; ++i)
+		{
+			value ^= value << 13;
+			value ^= value >> 17;
+			value ^= value << 5;
+		}
+		state->checksum.fetch_add(value & 1, std::memory_order_relaxed);
+	}
+
+	void RunJobSystemBenchmark(std::ostream& out)
+	{
+		uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<uint32_t> threadCounts;
+		for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(maxThreads);
+
+		out << "job system benchmark, " << BenchmarkJobCount << " jobs\n";
+		out << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(12) << "Mjobs/s" << std::setw(10) << "speedup" << "\n";
+
+		double baseline = 0.0;
+		for (uint32_t threads : threadCounts)
+		{
+			JobSystem jobSystem(threads - 1);
+			JobCounter counter;
+			JobBenchmarkState state;
+			state.jobSystem = &jobSystem;
+			state.counter = &counter;
+
+			//best of a few runs, the first one also pays for waking the workers
+			double best = 0.0;
+			for (int run = 0; run < 5; ++run)
+			{
+				FrameClock::time_point begin = FrameClock::now();
+				jobSystem.Run(BenchmarkJob, &state, 0, BenchmarkJobCount, &counter);
+				jobSystem.Wait(counter);
+				double elapsed = ElapsedMicroseconds(begin, FrameClock::now());
+
+				if (run == 0 || elapsed < best)
+				{
+					best = elapsed;
+				}
+			}
+
+			if (threads == 1)
+			{
+				baseline = best;
+			}
+
+			out << std::setw(8) << threads
+				<< std::setw(12) << std::fixed << std::setprecision(2) << best / 1000.0
+				<< std::setw(12) << BenchmarkJobCount / best
+				<< std::setw(10) << baseline / best << "\n";
+		}
+	}
+
+	//many times the ring's capacity, so the timing includes wrapping over old events like a long traced run does
+	void RunCpuTraceBenchmark(std::ostream& out)
+	{
+#if VF_CPU_TRACE
+		//the first scope registers the thread's ring, which is not what is measured
+		{
+			CPU_TRACE_SCOPE("bench scope");
+		}
+
+		double best = 0.0;
+		uint64_t bestTicks = 0;
+		for (int run = 0; run < 5; ++run)
+		{
+			uint64_t beginTicks = CpuTrace::Now();
+			FrameClock::time_point begin = FrameClock::now();
+			for (uint32_t i = 0; i < BenchmarkScopeCount; ++i)
+			{
+				CPU_TRACE_SCOPE("bench scope");
+			}
+			double elapsed = ElapsedMicroseconds(begin, FrameClock::now());
+			uint64_t ticks = CpuTrace::Now() - beginTicks;
+
+			if (run == 0 || elapsed < best)
+			{
+				best = elapsed;
+				bestTicks = ticks;
+			}
+		}
+
+		out << "cpu trace benchmark, " << BenchmarkScopeCount << " scopes, best of 5\n";
+		out << std::fixed << std::setprecision(2) << "  " << best * 1000.0 / BenchmarkScopeCount << " ns per CPU_TRACE_SCOPE, "
+			<< (double)bestTicks / BenchmarkScopeCount << " ticks\n";
+#else
+		out << "cpu trace benchmark: CPU_TRACE_SCOPE is compiled out in this build, define VF_CPU_TRACE=1 to measure it\n";
+#endif
+	}
+
+	//scattered like VulkanProject::CreateLights, only positions and radii matter to the references
+	static std::vector<Light> CreateBenchmarkLights(uint32_t lightCount)
+	{
+		std::mt19937 generator(1337);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		std::vector<Light> lights(lightCount);
+		for (Light& light : lights)
+		{
+			light.position = glm::vec3(unit(generator) * 20.0f - 10.0f, unit(generator) * 20.0f - 10.0f, 0.25f + unit(generator) * 1.5f);
+			light.radius = 0.5f + unit(generator) * 1.5f;
+			light.color = glm::vec3(1.0f);
+			light.intensity = 1.0f;
+			light.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			light.spotCosOuter = -1.0f;
+		}
+		return lights;
+	}
+
+	void RunLightAssignmentBenchmark(std::ostream& out)
+	{
+		//VulkanProject::UpdateCamera
+		const float nearPlane = 0.1f;
+		const float farPlane = 100.0f;
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 12.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), BenchmarkWidth / (float)BenchmarkHeight, nearPlane, farPlane);
+		projection[1][1] *= -1;
+
+		TileLightCuller tileCuller(BenchmarkWidth, BenchmarkHeight);
+		ClusteredLightAssigner clusterAssigner;
+		clusterAssigner.BuildClusters(projection, nearPlane, farPlane);
+
+		out << "light assignment benchmark, " << BenchmarkWidth << "x" << BenchmarkHeight << ", " << tileCuller.GetTileCount() << " tiles, "
+			<< ClusterCount << " clusters, best of 5\n";
+		out << std::setw(8) << "lights" << std::setw(12) << "tiled ms" << std::setw(14) << "clustered ms" << std::setw(18) << "cluster refs" << "\n";
+
+		for (uint32_t lightCount = 256; lightCount <= MaxLights; lightCount *= 4)
+		{
+			std::vector<Light> lights = CreateBenchmarkLights(lightCount);
+
+			double bestTiled = 0.0;
+			double bestClustered = 0.0;
+			for (int run = 0; run < 5; ++run)
+			{
+				FrameClock::time_point begin = FrameClock::now();
+				tileCuller.Cull(lights, view, projection, nearPlane, farPlane);
+				double tiled = ElapsedMicroseconds(begin, FrameClock::now());
+
+				begin = FrameClock::now();
+				clusterAssigner.Assign(lights, view);
+				double clustered = ElapsedMicroseconds(begin, FrameClock::now());
+
+				if (run == 0 || tiled < bestTiled)
+				{
+					bestTiled = tiled;
+				}
+				if (run == 0 || clustered < bestClustered)
+				{
+					bestClustered = clustered;
+				}
+			}
+
+			//also keeps the assignment from being optimized away
+			uint64_t clusterReferences = 0;
+			for (uint32_t count : clusterAssigner.GetLightCounts())
+			{
+				clusterReferences += count;
+			}
+
+			out << std::setw(8) << lightCount
+				<< std::setw(12) << std::fixed << std::setprecision(3) << bestTiled / 1000.0
+				<< std::setw(14) << bestClustered / 1000.0
+				<< std::setw(18) << clusterReferences << "\n";
+		}
+	}
+
+	void RunPipelineBenchmark(std::ostream& out, VkDevice device, ShaderLibrary& shaders, const std::vector<GraphicsPipelineDesc>& descs)
+	{
+		uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+		std::vector<uint32_t> threadCounts;
+		for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+		{
+			threadCounts.push_back(threads);
+		}
+		threadCounts.push_back(maxThreads);
+
+		out << "pipeline build benchmark, " << descs.size() << " pipelines, driver side shader caches may still hit\n";
+		out << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(14) << "pipelines/s" << std::setw(10) << "speedup" << "\n";
+
+		std::vector<VkPipeline> pipelines(descs.size());
+		double baseline = 0.0;
+		for (uint32_t threads : threadCounts)
+		{
+			JobSystem jobSystem(threads - 1);
+
+			double best = 0.0;
+			for (int run = 0; run < 3; ++run)
+			{
+				VkPipelineCacheCreateInfo cacheInfo{};
+				cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+				VkPipelineCache cache;
+				if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to Create Pipeline Cache!");
+				}
+
+				FrameClock::time_point begin = FrameClock::now();
+				{
+					PipelineBuilder builder(device, jobSystem, shaders, cache);
+					for (const GraphicsPipelineDesc& desc : descs)
+					{
+						builder.Submit(desc);
+					}
+					for (PipelineHandle handle = 0; handle < builder.GetSubmittedCount(); ++handle)
+					{
+						pipelines[handle] = builder.Get(handle);
+					}
+				}
+				double elapsed = ElapsedMicroseconds(begin, FrameClock::now());
+
+				for (VkPipeline pipeline : pipelines)
+				{
+					vkDestroyPipeline(device, pipeline, nullptr);
+				}
+				vkDestroyPipelineCache(device, cache, nullptr);
+
+				if (run == 0 || elapsed < best)
+				{
+					best = elapsed;
+				}
+			}
+
+			if (threads == 1)
+			{
+				baseline = best;
+			}
+
+			out << std::setw(8) << threads
+				<< std::setw(12) << std::fixed << std::setprecision(2) << best / 1000.0
+				<< std::setw(14) << descs.size() / (best / 1000000.0)
+				<< std::setw(10) << baseline / best << "\n";
+		}
+	}
+}
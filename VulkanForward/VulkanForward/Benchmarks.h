@@ -0,0 +1,21 @@
+#pragma once
+#include <ostream>
+#include <vector>
+#include "PipelineBuilder.h"
+
+namespace Graphics
+{
+	//job throughput for 1..hardware_concurrency threads, run with --bench-jobs
+	void RunJobSystemBenchmark(std::ostream& out);
+
+	//cost of one CPU_TRACE_SCOPE on the calling thread, run with --bench-cpu-trace
+	void RunCpuTraceBenchmark(std::ostream& out);
+
+	//CPU reference tile culling and cluster assignment at 1080p for a few light counts, the scene's camera and light
+	//scatter. run with --bench-light-assignment
+	void RunLightAssignmentBenchmark(std::ostream& out);
+
+	//pipelines per second building descs on 1..hardware_concurrency threads, each run into an empty pipeline cache.
+	//run with --bench-pipelines
+	void RunPipelineBenchmark(std::ostream& out, VkDevice device, ShaderLibrary& shaders, const std::vector<GraphicsPipelineDesc>& descs);
+}
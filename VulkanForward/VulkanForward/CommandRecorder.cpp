@@ -0,0 +1,131 @@
+#include "CommandRecorder.h"
+#include "CpuTrace.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Graphics
+{
+	ParallelCommandRecorder::ParallelCommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem& jobSystem, uint32_t framesInFlight, uint32_t passCount)
+		: m_jobSystem(jobSystem), m_passCount(passCount)
+	{
+		m_device = device;
+		m_slices.resize(jobSystem.GetThreadCount());
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilyIndex;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+		for (SliceContext& slice : m_slices)
+		{
+			slice.pools.resize(framesInFlight * passCount);
+			slice.buffers.resize(framesInFlight * passCount);
+
+			for (uint32_t context = 0; context < framesInFlight * passCount; ++context)
+			{
+				if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &slice.pools[context]) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to Create Command Pool!");
+				}
+
+				VkCommandBufferAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+				allocInfo.commandPool = slice.pools[context];
+				allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+				allocInfo.commandBufferCount = 1;
+
+				if (vkAllocateCommandBuffers(m_device, &allocInfo, &slice.buffers[context]) != VK_SUCCESS)
+				{
+					throw std::runtime_error("Failed to Allocate Command Buffers!");
+				}
+			}
+		}
+	}
+
+	ParallelCommandRecorder::~ParallelCommandRecorder()
+	{
+		for (SliceContext& slice : m_slices)
+		{
+			for (VkCommandPool pool : slice.pools)
+			{
+				vkDestroyCommandPool(m_device, pool, nullptr);
+			}
+		}
+	}
+
+	void ParallelCommandRecorder::RecordSlice(uint32_t sliceIndex)
+	{
+		CPU_TRACE_SCOPE("record slice");
+		uint32_t first = (uint32_t)((uint64_t)m_drawCount * sliceIndex / m_activeSlices);
+		uint32_t last = (uint32_t)((uint64_t)m_drawCount * (sliceIndex + 1) / m_activeSlices);
+
+		SliceContext& slice = m_slices[sliceIndex];
+		uint32_t context = m_frameIndex * m_passCount + m_pass;
+		VkCommandBuffer commandBuffer = slice.buffers[context];
+		vkResetCommandPool(m_device, slice.pools[context], 0);
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = m_inheritance;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording secondary command buffer");
+		}
+
+		(*m_record)(commandBuffer, first, last - first);
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Record Command Buffer!");
+		}
+	}
+
+	const std::vector<VkCommandBuffer>& ParallelCommandRecorder::Record(uint32_t frameIndex, uint32_t pass, const VkCommandBufferInheritanceInfo& inheritance, uint32_t drawCount, const RecordFunction& record)
+	{
+		uint32_t wantedSlices = std::max(1u, (drawCount + MinDrawsPerSlice - 1) / MinDrawsPerSlice);
+
+		m_frameIndex = frameIndex;
+		m_pass = pass;
+		m_activeSlices = std::min(wantedSlices, GetSliceCount());
+		m_drawCount = drawCount;
+		m_inheritance = &inheritance;
+		m_record = &record;
+		m_jobError = nullptr;
+
+		auto recordSlices = [this](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t sliceIndex = begin; sliceIndex < end; ++sliceIndex)
+			{
+				try
+				{
+					RecordSlice(sliceIndex);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(m_errorMutex);
+					if (!m_jobError)
+					{
+						m_jobError = std::current_exception();
+					}
+				}
+			}
+		};
+		m_jobSystem.ParallelFor(m_activeSlices, 1, recordSlices);
+
+		std::exception_ptr error = m_jobError;
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+
+		m_recorded.clear();
+		for (uint32_t i = 0; i < m_activeSlices; ++i)
+		{
+			m_recorded.push_back(m_slices[i].buffers[frameIndex * m_passCount + pass]);
+		}
+
+		return m_recorded;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <exception>
+#include <vulkan/vulkan.h>
+#include "JobSystem.h"
+
+namespace Graphics
+{
+	//Splits a draw list into one job per slice, every slice is recorded into its own secondary command buffer.
+	//Each slice owns one command pool per frame in flight and pass, so no pool is ever touched by two threads at once,
+	//several passes of a frame can be recorded, and a frame's pools can be reset wholesale once its fence has signaled.
+	//The calling thread records while it waits.
+	class ParallelCommandRecorder
+	{
+	public:
+		//records draws [first, first + count) into a secondary command buffer that is already recording
+		typedef std::function<void(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count)> RecordFunction;
+
+		//slices smaller than this are not worth a thread hand off
+		static const uint32_t MinDrawsPerSlice = 64;
+
+	private:
+		struct SliceContext
+		{
+			std::vector<VkCommandPool> pools;
+			std::vector<VkCommandBuffer> buffers;
+		};
+
+		VkDevice m_device;
+		JobSystem& m_jobSystem;
+		std::vector<SliceContext> m_slices;
+		std::vector<VkCommandBuffer> m_recorded;
+		uint32_t m_passCount;
+
+		std::mutex m_errorMutex;
+		std::exception_ptr m_jobError;
+
+		//state of the current Record call, read by the slice jobs
+		uint32_t m_frameIndex = 0;
+		uint32_t m_pass = 0;
+		uint32_t m_activeSlices = 0;
+		uint32_t m_drawCount = 0;
+		const VkCommandBufferInheritanceInfo* m_inheritance = nullptr;
+		const RecordFunction* m_record = nullptr;
+
+		void RecordSlice(uint32_t sliceIndex);
+
+	public:
+		//one slice per job system thread, passCount Record calls per frame
+		ParallelCommandRecorder(VkDevice device, uint32_t queueFamilyIndex, JobSystem& jobSystem, uint32_t framesInFlight, uint32_t passCount = 1);
+		~ParallelCommandRecorder();
+
+		ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+		ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+		//blocks until every slice is recorded, returns the secondary buffers in draw order ready for vkCmdExecuteCommands.
+		//the GPU must be done with frameIndex's previous use. The buffers stay valid until the same frame and pass are recorded again.
+		const std::vector<VkCommandBuffer>& Record(uint32_t frameIndex, uint32_t pass, const VkCommandBufferInheritanceInfo& inheritance, uint32_t drawCount, const RecordFunction& record);
+
+		inline uint32_t GetSliceCount() const { return static_cast<uint32_t>(m_slices.size()); }
+	};
+}
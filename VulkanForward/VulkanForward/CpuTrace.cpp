@@ -0,0 +1,78 @@
+#include "CpuTrace.h"
+#include <memory>
+#include <mutex>
+
+namespace Graphics
+{
+	namespace CpuTrace
+	{
+		thread_local CpuTraceRing* t_threadRing = nullptr;
+
+		//rings live until the process ends, so events of threads that are gone can still be collected
+		struct Registry
+		{
+			std::mutex mutex;
+			std::vector<std::unique_ptr<CpuTraceRing>> rings;
+
+			//first reading of both clocks, ticks are mapped to the FrameClock between it and the collection
+			uint64_t originTicks = Now();
+			FrameClock::time_point originTime = FrameClock::now();
+		};
+
+		static Registry& GetRegistry()
+		{
+			static Registry registry;
+			return registry;
+		}
+
+		CpuTraceRing& RegisterThread()
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+
+			registry.rings.push_back(std::make_unique<CpuTraceRing>());
+			CpuTraceRing* ring = registry.rings.back().get();
+			ring->threadName = "thread " + std::to_string(registry.rings.size() - 1);
+			t_threadRing = ring;
+			return *ring;
+		}
+
+		void SetThreadName(const std::string& name)
+		{
+			CpuTraceRing& ring = GetThreadRing();
+			std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+			ring.threadName = name;
+		}
+
+		void Collect(std::vector<TraceEvent>& events, std::vector<std::string>& trackNames)
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+
+			//the counter rate is measured over the whole run rather than trusted
+			double originMicroseconds = ToTraceMicroseconds(registry.originTime);
+#ifdef VF_CPU_TRACE_RDTSC
+			uint64_t nowTicks = Now();
+			double elapsedMicroseconds = ToTraceMicroseconds(FrameClock::now()) - originMicroseconds;
+			double microsecondsPerTick = (nowTicks > registry.originTicks) ? elapsedMicroseconds / (double)(nowTicks - registry.originTicks) : 0.0;
+#else
+			double microsecondsPerTick = std::chrono::duration<double, std::micro>(FrameClock::duration(1)).count();
+#endif
+
+			for (const std::unique_ptr<CpuTraceRing>& ring : registry.rings)
+			{
+				uint32_t track = static_cast<uint32_t>(trackNames.size());
+				trackNames.push_back(ring->threadName);
+
+				uint64_t written = ring->written.load(std::memory_order_acquire);
+				uint64_t first = (written > CpuTraceRing::Capacity) ? written - CpuTraceRing::Capacity : 0;
+				for (uint64_t i = first; i < written; ++i)
+				{
+					const CpuTraceEvent& event = ring->events[i & (CpuTraceRing::Capacity - 1)];
+					double begin = originMicroseconds + ((double)event.begin - (double)registry.originTicks) * microsecondsPerTick;
+					events.push_back({ event.name, begin, (double)(event.end - event.begin) * microsecondsPerTick, track });
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Trace.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VF_CPU_TRACE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VF_CPU_TRACE_RDTSC 1
+#endif
+
+//on in debug builds. Release builds compile every scope away unless VF_CPU_TRACE is defined to 1.
+#ifndef VF_CPU_TRACE
+#ifdef NDEBUG
+#define VF_CPU_TRACE 0
+#else
+#define VF_CPU_TRACE 1
+#endif
+#endif
+
+namespace Graphics
+{
+	//one CPU scope, in CpuTrace::Now ticks
+	struct CpuTraceEvent
+	{
+		const char* name;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	//Scopes of one thread, written by that thread only. Once full the oldest events are overwritten.
+	struct CpuTraceRing
+	{
+		static const uint32_t Capacity = 16384;		//power of two
+
+		CpuTraceEvent events[Capacity];
+		std::atomic<uint64_t> written{ 0 };
+		std::string threadName;
+
+		inline void Push(const char* name, uint64_t begin, uint64_t end)
+		{
+			uint64_t index = written.load(std::memory_order_relaxed);
+			events[index & (Capacity - 1)] = { name, begin, end };
+
+			//a reader acquiring the count sees the event
+			written.store(index + 1, std::memory_order_release);
+		}
+	};
+
+	//Per thread rings of CPU scopes. A thread's ring is registered under a lock on its first scope, after that a scope
+	//costs two reads of the time stamp counter, a thread local lookup and a store no other thread writes to.
+	namespace CpuTrace
+	{
+		extern thread_local CpuTraceRing* t_threadRing;
+
+		inline uint64_t Now()
+		{
+#ifdef VF_CPU_TRACE_RDTSC
+			return __rdtsc();
+#else
+			return (uint64_t)FrameClock::now().time_since_epoch().count();
+#endif
+		}
+
+		CpuTraceRing& RegisterThread();
+
+		inline CpuTraceRing& GetThreadRing()
+		{
+			CpuTraceRing* ring = t_threadRing;
+			return ring ? *ring : RegisterThread();
+		}
+
+		//names the calling thread's row in the trace
+		void SetThreadName(const std::string& name);
+
+		//every ring's events on the FrameClock timeline, one track per thread appended to trackNames.
+		//Events written meanwhile may come out torn, collect while the traced threads are idle.
+		void Collect(std::vector<TraceEvent>& events, std::vector<std::string>& trackNames);
+	}
+
+	class CpuTraceScope
+	{
+	private:
+		const char* m_name;
+		uint64_t m_begin;
+
+	public:
+		explicit CpuTraceScope(const char* name) : m_name(name), m_begin(CpuTrace::Now()) {}
+		~CpuTraceScope() { CpuTrace::GetThreadRing().Push(m_name, m_begin, CpuTrace::Now()); }
+
+		CpuTraceScope(const CpuTraceScope&) = delete;
+		CpuTraceScope& operator=(const CpuTraceScope&) = delete;
+	};
+}
+
+#if VF_CPU_TRACE
+#define VF_CPU_TRACE_CONCAT_INNER(a, b) a##b
+#define VF_CPU_TRACE_CONCAT(a, b) VF_CPU_TRACE_CONCAT_INNER(a, b)
+#define CPU_TRACE_SCOPE(name) Graphics::CpuTraceScope VF_CPU_TRACE_CONCAT(cpuTraceScope, __LINE__)(name)
+#define CPU_TRACE_THREAD_NAME(name) Graphics::CpuTrace::SetThreadName(name)
+#else
+#define CPU_TRACE_SCOPE(name) ((void)0)
+#define CPU_TRACE_THREAD_NAME(name) ((void)0)
+#endif
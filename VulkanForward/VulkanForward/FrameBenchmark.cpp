@@ -0,0 +1,182 @@
+#include "FrameBenchmark.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+
+namespace Graphics
+{
+	static std::vector<BenchScene> CreateBenchScenes()
+	{
+		RenderSettings tiled;
+		tiled.headless = true;
+
+		RenderSettings clustered = tiled;
+		clustered.lightCullingMode = LightCullingMode::Clustered;
+
+		RenderSettings noPrePass = tiled;
+		noPrePass.depthPrePass = false;
+
+		RenderSettings noOcclusion = clustered;
+		noOcclusion.occlusionCulling = false;
+
+		return {
+			{ "tiled", tiled, 30, 300 },
+			{ "clustered", clustered, 30, 300 },
+			{ "tiled-no-prepass", noPrePass, 30, 300 },
+			{ "clustered-no-occlusion", noOcclusion, 30, 300 },
+		};
+	}
+
+	const std::vector<BenchScene>& GetBenchScenes()
+	{
+		static const std::vector<BenchScene> scenes = CreateBenchScenes();
+		return scenes;
+	}
+
+	//nearest rank, exact unlike the bucketed FrameTimeHistogram. samples must be sorted.
+	static double GetPercentile(const std::vector<double>& samples, double percentile)
+	{
+		if (samples.empty())
+			return 0.0;
+
+		size_t rank = (size_t)std::ceil(samples.size() * percentile / 100.0);
+		return samples[std::min(std::max<size_t>(rank, 1), samples.size()) - 1];
+	}
+
+	static void PrintPercentiles(std::ostream& out, const char* name, std::vector<double>& microseconds)
+	{
+		std::sort(microseconds.begin(), microseconds.end());
+		out << "  " << name << " ms: p50 " << GetPercentile(microseconds, 50.0) / 1000.0 << ", p95 " << GetPercentile(microseconds, 95.0) / 1000.0
+			<< ", p99 " << GetPercentile(microseconds, 99.0) / 1000.0 << ", max " << microseconds.back() / 1000.0 << " (" << microseconds.size() << " frames)\n";
+	}
+
+	enum class GoldenResult
+	{
+		Match,		//or written as the new golden
+		Mismatch,
+		Skipped
+	};
+
+	static GoldenResult CheckGolden(std::ostream& out, const BenchScene& scene, const RgbImage& frame, const FrameBenchmarkOptions& options)
+	{
+		std::string golden = options.goldenDirectory + "/" + scene.name + ".ppm";
+		if (options.updateGolden)
+		{
+			std::error_code error;
+			std::filesystem::create_directories(options.goldenDirectory, error);
+			bool written = WritePpm(golden, frame);
+			out << "  golden: " << (written ? "written to " : "FAILED to write ") << golden << "\n";
+			return written ? GoldenResult::Match : GoldenResult::Mismatch;
+		}
+
+		std::error_code error;
+		if (!std::filesystem::exists(golden, error))
+		{
+			out << "  golden: " << (options.requireGolden ? "MISSING " : "skipped, no ") << golden << ", run with --update-golden on the reference device\n";
+			return options.requireGolden ? GoldenResult::Mismatch : GoldenResult::Skipped;
+		}
+
+		RgbImage expected;
+		if (!ReadPpm(golden, expected))
+		{
+			out << "  golden: UNREADABLE " << golden << "\n";
+			return GoldenResult::Mismatch;
+		}
+
+		ImageDifference difference = CompareImages(frame, expected, options.channelTolerance);
+		uint64_t allowedPixels = (uint64_t)(options.pixelTolerance * frame.width * frame.height);
+		bool match = !difference.sizeMismatch && difference.differingPixels <= allowedPixels;
+
+		if (difference.sizeMismatch)
+		{
+			out << "  golden: MISMATCH, " << frame.width << "x" << frame.height << " against " << expected.width << "x" << expected.height << "\n";
+		}
+		else
+		{
+			out << "  golden: " << (match ? "match, " : "MISMATCH, ") << difference.differingPixels << " pixels past tolerance (" << allowedPixels
+				<< " allowed), max channel difference " << difference.maxChannelDifference << "\n";
+		}
+
+		//kept next to the run for a look at what changed
+		if (!match)
+		{
+			std::string actual = std::string(scene.name) + ".actual.ppm";
+			if (WritePpm(actual, frame))
+			{
+				out << "  frame written to " << actual << "\n";
+			}
+		}
+		return match ? GoldenResult::Match : GoldenResult::Mismatch;
+	}
+
+	uint32_t RunFrameBenchmark(std::ostream& out, const FrameBenchmarkOptions& options)
+	{
+		const double MiB = 1024.0 * 1024.0;
+		uint32_t failures = 0;
+		uint32_t skipped = 0;
+
+		for (const BenchScene& scene : GetBenchScenes())
+		{
+			uint32_t frameCount = options.frameCount ? options.frameCount : scene.frameCount;
+			out << "vf_bench: " << scene.name << ", " << frameCount << " frames after " << scene.warmupFrames << " warm up\n";
+
+			VulkanProject project;
+			project.VP_InitVulkan(scene.settings);
+
+			for (uint32_t i = 0; i < scene.warmupFrames; ++i)
+			{
+				project.VP_RenderFrame();
+			}
+
+			//a frame's GPU time arrives once its fence has signaled, a few frames after it was rendered
+			std::vector<double> cpuFrames;
+			std::vector<double> gpuFrames;
+			cpuFrames.reserve(frameCount);
+			uint64_t gpuFrameCount = project.GetGpuFrameCount();
+
+			for (uint32_t i = 0; i < frameCount; ++i)
+			{
+				FrameClock::time_point start = FrameClock::now();
+				project.VP_RenderFrame();
+				cpuFrames.push_back(ElapsedMicroseconds(start, FrameClock::now()));
+
+				if (project.GetGpuFrameCount() != gpuFrameCount)
+				{
+					gpuFrameCount = project.GetGpuFrameCount();
+					gpuFrames.push_back(project.GetLastGpuFrameMicroseconds());
+				}
+			}
+
+			RgbImage frame = project.VP_ReadbackFrame();
+			MemoryStats memory = project.GetMemoryStats();
+			VkDeviceSize uploadHighWaterMark = project.GetUploadHighWaterMark();
+			project.VP_CleanUP();
+
+			out << std::fixed << std::setprecision(3);
+			PrintPercentiles(out, "cpu frame", cpuFrames);
+			if (gpuFrames.empty())
+			{
+				out << "  gpu frame: no timestamps on this device\n";
+			}
+			else
+			{
+				PrintPercentiles(out, "gpu frame", gpuFrames);
+			}
+			out << std::setprecision(1) << "  memory: peak " << memory.peakUsedBytes / MiB << " MiB used in " << memory.peakBlockBytes / MiB
+				<< " MiB of blocks, frame upload high water mark " << uploadHighWaterMark / 1024 << " KiB\n";
+
+			GoldenResult result = CheckGolden(out, scene, frame, options);
+			failures += (result == GoldenResult::Mismatch) ? 1 : 0;
+			skipped += (result == GoldenResult::Skipped) ? 1 : 0;
+		}
+
+		out << "vf_bench: " << GetBenchScenes().size() - failures - skipped << " of " << GetBenchScenes().size() << " scenes passed";
+		if (skipped)
+		{
+			out << ", " << skipped << " skipped without a golden";
+		}
+		out << "\n";
+		return failures;
+	}
+}
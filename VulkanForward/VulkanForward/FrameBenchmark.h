@@ -0,0 +1,35 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "VulkanProject.h"
+
+namespace Graphics
+{
+	//one scripted vf_bench run: a fresh headless device set up with the settings, warmupFrames are rendered untimed
+	struct BenchScene
+	{
+		const char* name;
+		RenderSettings settings;
+		uint32_t warmupFrames;
+		uint32_t frameCount;
+	};
+
+	struct FrameBenchmarkOptions
+	{
+		std::string goldenDirectory = "Golden";
+		bool updateGolden = false;		//the final frames become the new goldens instead of being compared
+		bool requireGolden = false;		//a scene without a golden fails instead of being skipped
+		uint32_t frameCount = 0;		//overrides every scene's frame count when not 0
+		uint32_t channelTolerance = 8;
+		double pixelTolerance = 0.001;	//fraction of pixels allowed past the channel tolerance
+	};
+
+	//the scenes of --vf-bench. The lights and camera are fixed, so every run of a scene renders the same frame.
+	const std::vector<BenchScene>& GetBenchScenes();
+
+	//runs every scene and prints its CPU and GPU frame time percentiles and memory high water marks.
+	//returns the number of scenes whose final frame does not match its golden image. Goldens depend on the device
+	//and are not committed, a scene without one is skipped unless requireGolden is set.
+	uint32_t RunFrameBenchmark(std::ostream& out, const FrameBenchmarkOptions& options);
+}
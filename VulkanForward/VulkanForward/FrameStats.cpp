@@ -0,0 +1,118 @@
+#include "FrameStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace Graphics
+{
+	void FrameTimeHistogram::Record(double microseconds)
+	{
+		uint32_t bucket = 0;
+		if (microseconds >= 1.0)
+		{
+			bucket = (uint32_t)std::log2(microseconds) + 1;
+			if (bucket >= BucketCount)
+			{
+				bucket = BucketCount - 1;
+			}
+		}
+
+		++m_buckets[bucket];
+		++m_count;
+		m_totalMicroseconds += microseconds;
+		if (microseconds > m_maxMicroseconds)
+		{
+			m_maxMicroseconds = microseconds;
+		}
+	}
+
+	void FrameTimeHistogram::Reset()
+	{
+		*this = FrameTimeHistogram();
+	}
+
+	double FrameTimeHistogram::GetPercentile(double percentile) const
+	{
+		if (m_count == 0)
+			return 0.0;
+
+		uint64_t target = (uint64_t)std::ceil(m_count * percentile / 100.0);
+		uint64_t seen = 0;
+
+		for (uint32_t i = 0; i < BucketCount; ++i)
+		{
+			seen += m_buckets[i];
+			if (seen >= target && seen > 0)
+			{
+				return (i == BucketCount - 1) ? m_maxMicroseconds : std::ldexp(1.0, (int)i);
+			}
+		}
+
+		return m_maxMicroseconds;
+	}
+
+	double FrameTimeHistogram::GetAverage() const
+	{
+		return m_count ? m_totalMicroseconds / m_count : 0.0;
+	}
+
+	void FrameTimeHistogram::Print(std::ostream& out, const char* name) const
+	{
+		out << std::fixed << std::setprecision(1);
+		out << name << ": avg " << GetAverage() << "us, p50 <" << GetPercentile(50.0) << "us, p99 <" << GetPercentile(99.0)
+			<< "us, max " << m_maxMicroseconds << "us (" << m_count << " samples)\n";
+
+		for (uint32_t i = 0; i < BucketCount; ++i)
+		{
+			if (m_buckets[i] == 0)
+				continue;
+
+			double lower = (i == 0) ? 0.0 : std::ldexp(1.0, (int)i - 1);
+			out << "    [" << std::setw(9) << lower << "us, " << std::setw(9) << std::ldexp(1.0, (int)i) << "us) " << m_buckets[i] << "\n";
+		}
+	}
+
+	void FrameStats::Reset()
+	{
+		fenceWait.Reset();
+		acquire.Reset();
+		cpuRecord.Reset();
+		frameInterval.Reset();
+		gpuFrame.Reset();
+	}
+
+	void FrameStats::Print(std::ostream& out) const
+	{
+		fenceWait.Print(out, "fence wait");
+		acquire.Print(out, "acquire");
+		cpuRecord.Print(out, "cpu record");
+		frameInterval.Print(out, "frame interval");
+		if (gpuFrame.GetCount() > 0)
+		{
+			gpuFrame.Print(out, "gpu frame");
+		}
+	}
+
+	void OverdrawStats::Record(uint64_t fragments, uint64_t draws)
+	{
+		shadedFragments += fragments;
+		visibleDraws += draws;
+		maxShadedFragments = std::max(maxShadedFragments, fragments);
+		++frameCount;
+	}
+
+	void OverdrawStats::Print(std::ostream& out, uint64_t screenPixels, uint64_t drawCount) const
+	{
+		if (frameCount == 0 || screenPixels == 0)
+			return;
+
+		double average = (double)shadedFragments / frameCount;
+		out << std::fixed << std::setprecision(2);
+		out << "overdraw: " << average / screenPixels << " shaded fragments per screen pixel, avg " << (uint64_t)average
+			<< " max " << maxShadedFragments << " per frame (" << frameCount << " frames)\n";
+		if (drawCount > 0)
+		{
+			out << "occlusion culling: " << (double)visibleDraws / frameCount << " of " << drawCount << " draws visible per frame\n";
+		}
+	}
+}
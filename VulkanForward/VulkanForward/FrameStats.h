@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+
+namespace Graphics
+{
+	//log2 bucketed histogram of durations in microseconds. Recording is a few adds, so it can stay on in release builds.
+	class FrameTimeHistogram
+	{
+	public:
+		//bucket 0 holds everything below 1us, bucket i holds [2^(i-1), 2^i) us, the last bucket is open ended
+		static const uint32_t BucketCount = 24;
+
+	private:
+		uint64_t m_buckets[BucketCount] = {};
+		uint64_t m_count = 0;
+		double m_totalMicroseconds = 0.0;
+		double m_maxMicroseconds = 0.0;
+
+	public:
+		void Record(double microseconds);
+		void Reset();
+
+		//upper bound of the bucket containing the given percentile (0-100)
+		double GetPercentile(double percentile) const;
+		double GetAverage() const;
+
+		inline uint64_t GetCount() const { return m_count; }
+		inline double GetMax() const { return m_maxMicroseconds; }
+		inline uint64_t GetBucket(uint32_t index) const { return m_buckets[index]; }
+
+		void Print(std::ostream& out, const char* name) const;
+	};
+
+	//per frame CPU timings of DrawFrame. With frames overlapping, fence wait is the time the CPU
+	//is throttled by the GPU and should be close to zero while the GPU keeps up.
+	//gpu frame is the span between the timestamps at both ends of the frame's command buffer, FramesInFlight frames late.
+	struct FrameStats
+	{
+		FrameTimeHistogram fenceWait;
+		FrameTimeHistogram acquire;
+		FrameTimeHistogram cpuRecord;
+		FrameTimeHistogram frameInterval;
+		FrameTimeHistogram gpuFrame;
+
+		void Reset();
+		void Print(std::ostream& out) const;
+	};
+
+	//fragments shaded by the forward pass, read back from the GPU a few frames late. With the depth pre-pass each
+	//visible pixel is shaded once, so fragments per screen pixel is the coverage; without it the excess is overdraw.
+	struct OverdrawStats
+	{
+		uint64_t shadedFragments = 0;
+		uint64_t frameCount = 0;
+		uint64_t maxShadedFragments = 0;
+		uint64_t visibleDraws = 0;		//draws left after occlusion culling
+
+		void Record(uint64_t fragments, uint64_t draws);
+
+		//drawCount 0 when draws were not culled
+		void Print(std::ostream& out, uint64_t screenPixels, uint64_t drawCount) const;
+	};
+
+	typedef std::chrono::steady_clock FrameClock;
+
+	inline double ElapsedMicroseconds(FrameClock::time_point begin, FrameClock::time_point end)
+	{
+		return std::chrono::duration<double, std::micro>(end - begin).count();
+	}
+}
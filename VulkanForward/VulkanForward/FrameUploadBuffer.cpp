@@ -0,0 +1,74 @@
+#include "FrameUploadBuffer.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Graphics
+{
+	static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	FrameUploadBuffer::FrameUploadBuffer(VkDevice device, DeviceMemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage)
+		: m_device(device), m_allocator(allocator)
+	{
+		//every allocation can be bound as a uniform or storage buffer and holds any vertex attribute
+		m_alignment = std::max<VkDeviceSize>({ 16, limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment });
+		m_frameSize = AlignUp(frameSize, m_alignment);
+		m_frameCount = frameCount;
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = m_frameSize * m_frameCount;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_device, m_buffer, &memRequirements);
+
+		m_allocation = m_allocator.Allocate(memRequirements, MemoryUsage::CpuToGpu, ResourceKind::Linear);
+		vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
+	}
+
+	FrameUploadBuffer::~FrameUploadBuffer()
+	{
+		vkDestroyBuffer(m_device, m_buffer, nullptr);
+		m_allocator.Free(m_allocation);
+	}
+
+	void FrameUploadBuffer::BeginFrame(uint32_t frameIndex)
+	{
+		m_frameBegin = m_frameSize * (frameIndex % m_frameCount);
+		m_head.store(m_frameBegin, std::memory_order_relaxed);
+	}
+
+	void FrameUploadBuffer::EndFrame()
+	{
+		VkDeviceSize used = std::min(m_head.load(std::memory_order_relaxed) - m_frameBegin, m_frameSize);
+		m_highWaterMark = std::max(m_highWaterMark, used);
+
+		if (used > 0)
+		{
+			m_allocator.Flush(m_allocation, m_frameBegin, used);
+		}
+	}
+
+	UploadAllocation FrameUploadBuffer::Allocate(VkDeviceSize size)
+	{
+		VkDeviceSize offset = m_head.fetch_add(AlignUp(size, m_alignment), std::memory_order_relaxed);
+		if (offset + size > m_frameBegin + m_frameSize)
+		{
+			throw std::runtime_error("Frame upload buffer is full!");
+		}
+
+		UploadAllocation allocation;
+		allocation.data = static_cast<char*>(m_allocation.mapped) + offset;
+		allocation.offset = static_cast<uint32_t>(offset);
+		return allocation;
+	}
+}
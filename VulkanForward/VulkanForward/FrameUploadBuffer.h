@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstring>
+#include <vulkan/vulkan.h>
+#include "MemoryAllocator.h"
+
+namespace Graphics
+{
+	struct UploadAllocation
+	{
+		void* data;
+		uint32_t offset;	//dynamic offset into the upload buffer
+	};
+
+	//One persistently mapped buffer split into a partition per frame in flight. Allocation is a bump of an atomic head,
+	//so any thread can write per frame uniforms, storage or vertex data and bind it with a dynamic offset.
+	//A partition is only reused after BeginFrame is called with its index, which the caller must do after the frame's fence.
+	class FrameUploadBuffer
+	{
+	private:
+		VkDevice m_device;
+		DeviceMemoryAllocator& m_allocator;
+		VkBuffer m_buffer = VK_NULL_HANDLE;
+		Allocation m_allocation;
+
+		VkDeviceSize m_alignment;
+		VkDeviceSize m_frameSize;
+		uint32_t m_frameCount;
+
+		std::atomic<VkDeviceSize> m_head{ 0 };
+		VkDeviceSize m_frameBegin = 0;
+		VkDeviceSize m_highWaterMark = 0;
+
+	public:
+		FrameUploadBuffer(VkDevice device, DeviceMemoryAllocator& allocator, const VkPhysicalDeviceLimits& limits, VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage);
+		~FrameUploadBuffer();
+
+		FrameUploadBuffer(const FrameUploadBuffer&) = delete;
+		FrameUploadBuffer& operator=(const FrameUploadBuffer&) = delete;
+
+		void BeginFrame(uint32_t frameIndex);
+
+		//flushes what the frame wrote when the memory is not coherent, call before the frame is submitted
+		void EndFrame();
+
+		//throws when the frame's partition is full
+		UploadAllocation Allocate(VkDeviceSize size);
+
+		inline uint32_t Upload(const void* data, VkDeviceSize size)
+		{
+			UploadAllocation allocation = Allocate(size);
+			memcpy(allocation.data, data, (size_t)size);
+			return allocation.offset;
+		}
+
+		inline VkBuffer GetBuffer() const { return m_buffer; }
+		inline VkDeviceSize GetFrameSize() const { return m_frameSize; }
+
+		//most bytes any single frame has used
+		inline VkDeviceSize GetHighWaterMark() const { return m_highWaterMark; }
+	};
+}
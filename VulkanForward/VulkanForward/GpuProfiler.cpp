@@ -0,0 +1,170 @@
+#include "GpuProfiler.h"
+#include <stdexcept>
+#include <iomanip>
+#include <string>
+
+namespace Graphics
+{
+	GpuProfiler::GpuProfiler(VkDevice device, const VkPhysicalDeviceLimits& limits, uint32_t timestampValidBits, uint32_t framesInFlight)
+		: m_device(device), m_period(limits.timestampPeriod), m_frameScopes(framesInFlight)
+	{
+		m_mask = (timestampValidBits >= 64) ? ~0ull : (1ull << timestampValidBits) - 1;
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = framesInFlight * MaxScopes * 2;
+
+		if (vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Query Pool!");
+		}
+
+		m_ticks.resize(MaxScopes * 2);
+	}
+
+	GpuProfiler::~GpuProfiler()
+	{
+		vkDestroyQueryPool(m_device, m_pool, nullptr);
+	}
+
+	void GpuProfiler::Calibrate(VkQueue queue, VkCommandPool commandPool)
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Command Buffers!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		vkCmdResetQueryPool(commandBuffer, m_pool, 0, 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, 0);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		//the timestamp was taken somewhere between the submit and the wait returning, the middle is the best guess
+		FrameClock::time_point submitted = FrameClock::now();
+		vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(queue);
+		FrameClock::time_point done = FrameClock::now();
+		vkFreeCommandBuffers(m_device, commandPool, 1, &commandBuffer);
+
+		uint64_t ticks = 0;
+		if (vkGetQueryPoolResults(m_device, m_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to read the calibration timestamp!");
+		}
+
+		m_clockOffset = (ToTraceMicroseconds(submitted) + ToTraceMicroseconds(done)) / 2.0 - ToMicroseconds(ticks);
+	}
+
+	void GpuProfiler::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, const char* name)
+	{
+		m_frameIndex = frameIndex;
+		m_frameScopes[frameIndex].clear();
+		m_openScopes.clear();
+
+		vkCmdResetQueryPool(commandBuffer, m_pool, frameIndex * MaxScopes * 2, MaxScopes * 2);
+		BeginScope(commandBuffer, name);
+	}
+
+	void GpuProfiler::EndFrame(VkCommandBuffer commandBuffer)
+	{
+		EndScope(commandBuffer, 0);
+	}
+
+	uint32_t GpuProfiler::BeginScope(VkCommandBuffer commandBuffer, const char* name)
+	{
+		std::vector<Scope>& scopes = m_frameScopes[m_frameIndex];
+		if (scopes.size() == MaxScopes)
+			return UINT32_MAX;
+
+		uint32_t scope = static_cast<uint32_t>(scopes.size());
+		scopes.push_back({ name, static_cast<uint32_t>(m_openScopes.size()) });
+		m_openScopes.push_back(scope);
+
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool, (m_frameIndex * MaxScopes + scope) * 2);
+		return scope;
+	}
+
+	void GpuProfiler::EndScope(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (scope == UINT32_MAX)
+			return;
+
+		m_openScopes.pop_back();
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool, (m_frameIndex * MaxScopes + scope) * 2 + 1);
+	}
+
+	bool GpuProfiler::ReadFrame(uint32_t frameIndex)
+	{
+		const std::vector<Scope>& scopes = m_frameScopes[frameIndex];
+		uint32_t queryCount = static_cast<uint32_t>(scopes.size()) * 2;
+		if (queryCount == 0)
+			return false;
+
+		//no wait flag, results that are not there yet are VK_NOT_READY rather than a stall
+		if (vkGetQueryPoolResults(m_device, m_pool, frameIndex * MaxScopes * 2, queryCount, queryCount * sizeof(uint64_t), m_ticks.data(),
+			sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+			return false;
+
+		m_lastFrame.resize(scopes.size());
+		for (size_t i = 0; i < scopes.size(); ++i)
+		{
+			GpuScopeTiming& timing = m_lastFrame[i];
+			timing.name = scopes[i].name;
+			timing.depth = scopes[i].depth;
+			timing.beginMicroseconds = ToMicroseconds(m_ticks[i * 2]) + m_clockOffset;
+			timing.durationMicroseconds = ToMicroseconds(m_ticks[i * 2 + 1] - m_ticks[i * 2]);
+
+			//a handful of scopes, a linear search beats hashing
+			ScopeStats* stats = nullptr;
+			for (ScopeStats& candidate : m_stats)
+			{
+				if (candidate.name == timing.name && candidate.depth == timing.depth)
+				{
+					stats = &candidate;
+					break;
+				}
+			}
+			if (stats == nullptr)
+			{
+				m_stats.push_back({ timing.name, timing.depth, FrameTimeHistogram() });
+				stats = &m_stats.back();
+			}
+			stats->histogram.Record(timing.durationMicroseconds);
+
+			if (m_capture)
+			{
+				m_traceEvents.push_back({ timing.name, timing.beginMicroseconds, timing.durationMicroseconds, TraceTrack });
+			}
+		}
+
+		++m_frameCount;
+		return true;
+	}
+
+	void GpuProfiler::Print(std::ostream& out) const
+	{
+		out << std::fixed << std::setprecision(1);
+		out << "gpu scopes over " << m_frameCount << " frames:\n";
+		for (const ScopeStats& stats : m_stats)
+		{
+			out << "  " << std::string(stats.depth * 2, ' ') << stats.name << ": avg " << stats.histogram.GetAverage() << "us, p99 <"
+				<< stats.histogram.GetPercentile(99.0) << "us, max " << stats.histogram.GetMax() << "us\n";
+		}
+	}
+}
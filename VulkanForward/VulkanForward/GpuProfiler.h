@@ -0,0 +1,125 @@
+#pragma once
+#include <vector>
+#include <ostream>
+#include <vulkan/vulkan.h>
+#include "FrameStats.h"
+#include "Trace.h"
+
+namespace Graphics
+{
+	//one scope of a frame read back from the GPU, begin is on the FrameClock timeline
+	struct GpuScopeTiming
+	{
+		const char* name;
+		uint32_t depth;		//0 for the frame itself
+		double beginMicroseconds;
+		double durationMicroseconds;
+	};
+
+	//Named, nested timestamp scopes in the frame's command buffer. Every frame in flight has its own range of queries,
+	//read once the frame's fence has signaled, so reading never waits on the GPU. Both ends of a scope are taken at the
+	//bottom of the pipe, once everything recorded before them is done, so sibling scopes do not overlap.
+	class GpuProfiler
+	{
+	public:
+		static const uint32_t MaxScopes = 32;		//per frame with the root, scopes past it are not timed
+		static const uint32_t TraceTrack = 0;		//track of the GPU events in a Chrome trace
+
+	private:
+		struct Scope
+		{
+			const char* name;
+			uint32_t depth;
+		};
+
+		struct ScopeStats
+		{
+			const char* name;
+			uint32_t depth;
+			FrameTimeHistogram histogram;
+		};
+
+		VkDevice m_device;
+		VkQueryPool m_pool = VK_NULL_HANDLE;
+		double m_period;				//nanoseconds per tick
+		uint64_t m_mask;				//timestampValidBits
+		double m_clockOffset = 0.0;		//FrameClock minus GPU clock, in microseconds
+
+		std::vector<std::vector<Scope>> m_frameScopes;		//what each frame in flight recorded
+		std::vector<uint32_t> m_openScopes;
+		uint32_t m_frameIndex = 0;
+
+		std::vector<uint64_t> m_ticks;
+		std::vector<GpuScopeTiming> m_lastFrame;
+		uint64_t m_frameCount = 0;
+		std::vector<ScopeStats> m_stats;
+		bool m_capture = false;
+		std::vector<TraceEvent> m_traceEvents;
+
+		inline double ToMicroseconds(uint64_t ticks) const { return (ticks & m_mask) * m_period / 1000.0; }
+
+	public:
+		//timestampValidBits of the queue family the frames are submitted to, it must not be 0
+		GpuProfiler(VkDevice device, const VkPhysicalDeviceLimits& limits, uint32_t timestampValidBits, uint32_t framesInFlight);
+		~GpuProfiler();
+
+		GpuProfiler(const GpuProfiler&) = delete;
+		GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+		//lines the GPU clock up with the FrameClock through a timestamp of a one off submission, waits for the queue.
+		//Off by at most half a submission round trip, no frame may be in flight.
+		void Calibrate(VkQueue queue, VkCommandPool commandPool);
+
+		//resets the frame's queries and opens the root scope, the GPU must be done with the frame's previous use
+		void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex, const char* name);
+		void EndFrame(VkCommandBuffer commandBuffer);
+
+		//outside render passes only, returns what EndScope takes
+		uint32_t BeginScope(VkCommandBuffer commandBuffer, const char* name);
+		void EndScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		//the frame's fence must have signaled. False when there are no results, e.g. it was recorded but not submitted
+		bool ReadFrame(uint32_t frameIndex);
+
+		//scopes of the latest frame read, the root first
+		inline const std::vector<GpuScopeTiming>& GetLastFrame() const { return m_lastFrame; }
+		inline uint64_t GetFrameCount() const { return m_frameCount; }
+
+		//frames read from now on are kept as trace events
+		inline void SetCapture(bool capture) { m_capture = capture; }
+		inline const std::vector<TraceEvent>& GetTraceEvents() const { return m_traceEvents; }
+
+		//average and p99 of every scope, indented by depth
+		void Print(std::ostream& out) const;
+	};
+
+	//ends the scope when it goes out of scope, does nothing without a profiler
+	class GpuProfileScope
+	{
+	private:
+		GpuProfiler* m_profiler;
+		VkCommandBuffer m_commandBuffer;
+		uint32_t m_scope = 0;
+
+	public:
+		GpuProfileScope(GpuProfiler* profiler, VkCommandBuffer commandBuffer, const char* name)
+			: m_profiler(profiler), m_commandBuffer(commandBuffer)
+		{
+			if (m_profiler)
+			{
+				m_scope = m_profiler->BeginScope(commandBuffer, name);
+			}
+		}
+
+		~GpuProfileScope()
+		{
+			if (m_profiler)
+			{
+				m_profiler->EndScope(m_commandBuffer, m_scope);
+			}
+		}
+
+		GpuProfileScope(const GpuProfileScope&) = delete;
+		GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+	};
+}
@@ -0,0 +1,24 @@
+#include "Hash.h"
+
+namespace Graphics
+{
+	void StateHasher::Add(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		if (m_key)
+		{
+			m_key->append(reinterpret_cast<const char*>(bytes), size);
+		}
+		for (size_t i = 0; i < size; ++i)
+		{
+			m_hash ^= bytes[i];
+			m_hash *= 1099511628211ull;
+		}
+	}
+
+	void StateHasher::Add(const std::string& text)
+	{
+		Add(text.size());
+		Add(text.data(), text.size());
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace Graphics
+{
+	//64 bit FNV-1a, stable across runs for the same input bytes. Given a key, every byte hashed is also appended
+	//to it, so two states with equal hashes can still be told apart.
+	class StateHasher
+	{
+	private:
+		uint64_t m_hash = 14695981039346656037ull;
+		std::string* m_key;
+
+	public:
+		explicit StateHasher(std::string* key = nullptr) : m_key(key) {}
+
+		void Add(const void* data, size_t size);
+		void Add(const std::string& text);
+
+		template<typename T>
+		inline void Add(const T& value) { Add(&value, sizeof(T)); }
+
+		inline uint64_t Get() const { return m_hash; }
+	};
+}
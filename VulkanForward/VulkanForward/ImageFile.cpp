@@ -0,0 +1,83 @@
+#include "ImageFile.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace Graphics
+{
+	bool WritePpm(const std::string& filename, const RgbImage& image)
+	{
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		file << "P6\n" << image.width << " " << image.height << "\n255\n";
+		file.write(reinterpret_cast<const char*>(image.pixels.data()), image.pixels.size());
+		return file.good();
+	}
+
+	//header fields are separated by whitespace and may be followed by # comments
+	static bool ReadPpmField(std::istream& in, uint32_t& value)
+	{
+		in >> std::ws;
+		while (in.peek() == '#')
+		{
+			in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+			in >> std::ws;
+		}
+		return static_cast<bool>(in >> value);
+	}
+
+	bool ReadPpm(const std::string& filename, RgbImage& image)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		char magic[2] = {};
+		if (!file.read(magic, 2) || magic[0] != 'P' || magic[1] != '6')
+			return false;
+
+		uint32_t maxValue = 0;
+		if (!ReadPpmField(file, image.width) || !ReadPpmField(file, image.height) || !ReadPpmField(file, maxValue) || maxValue != 255)
+			return false;
+		if (image.width > MaxPpmDimension || image.height > MaxPpmDimension)
+			return false;
+
+		//exactly one whitespace character separates the header from the pixels
+		file.get();
+
+		//the pixels must all be there before they are allocated
+		size_t pixelBytes = (size_t)image.width * image.height * 3;
+		std::streampos pixelStart = file.tellg();
+		file.seekg(0, std::ios::end);
+		if (!file || file.tellg() - pixelStart < (std::streamoff)pixelBytes)
+			return false;
+		file.seekg(pixelStart);
+
+		image.pixels.resize(pixelBytes);
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size()));
+	}
+
+	ImageDifference CompareImages(const RgbImage& a, const RgbImage& b, uint32_t channelTolerance)
+	{
+		ImageDifference difference;
+		if (a.width != b.width || a.height != b.height || a.pixels.size() != b.pixels.size())
+		{
+			difference.sizeMismatch = true;
+			return difference;
+		}
+
+		for (size_t pixel = 0; pixel < a.pixels.size(); pixel += 3)
+		{
+			uint32_t pixelDifference = 0;
+			for (size_t channel = pixel; channel < pixel + 3; ++channel)
+			{
+				pixelDifference = std::max(pixelDifference, (uint32_t)std::abs((int)a.pixels[channel] - (int)b.pixels[channel]));
+			}
+
+			difference.maxChannelDifference = std::max(difference.maxChannelDifference, pixelDifference);
+			difference.differingPixels += (pixelDifference > channelTolerance) ? 1 : 0;
+		}
+
+		return difference;
+	}
+}
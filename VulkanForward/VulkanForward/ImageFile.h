@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace Graphics
+{
+	//8 bit RGB pixels, rows top to bottom without padding
+	struct RgbImage
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<uint8_t> pixels;
+	};
+
+	//binary PPM (P6), readable by about every image tool without a codec. False when the file can not be written.
+	bool WritePpm(const std::string& filename, const RgbImage& image);
+
+	//larger sides are taken for a corrupt header rather than allocated
+	const uint32_t MaxPpmDimension = 16384;
+
+	//reads what WritePpm writes, 8 bit binary PPM only. False when the file is missing, not such a PPM, larger than
+	//MaxPpmDimension on a side or shorter than its header says.
+	bool ReadPpm(const std::string& filename, RgbImage& image);
+
+	struct ImageDifference
+	{
+		uint64_t differingPixels = 0;		//pixels with a channel off by more than the tolerance
+		uint32_t maxChannelDifference = 0;
+		bool sizeMismatch = false;
+	};
+
+	//per channel comparison, channelTolerance absorbs rounding differences between rasterizers
+	ImageDifference CompareImages(const RgbImage& a, const RgbImage& b, uint32_t channelTolerance);
+}
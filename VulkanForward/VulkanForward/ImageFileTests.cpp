@@ -0,0 +1,123 @@
+#include "UnitTests.h"
+#include "ImageFile.h"
+#include <filesystem>
+#include <fstream>
+
+namespace Graphics
+{
+	static std::string GetTemporaryPath(const char* name)
+	{
+		return (std::filesystem::temp_directory_path() / name).string();
+	}
+
+	static void WriteFile(const std::string& filename, const std::string& contents)
+	{
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file << contents;
+	}
+
+	static RgbImage CreateGradient(uint32_t width, uint32_t height)
+	{
+		RgbImage image;
+		image.width = width;
+		image.height = height;
+		image.pixels.resize((size_t)width * height * 3);
+		for (size_t i = 0; i < image.pixels.size(); ++i)
+		{
+			image.pixels[i] = (uint8_t)(i * 7);
+		}
+		return image;
+	}
+
+	static void TestPpmRoundTrip(TestContext& context)
+	{
+		context.BeginTest("PPM files read back what was written");
+
+		std::string filename = GetTemporaryPath("vf_test_roundtrip.ppm");
+		RgbImage written = CreateGradient(37, 11);
+		VF_CHECK(context, WritePpm(filename, written));
+
+		RgbImage read;
+		VF_CHECK(context, ReadPpm(filename, read));
+		VF_CHECK(context, read.width == 37 && read.height == 11);
+		VF_CHECK(context, read.pixels == written.pixels);
+
+		//comments and any whitespace between the header fields, pixel bytes that look like whitespace
+		WriteFile(filename, std::string("P6\n# made by hand\n2\t1\n# another\n255\n") + std::string("\n \t\r\n#", 6));
+		VF_CHECK(context, ReadPpm(filename, read));
+		VF_CHECK(context, read.width == 2 && read.height == 1 && read.pixels == std::vector<uint8_t>({ '\n', ' ', '\t', '\r', '\n', '#' }));
+
+		std::filesystem::remove(filename);
+	}
+
+	static void TestPpmRejects(TestContext& context)
+	{
+		context.BeginTest("corrupt PPM files are rejected");
+
+		std::string filename = GetTemporaryPath("vf_test_corrupt.ppm");
+		RgbImage image;
+
+		VF_CHECK(context, !ReadPpm(GetTemporaryPath("vf_test_does_not_exist.ppm"), image));
+
+		WriteFile(filename, "P3\n1 1\n255\n0 0 0\n");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		WriteFile(filename, "P6\n1 1\n65535\nabcdef");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		WriteFile(filename, "P6\n1 x\n255\nabc");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		//fewer pixels than the header says
+		WriteFile(filename, "P6\n4 4\n255\nabcdef");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		//would be 30 GB, turned down before anything is allocated
+		WriteFile(filename, "P6\n100000 100000\n255\nabc");
+		VF_CHECK(context, !ReadPpm(filename, image));
+		VF_CHECK(context, image.pixels.size() < 1024 * 1024);
+
+		WriteFile(filename, "P6\n1 " + std::to_string(MaxPpmDimension + 1) + "\n255\nabc");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		WriteFile(filename, "P6\n4294967295 4294967295\n255\nabc");
+		VF_CHECK(context, !ReadPpm(filename, image));
+
+		std::filesystem::remove(filename);
+	}
+
+	static void TestImageComparison(TestContext& context)
+	{
+		context.BeginTest("image comparison");
+
+		RgbImage a = CreateGradient(8, 8);
+		RgbImage b = a;
+
+		ImageDifference same = CompareImages(a, b, 0);
+		VF_CHECK(context, !same.sizeMismatch && same.differingPixels == 0 && same.maxChannelDifference == 0);
+
+		//two channels of one pixel and one of another, the tolerance is inclusive
+		b.pixels[3] = (uint8_t)(a.pixels[3] + 5);
+		b.pixels[5] = (uint8_t)(a.pixels[5] - 9);
+		b.pixels[30] = (uint8_t)(a.pixels[30] + 3);
+
+		ImageDifference loose = CompareImages(a, b, 9);
+		VF_CHECK(context, loose.differingPixels == 0 && loose.maxChannelDifference == 9);
+
+		ImageDifference tight = CompareImages(a, b, 4);
+		VF_CHECK(context, tight.differingPixels == 1 && tight.maxChannelDifference == 9);
+
+		ImageDifference strict = CompareImages(a, b, 0);
+		VF_CHECK(context, strict.differingPixels == 2);
+
+		ImageDifference transposed = CompareImages(a, CreateGradient(16, 4), 255);
+		VF_CHECK(context, transposed.sizeMismatch);
+	}
+
+	void RunImageFileTests(TestContext& context)
+	{
+		TestPpmRoundTrip(context);
+		TestPpmRejects(context);
+		TestImageComparison(context);
+	}
+}
@@ -0,0 +1,283 @@
+#include "JobSystem.h"
+#include "CpuTrace.h"
+#include <cassert>
+
+namespace Graphics
+{
+	//the system the calling thread belongs to, set on the creating thread and on every worker
+	static thread_local const JobSystem* t_jobSystem = nullptr;
+	static thread_local uint32_t t_threadIndex = 0;
+
+	//spins before a worker goes to sleep, stealing is cheap compared to a wake up
+	static const uint32_t IdleSpinCount = 256;
+
+	WorkStealingDeque::WorkStealingDeque()
+	{
+		for (uint32_t i = 0; i < Capacity; ++i)
+		{
+			m_jobs[i].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	bool WorkStealingDeque::Push(Job* job)
+	{
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+		int64_t top = m_top.load(std::memory_order_acquire);
+
+		if (bottom - top >= (int64_t)Capacity)
+			return false;
+
+		m_jobs[bottom & (Capacity - 1)].store(job, std::memory_order_relaxed);
+		m_bottom.store(bottom + 1, std::memory_order_release);
+		return true;
+	}
+
+	Job* WorkStealingDeque::Pop()
+	{
+		int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+		m_bottom.store(bottom, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t top = m_top.load(std::memory_order_relaxed);
+
+		if (top > bottom)
+		{
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+
+		Job* job = m_jobs[bottom & (Capacity - 1)].load(std::memory_order_relaxed);
+		if (top == bottom)
+		{
+			//last job, race the thieves for it
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				job = nullptr;
+			}
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	Job* WorkStealingDeque::Steal()
+	{
+		int64_t top = m_top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+		if (top >= bottom)
+			return nullptr;
+
+		Job* job = m_jobs[top & (Capacity - 1)].load(std::memory_order_relaxed);
+		if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return nullptr;
+
+		return job;
+	}
+
+	int64_t WorkStealingDeque::Size() const
+	{
+		return m_bottom.load(std::memory_order_relaxed) - m_top.load(std::memory_order_relaxed);
+	}
+
+	JobSystem::JobSystem(uint32_t workerCount)
+	{
+		m_contexts.resize(workerCount + 1);
+		for (uint32_t i = 0; i <= workerCount; ++i)
+		{
+			m_contexts[i] = std::make_unique<ThreadContext>();
+			m_contexts[i]->jobPool.reset(new Job[JobPoolSize]);
+			m_contexts[i]->randomState = 0x9E3779B9u * (i + 1);
+		}
+
+		t_jobSystem = this;
+		t_threadIndex = 0;
+		for (uint32_t i = 1; i <= workerCount; ++i)
+		{
+			m_workers.emplace_back(&JobSystem::WorkerLoop, this, i);
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_quit.store(true);
+		}
+		m_sleepCondition.notify_all();
+
+		for (std::thread& worker : m_workers)
+		{
+			worker.join();
+		}
+
+		if (t_jobSystem == this)
+		{
+			t_jobSystem = nullptr;
+		}
+	}
+
+	uint32_t JobSystem::GetCurrentThreadIndex()
+	{
+		return t_threadIndex;
+	}
+
+	uint32_t JobSystem::DefaultWorkerCount()
+	{
+		uint32_t hardwareThreads = std::thread::hardware_concurrency();
+		return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	void JobSystem::Run(JobFunction function, void* data, uint32_t begin, uint32_t end, JobCounter* counter)
+	{
+		//any other thread would share thread 0's deque, which only its owner may push to
+		assert(t_jobSystem == this && "jobs must be run from the thread that created the job system or one of its workers");
+		uint32_t threadIndex = GetCurrentThreadIndex();
+		assert(threadIndex < m_contexts.size());
+		ThreadContext& context = *m_contexts[threadIndex];
+
+		if (counter)
+		{
+			counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//pool slots are recycled round robin, a slot whose job is still queued means the pool is exhausted
+		Job* job = &context.jobPool[context.nextJob];
+		if (job->inUse.load(std::memory_order_acquire))
+		{
+			Job inlineJob;
+			inlineJob.function = function;
+			inlineJob.data = data;
+			inlineJob.begin = begin;
+			inlineJob.end = end;
+			inlineJob.counter = counter;
+			Execute(&inlineJob);
+			return;
+		}
+		context.nextJob = (context.nextJob + 1) % JobPoolSize;
+
+		job->function = function;
+		job->data = data;
+		job->begin = begin;
+		job->end = end;
+		job->counter = counter;
+		job->inUse.store(true, std::memory_order_relaxed);
+
+		if (!context.deque.Push(job))
+		{
+			Execute(job);
+			return;
+		}
+
+		m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+		if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+		{
+			//taking the lock orders this wake up after a worker that is about to sleep has started waiting
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+			}
+			m_sleepCondition.notify_one();
+		}
+	}
+
+	Job* JobSystem::FindJob(uint32_t threadIndex)
+	{
+		ThreadContext& context = *m_contexts[threadIndex];
+
+		Job* job = context.deque.Pop();
+		if (job == nullptr)
+		{
+			uint32_t threadCount = GetThreadCount();
+			if (threadCount > 1)
+			{
+				//xorshift picks where to start so thieves spread over the victims
+				context.randomState ^= context.randomState << 13;
+				context.randomState ^= context.randomState >> 17;
+				context.randomState ^= context.randomState << 5;
+				uint32_t start = context.randomState % threadCount;
+
+				for (uint32_t i = 0; i < threadCount && job == nullptr; ++i)
+				{
+					uint32_t victim = (start + i) % threadCount;
+					if (victim != threadIndex)
+					{
+						job = m_contexts[victim]->deque.Steal();
+					}
+				}
+			}
+		}
+
+		if (job)
+		{
+			m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		return job;
+	}
+
+	void JobSystem::Execute(Job* job)
+	{
+		{
+			CPU_TRACE_SCOPE("job");
+			job->function(job->data, job->begin, job->end);
+		}
+
+		JobCounter* counter = job->counter;
+		job->inUse.store(false, std::memory_order_release);
+
+		if (counter)
+		{
+			counter->m_pending.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void JobSystem::Wait(JobCounter& counter)
+	{
+		assert(t_jobSystem == this && "jobs must be waited on from the thread that created the job system or one of its workers");
+		uint32_t threadIndex = GetCurrentThreadIndex();
+
+		while (!counter.IsDone())
+		{
+			Job* job = FindJob(threadIndex);
+			if (job)
+			{
+				Execute(job);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void JobSystem::WorkerLoop(uint32_t threadIndex)
+	{
+		t_jobSystem = this;
+		t_threadIndex = threadIndex;
+		CPU_TRACE_THREAD_NAME("job worker " + std::to_string(threadIndex));
+		uint32_t idleSpins = 0;
+
+		while (!m_quit.load(std::memory_order_relaxed))
+		{
+			Job* job = FindJob(threadIndex);
+			if (job)
+			{
+				Execute(job);
+				idleSpins = 0;
+				continue;
+			}
+
+			if (++idleSpins < IdleSpinCount)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+			m_sleepCondition.wait(lock, [this] { return m_quit.load() || m_queuedJobs.load(std::memory_order_seq_cst) > 0; });
+			m_sleepingWorkers.fetch_sub(1, std::memory_order_seq_cst);
+			idleSpins = 0;
+		}
+	}
+}
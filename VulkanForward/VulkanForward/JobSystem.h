@@ -0,0 +1,123 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+
+namespace Graphics
+{
+	//number of jobs still outstanding for a batch, Wait on it to join
+	class JobCounter
+	{
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> m_pending{ 0 };
+
+	public:
+		inline bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+	};
+
+	//runs [begin, end) of a ranged job
+	typedef void (*JobFunction)(void* data, uint32_t begin, uint32_t end);
+
+	struct Job
+	{
+		JobFunction function = nullptr;
+		void* data = nullptr;
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		JobCounter* counter = nullptr;
+		std::atomic<bool> inUse{ false };
+	};
+
+	//Chase-Lev work stealing deque with a fixed capacity. The owning thread pushes and pops at the bottom,
+	//any other thread steals from the top.
+	class WorkStealingDeque
+	{
+	public:
+		static const uint32_t Capacity = 4096;
+
+	private:
+		std::atomic<int64_t> m_top{ 0 };
+		std::atomic<int64_t> m_bottom{ 0 };
+		std::atomic<Job*> m_jobs[Capacity];
+
+	public:
+		WorkStealingDeque();
+
+		bool Push(Job* job);
+		Job* Pop();
+		Job* Steal();
+		int64_t Size() const;
+	};
+
+	//Work stealing job scheduler. Thread 0 is the thread that created the system, it runs jobs while it waits
+	//on a counter; the other threads sleep when there is nothing to steal. Run and Wait must be called from one
+	//of the scheduler's threads, which is asserted. GetCurrentThreadIndex can index per thread resources such as
+	//command pools.
+	class JobSystem
+	{
+	public:
+		static const uint32_t JobPoolSize = 4096;
+
+	private:
+		struct ThreadContext
+		{
+			WorkStealingDeque deque;
+			std::unique_ptr<Job[]> jobPool;
+			uint32_t nextJob = 0;
+			uint32_t randomState = 0;
+		};
+
+		std::vector<std::unique_ptr<ThreadContext>> m_contexts;
+		std::vector<std::thread> m_workers;
+
+		std::atomic<uint32_t> m_queuedJobs{ 0 };
+		std::atomic<uint32_t> m_sleepingWorkers{ 0 };
+		std::atomic<bool> m_quit{ false };
+		std::mutex m_sleepMutex;
+		std::condition_variable m_sleepCondition;
+
+		void WorkerLoop(uint32_t threadIndex);
+		Job* FindJob(uint32_t threadIndex);
+		void Execute(Job* job);
+
+	public:
+		explicit JobSystem(uint32_t workerCount);
+		~JobSystem();
+
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		//queues function(data, begin, end) on the calling thread's deque, runs it inline when the deque is full
+		void Run(JobFunction function, void* data, uint32_t begin, uint32_t end, JobCounter* counter);
+
+		//runs other jobs until the counter reaches zero
+		void Wait(JobCounter& counter);
+
+		//splits [0, count) into batches of batchSize and calls body(begin, end) on every thread, returns when all are done
+		template<typename Function>
+		void ParallelFor(uint32_t count, uint32_t batchSize, Function& body)
+		{
+			JobCounter counter;
+			JobFunction trampoline = [](void* data, uint32_t begin, uint32_t end) { (*static_cast<Function*>(data))(begin, end); };
+
+			for (uint32_t begin = 0; begin < count; begin += batchSize)
+			{
+				uint32_t end = (count - begin > batchSize) ? begin + batchSize : count;
+				Run(trampoline, &body, begin, end, &counter);
+			}
+
+			Wait(counter);
+		}
+
+		inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_contexts.size()); }
+		static uint32_t GetCurrentThreadIndex();
+
+		//worker count that leaves one hardware thread for the creating thread
+		static uint32_t DefaultWorkerCount();
+	};
+}
@@ -0,0 +1,187 @@
+#include "LightClustering.h"
+#include "CpuTrace.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VF_CLUSTER_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace Graphics
+{
+	static glm::vec3 UnprojectClusterCorner(const glm::vec2& ndc, const glm::mat4& inverseProjection)
+	{
+		glm::vec4 view = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+		return glm::vec3(view) / view.w;
+	}
+
+	uint32_t SphereOverlapsClusters4(const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ, const glm::vec3& center, float radiusSquared)
+	{
+#ifdef VF_CLUSTER_SSE
+		const __m128 zero = _mm_setzero_ps();
+		__m128 cx = _mm_set1_ps(center.x);
+		__m128 cy = _mm_set1_ps(center.y);
+		__m128 cz = _mm_set1_ps(center.z);
+
+		__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(maxX)), zero));
+		__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minY), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(maxY)), zero));
+		__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minZ), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(maxZ)), zero));
+
+		__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_set1_ps(radiusSquared)));
+#else
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			float dx = std::max(minX[i] - center.x, 0.0f) + std::max(center.x - maxX[i], 0.0f);
+			float dy = std::max(minY[i] - center.y, 0.0f) + std::max(center.y - maxY[i], 0.0f);
+			float dz = std::max(minZ[i] - center.z, 0.0f) + std::max(center.z - maxZ[i], 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= radiusSquared)
+			{
+				mask |= 1u << i;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	bool SphereOverlapsCluster(const ClusterAABB& bounds, const glm::vec3& viewCenter, float radius)
+	{
+		glm::vec3 offset = viewCenter - glm::clamp(viewCenter, glm::vec3(bounds.minPoint), glm::vec3(bounds.maxPoint));
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	float GetClusterSliceDepth(uint32_t slice, float nearPlane, float farPlane)
+	{
+		return nearPlane * std::pow(farPlane / nearPlane, slice / (float)ClusterCountZ);
+	}
+
+	ClusteredLightAssigner::ClusteredLightAssigner()
+	{
+		m_bounds.resize(ClusterCount);
+		m_lightCounts.resize(ClusterCount, 0);
+		m_lightIndices.resize((size_t)ClusterCount * MaxLightsPerCluster, 0);
+
+		static_assert(ClusterCount % 4 == 0, "SIMD assignment processes clusters four at a time");
+		m_minX.resize(ClusterCount); m_minY.resize(ClusterCount); m_minZ.resize(ClusterCount);
+		m_maxX.resize(ClusterCount); m_maxY.resize(ClusterCount); m_maxZ.resize(ClusterCount);
+	}
+
+	//mirrors clusterBounds.comp: the screen rect of the cluster is projected onto the near and far depth of its slice
+	void ClusteredLightAssigner::BuildClusters(const glm::mat4& projection, float nearPlane, float farPlane)
+	{
+		m_nearPlane = nearPlane;
+		m_farPlane = farPlane;
+		glm::mat4 inverseProjection = glm::inverse(projection);
+
+		for (uint32_t z = 0; z < ClusterCountZ; ++z)
+		{
+			float sliceNear = GetClusterSliceDepth(z, nearPlane, farPlane);
+			float sliceFar = GetClusterSliceDepth(z + 1, nearPlane, farPlane);
+
+			for (uint32_t y = 0; y < ClusterCountY; ++y)
+			{
+				for (uint32_t x = 0; x < ClusterCountX; ++x)
+				{
+					glm::vec2 ndcMin(x / (float)ClusterCountX * 2.0f - 1.0f, y / (float)ClusterCountY * 2.0f - 1.0f);
+					glm::vec2 ndcMax((x + 1) / (float)ClusterCountX * 2.0f - 1.0f, (y + 1) / (float)ClusterCountY * 2.0f - 1.0f);
+
+					glm::vec3 rays[4] =
+					{
+						UnprojectClusterCorner(ndcMin, inverseProjection),
+						UnprojectClusterCorner(glm::vec2(ndcMax.x, ndcMin.y), inverseProjection),
+						UnprojectClusterCorner(ndcMax, inverseProjection),
+						UnprojectClusterCorner(glm::vec2(ndcMin.x, ndcMax.y), inverseProjection)
+					};
+
+					glm::vec3 minPoint(std::numeric_limits<float>::max());
+					glm::vec3 maxPoint(-std::numeric_limits<float>::max());
+					for (const glm::vec3& ray : rays)
+					{
+						glm::vec3 nearPoint = ray * (sliceNear / -ray.z);
+						glm::vec3 farPoint = ray * (sliceFar / -ray.z);
+						minPoint = glm::min(minPoint, glm::min(nearPoint, farPoint));
+						maxPoint = glm::max(maxPoint, glm::max(nearPoint, farPoint));
+					}
+
+					uint32_t index = GetClusterIndex(x, y, z);
+					m_bounds[index].minPoint = glm::vec4(minPoint, 1.0f);
+					m_bounds[index].maxPoint = glm::vec4(maxPoint, 1.0f);
+
+					m_minX[index] = minPoint.x; m_minY[index] = minPoint.y; m_minZ[index] = minPoint.z;
+					m_maxX[index] = maxPoint.x; m_maxY[index] = maxPoint.y; m_maxZ[index] = maxPoint.z;
+				}
+			}
+		}
+	}
+
+	//lights are visited in order so every cluster list comes out sorted. Each light only tests the
+	//slices its depth range touches, a slice is a contiguous run of ClusterCountX * ClusterCountY boxes.
+	void ClusteredLightAssigner::Assign(const std::vector<Light>& lights, const glm::mat4& view, const glm::vec2* clusterDepthRanges)
+	{
+		CPU_TRACE_SCOPE("reference cluster light assignment");
+		const uint32_t sliceSize = ClusterCountX * ClusterCountY;
+		const float logDepthRange = std::log(m_farPlane / m_nearPlane);
+
+		std::fill(m_lightCounts.begin(), m_lightCounts.end(), 0);
+		m_overflow.clear();
+
+		for (uint32_t lightIndex = 0; lightIndex < (uint32_t)lights.size(); ++lightIndex)
+		{
+			const Light& light = lights[lightIndex];
+			glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+
+			float depthMin = -center.z - light.radius;
+			float depthMax = -center.z + light.radius;
+			if (depthMax < m_nearPlane || depthMin > m_farPlane)
+				continue;
+
+			//widen by one slice on either side so float error in the log never drops a boundary cluster
+			int firstSlice = (int)std::floor(std::log(std::max(depthMin, m_nearPlane) / m_nearPlane) / logDepthRange * ClusterCountZ) - 1;
+			int lastSlice = (int)std::floor(std::log(std::min(depthMax, m_farPlane) / m_nearPlane) / logDepthRange * ClusterCountZ) + 1;
+			firstSlice = std::max(firstSlice, 0);
+			lastSlice = std::min(lastSlice, (int)ClusterCountZ - 1);
+
+			float radiusSquared = light.radius * light.radius;
+			uint32_t begin = firstSlice * sliceSize;
+			uint32_t end = (lastSlice + 1) * sliceSize;
+
+			for (uint32_t first = begin; first < end; first += 4)
+			{
+				uint32_t mask = SphereOverlapsClusters4(&m_minX[first], &m_minY[first], &m_minZ[first],
+					&m_maxX[first], &m_maxY[first], &m_maxZ[first], center, radiusSquared);
+
+				while (mask != 0)
+				{
+					uint32_t bit = 0;
+					while ((mask & (1u << bit)) == 0)
+						++bit;
+					mask &= ~(1u << bit);
+
+					uint32_t cluster = first + bit;
+					if (clusterDepthRanges && clusterDepthRanges[cluster].x > clusterDepthRanges[cluster].y)
+						continue;
+
+					uint32_t& count = m_lightCounts[cluster];
+					if (count < MaxLightsPerCluster)
+					{
+						m_lightIndices[(size_t)cluster * MaxLightsPerCluster + count] = lightIndex;
+						++count;
+					}
+					else
+					{
+						m_overflow.push_back({ cluster, lightIndex });
+					}
+				}
+			}
+		}
+	}
+
+	uint32_t ClusteredLightAssigner::CountMismatchedClusters(const uint32_t* lightCounts, const uint32_t* lightIndices) const
+	{
+		return CountMismatchedLightLists(m_lightCounts.data(), m_lightIndices.data(), lightCounts, lightIndices, ClusterCount, MaxLightsPerCluster, m_overflow);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "LightCulling.h"
+
+namespace Graphics
+{
+	//must match CLUSTER_COUNT_X/Y/Z in Shaders/common.glsl
+	const uint32_t ClusterCountX = 16;
+	const uint32_t ClusterCountY = 9;
+	const uint32_t ClusterCountZ = 24;
+	const uint32_t ClusterCount = ClusterCountX * ClusterCountY * ClusterCountZ;
+
+	//handed to the shaders as the MAX_LIGHTS_PER_CLUSTER specialization constant
+	const uint32_t MaxLightsPerCluster = 256;
+
+	//std430 layout of the cluster bounds buffer, view space.
+	struct ClusterAABB
+	{
+		glm::vec4 minPoint;
+		glm::vec4 maxPoint;
+	};
+
+	//clusters are stored slice by slice: index = (z * ClusterCountY + y) * ClusterCountX + x
+	inline uint32_t GetClusterIndex(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return (z * ClusterCountY + y) * ClusterCountX + x;
+	}
+
+	//the sphere vs box test of clusterAssign.comp, one box at a time.
+	bool SphereOverlapsCluster(const ClusterAABB& bounds, const glm::vec3& viewCenter, float radius);
+
+	//the same test against four consecutive boxes of a structure of arrays, bit i of the result is set when box i
+	//overlaps. Uses SSE2 where the target has it.
+	uint32_t SphereOverlapsClusters4(const float* minX, const float* minY, const float* minZ,
+		const float* maxX, const float* maxY, const float* maxZ, const glm::vec3& center, float radiusSquared);
+
+	//view space depth of the near boundary of a slice, slices are spaced logarithmically between near and far.
+	float GetClusterSliceDepth(uint32_t slice, float nearPlane, float farPlane);
+
+	//CPU version of clusterBounds.comp + clusterAssign.comp. Bounds are rebuilt only when the projection changes,
+	//lights are assigned every frame with a 4 wide SIMD sphere vs AABB test.
+	class ClusteredLightAssigner
+	{
+	private:
+		float m_nearPlane = 0.0f;
+		float m_farPlane = 0.0f;
+		std::vector<ClusterAABB> m_bounds;
+
+		//structure of arrays copy of m_bounds for the SIMD test
+		std::vector<float> m_minX, m_minY, m_minZ;
+		std::vector<float> m_maxX, m_maxY, m_maxZ;
+
+		std::vector<uint32_t> m_lightCounts;
+		std::vector<uint32_t> m_lightIndices;
+		std::vector<LightListOverflow> m_overflow;
+
+	public:
+		//clusters split NDC space, so they do not depend on the resolution
+		ClusteredLightAssigner();
+
+		void BuildClusters(const glm::mat4& projection, float nearPlane, float farPlane);
+		//clusterDepthRanges holds the view depth range of each cluster that has surfaces behind it, like clusterAssign.comp
+		//gets from the depth pyramid. A cluster whose range is empty (x > y) keeps no lights.
+		void Assign(const std::vector<Light>& lights, const glm::mat4& view, const glm::vec2* clusterDepthRanges = nullptr);
+
+		//number of clusters whose light set differs from the given GPU output (indices may be in any order).
+		uint32_t CountMismatchedClusters(const uint32_t* lightCounts, const uint32_t* lightIndices) const;
+
+		inline const std::vector<ClusterAABB>& GetBounds() const { return m_bounds; }
+		inline const std::vector<uint32_t>& GetLightCounts() const { return m_lightCounts; }
+		inline const std::vector<uint32_t>& GetLightIndices() const { return m_lightIndices; }
+		inline const std::vector<LightListOverflow>& GetOverflow() const { return m_overflow; }
+	};
+}
@@ -0,0 +1,281 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include "UnitTests.h"
+#include "LightClustering.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+#include <algorithm>
+
+namespace Graphics
+{
+	static const float TestNearPlane = 0.1f;
+	static const float TestFarPlane = 100.0f;
+
+	//the engine's camera at a 16:9 resolution. The view is left to the tests, so light positions can be given in view space.
+	static glm::mat4 GetTestProjection()
+	{
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, TestNearPlane, TestFarPlane);
+		projection[1][1] *= -1;
+		return projection;
+	}
+
+	static Light MakePointLight(const glm::vec3& position, float radius)
+	{
+		Light light{};
+		light.position = position;
+		light.radius = radius;
+		light.color = glm::vec3(1.0f);
+		light.intensity = 1.0f;
+		light.spotCosOuter = -1.0f;
+		return light;
+	}
+
+	static bool ClusterHoldsLight(const ClusteredLightAssigner& assigner, uint32_t cluster, uint32_t light)
+	{
+		const uint32_t* begin = &assigner.GetLightIndices()[(size_t)cluster * MaxLightsPerCluster];
+		const uint32_t* end = begin + assigner.GetLightCounts()[cluster];
+		return std::find(begin, end, light) != end;
+	}
+
+	static uint32_t CountClustersHolding(const ClusteredLightAssigner& assigner, uint32_t light)
+	{
+		uint32_t clusters = 0;
+		for (uint32_t cluster = 0; cluster < ClusterCount; ++cluster)
+		{
+			clusters += ClusterHoldsLight(assigner, cluster, light) ? 1 : 0;
+		}
+		return clusters;
+	}
+
+	static void TestSphereClusterGeometry(TestContext& context)
+	{
+		context.BeginTest("sphere vs cluster box");
+
+		ClusterAABB box;
+		box.minPoint = glm::vec4(-1.0f, -1.0f, -2.0f, 1.0f);
+		box.maxPoint = glm::vec4(1.0f, 1.0f, -1.0f, 1.0f);
+
+		VF_CHECK(context, SphereOverlapsCluster(box, glm::vec3(0.0f, 0.0f, -1.5f), 0.01f));
+		VF_CHECK(context, SphereOverlapsCluster(box, glm::vec3(3.0f, 0.0f, -1.5f), 2.0f));
+		VF_CHECK(context, !SphereOverlapsCluster(box, glm::vec3(3.0f, 0.0f, -1.5f), 1.99f));
+		VF_CHECK(context, SphereOverlapsCluster(box, glm::vec3(0.0f, 0.0f, 0.5f), 1.5f));
+		VF_CHECK(context, !SphereOverlapsCluster(box, glm::vec3(0.0f, 0.0f, -4.0f), 1.9f));
+
+		//past a corner the distance is to the corner, not to the nearest face
+		VF_CHECK(context, SphereOverlapsCluster(box, glm::vec3(2.0f, 2.0f, 0.0f), 1.75f));
+		VF_CHECK(context, !SphereOverlapsCluster(box, glm::vec3(2.0f, 2.0f, 0.0f), 1.7f));
+
+		//four boxes at once: the box, one stretched to hold the center, one far away and a point at the center
+		float minX[4] = { -1.0f, 0.0f, 50.0f, 3.0f };
+		float minY[4] = { -1.0f, -1.0f, -1.0f, 0.0f };
+		float minZ[4] = { -2.0f, -2.0f, -2.0f, -1.5f };
+		float maxX[4] = { 1.0f, 3.0f, 52.0f, 3.0f };
+		float maxY[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+		float maxZ[4] = { -1.0f, -1.0f, -1.0f, -1.5f };
+		VF_CHECK(context, SphereOverlapsClusters4(minX, minY, minZ, maxX, maxY, maxZ, glm::vec3(3.0f, 0.0f, -1.5f), 4.0f) == 0xb);
+		VF_CHECK(context, SphereOverlapsClusters4(minX, minY, minZ, maxX, maxY, maxZ, glm::vec3(3.0f, 0.0f, -1.5f), 0.0f) == 0xa);
+		VF_CHECK(context, SphereOverlapsClusters4(minX, minY, minZ, maxX, maxY, maxZ, glm::vec3(-10.0f, 0.0f, -1.5f), 1.0f) == 0);
+	}
+
+	//random boxes and spheres, a quarter of the centers snapped onto a face so touching spheres are covered
+	static void TestSimdMatchesScalar(TestContext& context)
+	{
+		context.BeginTest("4 wide sphere vs cluster test matches the scalar one");
+
+		std::mt19937 generator(7);
+		std::uniform_real_distribution<float> coordinate(-10.0f, 10.0f);
+		std::uniform_real_distribution<float> extent(0.0f, 5.0f);
+		std::uniform_real_distribution<float> radius(0.0f, 10.0f);
+
+		uint32_t mismatches = 0;
+		uint32_t overlaps = 0;
+		for (uint32_t trial = 0; trial < 4096; ++trial)
+		{
+			float minX[4], minY[4], minZ[4], maxX[4], maxY[4], maxZ[4];
+			ClusterAABB boxes[4];
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				glm::vec3 minPoint(coordinate(generator), coordinate(generator), coordinate(generator));
+				glm::vec3 maxPoint = minPoint + glm::vec3(extent(generator), extent(generator), extent(generator));
+				minX[i] = minPoint.x; minY[i] = minPoint.y; minZ[i] = minPoint.z;
+				maxX[i] = maxPoint.x; maxY[i] = maxPoint.y; maxZ[i] = maxPoint.z;
+				boxes[i].minPoint = glm::vec4(minPoint, 1.0f);
+				boxes[i].maxPoint = glm::vec4(maxPoint, 1.0f);
+			}
+
+			glm::vec3 center(coordinate(generator), coordinate(generator), coordinate(generator));
+			if (trial % 4 == 0)
+			{
+				center.x = maxX[trial / 4 % 4];
+			}
+			float sphereRadius = radius(generator);
+
+			uint32_t mask = SphereOverlapsClusters4(minX, minY, minZ, maxX, maxY, maxZ, center, sphereRadius * sphereRadius);
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				bool expected = SphereOverlapsCluster(boxes[i], center, sphereRadius);
+				mismatches += expected != ((mask & (1u << i)) != 0) ? 1 : 0;
+				overlaps += expected ? 1 : 0;
+			}
+		}
+
+		VF_CHECK(context, mismatches == 0);
+		VF_CHECK(context, overlaps > 1000 && overlaps < 4096 * 4 - 1000);
+	}
+
+	//the slice range Assign narrows each light to must never lose a cluster the plain test finds
+	static void TestAssignmentMatchesBruteForce(TestContext& context)
+	{
+		context.BeginTest("cluster assignment matches testing every cluster");
+
+		ClusteredLightAssigner assigner;
+		assigner.BuildClusters(GetTestProjection(), TestNearPlane, TestFarPlane);
+		const std::vector<ClusterAABB>& bounds = assigner.GetBounds();
+
+		std::mt19937 generator(1337);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<Light> lights;
+		for (uint32_t i = 0; i < 512; ++i)
+		{
+			float depth = TestNearPlane + (TestFarPlane + 10.0f) * unit(generator) * unit(generator);
+			glm::vec3 position((unit(generator) * 2.0f - 1.0f) * depth, (unit(generator) * 2.0f - 1.0f) * depth * 0.6f, -depth);
+			lights.push_back(MakePointLight(position, 0.05f + unit(generator) * 4.0f));
+		}
+
+		assigner.Assign(lights, glm::mat4(1.0f));
+
+		std::vector<uint32_t> expectedCounts(ClusterCount, 0);
+		std::vector<uint32_t> expectedIndices((size_t)ClusterCount * MaxLightsPerCluster, 0);
+		for (uint32_t cluster = 0; cluster < ClusterCount; ++cluster)
+		{
+			for (uint32_t i = 0; i < (uint32_t)lights.size(); ++i)
+			{
+				if (SphereOverlapsCluster(bounds[cluster], lights[i].position, lights[i].radius) && expectedCounts[cluster] < MaxLightsPerCluster)
+				{
+					expectedIndices[(size_t)cluster * MaxLightsPerCluster + expectedCounts[cluster]++] = i;
+				}
+			}
+		}
+
+		VF_CHECK(context, assigner.GetOverflow().empty());
+		VF_CHECK(context, assigner.CountMismatchedClusters(expectedCounts.data(), expectedIndices.data()) == 0);
+
+		//Assign visits lights in order, so its lists are the brute force lists exactly, not just the same sets
+		VF_CHECK(context, assigner.GetLightCounts() == expectedCounts);
+		bool sameOrder = true;
+		for (uint32_t cluster = 0; cluster < ClusterCount; ++cluster)
+		{
+			size_t first = (size_t)cluster * MaxLightsPerCluster;
+			sameOrder = sameOrder && std::equal(&expectedIndices[first], &expectedIndices[first] + expectedCounts[cluster], &assigner.GetLightIndices()[first]);
+		}
+		VF_CHECK(context, sameOrder);
+	}
+
+	static void TestLightsStraddlingNearAndFar(TestContext& context)
+	{
+		context.BeginTest("lights straddling the near and far planes");
+
+		ClusteredLightAssigner assigner;
+		assigner.BuildClusters(GetTestProjection(), TestNearPlane, TestFarPlane);
+
+		std::vector<Light> lights =
+		{
+			MakePointLight(glm::vec3(0.0f, 0.0f, -TestNearPlane * 0.5f), 0.2f),			//center in front of the near plane
+			MakePointLight(glm::vec3(0.0f, 0.0f, -TestFarPlane - 1.0f), 2.0f),			//center past the far plane
+			MakePointLight(glm::vec3(0.0f, 0.0f, 5.0f), 1.0f),							//behind the eye
+			MakePointLight(glm::vec3(0.0f, 0.0f, -TestFarPlane - 5.0f), 1.0f),			//entirely past the far plane
+			MakePointLight(glm::vec3(0.0f, 0.0f, -TestNearPlane * 0.5f), TestNearPlane * 0.25f)	//entirely before the near plane
+		};
+		assigner.Assign(lights, glm::mat4(1.0f));
+
+		uint32_t centerX = ClusterCountX / 2;
+		uint32_t centerY = ClusterCountY / 2;
+		VF_CHECK(context, ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, 0), 0));
+		VF_CHECK(context, !ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, ClusterCountZ - 1), 0));
+		VF_CHECK(context, ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, ClusterCountZ - 1), 1));
+		VF_CHECK(context, !ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, 0), 1));
+
+		VF_CHECK(context, CountClustersHolding(assigner, 2) == 0);
+		VF_CHECK(context, CountClustersHolding(assigner, 3) == 0);
+		VF_CHECK(context, CountClustersHolding(assigner, 4) == 0);
+
+		//with the depth pyramid's ranges, a slice with nothing drawn in it keeps no lights
+		std::vector<glm::vec2> depthRanges(ClusterCount, glm::vec2(TestNearPlane, TestFarPlane));
+		for (uint32_t cluster = GetClusterIndex(0, 0, 0); cluster < GetClusterIndex(0, 0, 1); ++cluster)
+		{
+			depthRanges[cluster] = glm::vec2(1.0f, 0.0f);
+		}
+		assigner.Assign(lights, glm::mat4(1.0f), depthRanges.data());
+		VF_CHECK(context, !ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, 0), 0));
+		VF_CHECK(context, ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, 1), 0));
+		VF_CHECK(context, ClusterHoldsLight(assigner, GetClusterIndex(centerX, centerY, ClusterCountZ - 1), 1));
+	}
+
+	//more lights on one spot than a cluster holds. The reference keeps the first ones by index, the GPU any of them.
+	static void TestClusterCap(TestContext& context)
+	{
+		context.BeginTest("full clusters");
+
+		ClusteredLightAssigner assigner;
+		assigner.BuildClusters(GetTestProjection(), TestNearPlane, TestFarPlane);
+
+		const uint32_t lightCount = MaxLightsPerCluster + 44;
+		std::vector<Light> lights(lightCount, MakePointLight(glm::vec3(0.3f, 0.2f, -10.0f), 0.5f));
+		lights.push_back(MakePointLight(glm::vec3(0.0f, 0.0f, 50.0f), 1.0f));		//behind the eye, in no cluster
+		assigner.Assign(lights, glm::mat4(1.0f));
+
+		const std::vector<uint32_t>& counts = assigner.GetLightCounts();
+		const std::vector<uint32_t>& indices = assigner.GetLightIndices();
+		uint32_t fullClusters = 0;
+		bool firstByIndex = true;
+		for (uint32_t cluster = 0; cluster < ClusterCount; ++cluster)
+		{
+			VF_CHECK(context, counts[cluster] == 0 || counts[cluster] == MaxLightsPerCluster);
+			if (counts[cluster] == MaxLightsPerCluster)
+			{
+				++fullClusters;
+				for (uint32_t i = 0; i < MaxLightsPerCluster; ++i)
+				{
+					firstByIndex = firstByIndex && indices[(size_t)cluster * MaxLightsPerCluster + i] == i;
+				}
+			}
+		}
+		VF_CHECK(context, fullClusters > 0);
+		VF_CHECK(context, firstByIndex);
+		VF_CHECK(context, assigner.GetOverflow().size() == (size_t)fullClusters * (lightCount - MaxLightsPerCluster));
+
+		//a GPU grid that kept the last lights instead, in reverse, still matches
+		std::vector<uint32_t> gpuCounts = counts;
+		std::vector<uint32_t> gpuIndices = indices;
+		for (uint32_t cluster = 0; cluster < ClusterCount; ++cluster)
+		{
+			for (uint32_t i = 0; i < gpuCounts[cluster]; ++i)
+			{
+				gpuIndices[(size_t)cluster * MaxLightsPerCluster + i] = lightCount - 1 - i;
+			}
+		}
+		VF_CHECK(context, assigner.CountMismatchedClusters(gpuCounts.data(), gpuIndices.data()) == 0);
+
+		//without the overflow the reference only accepts its own lights
+		VF_CHECK(context, CountMismatchedLightLists(counts.data(), indices.data(), gpuCounts.data(), gpuIndices.data(),
+			ClusterCount, MaxLightsPerCluster) == fullClusters);
+
+		//a light that is no candidate, or a full list cut short, is still caught
+		uint32_t full = (uint32_t)(std::find(counts.begin(), counts.end(), MaxLightsPerCluster) - counts.begin());
+		gpuIndices[(size_t)full * MaxLightsPerCluster] = lightCount;
+		VF_CHECK(context, assigner.CountMismatchedClusters(gpuCounts.data(), gpuIndices.data()) == 1);
+
+		gpuIndices[(size_t)full * MaxLightsPerCluster] = 0;
+		gpuCounts[full] = MaxLightsPerCluster - 1;
+		VF_CHECK(context, assigner.CountMismatchedClusters(gpuCounts.data(), gpuIndices.data()) == 1);
+	}
+
+	void RunLightClusteringTests(TestContext& context)
+	{
+		TestSphereClusterGeometry(context);
+		TestSimdMatchesScalar(context);
+		TestAssignmentMatchesBruteForce(context);
+		TestLightsStraddlingNearAndFar(context);
+		TestClusterCap(context);
+	}
+}
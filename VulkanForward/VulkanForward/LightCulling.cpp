@@ -0,0 +1,171 @@
+#include "LightCulling.h"
+#include "CpuTrace.h"
+#include <algorithm>
+
+namespace Graphics
+{
+	static glm::vec3 UnprojectPixel(const glm::vec2& pixel, uint32_t width, uint32_t height, const glm::mat4& inverseProjection)
+	{
+		glm::vec2 ndc = pixel / glm::vec2((float)width, (float)height) * 2.0f - 1.0f;
+		glm::vec4 view = inverseProjection * glm::vec4(ndc, 1.0f, 1.0f);
+		return glm::vec3(view) / view.w;
+	}
+
+	TileFrustum BuildTileFrustum(uint32_t tileX, uint32_t tileY, uint32_t width, uint32_t height, const glm::mat4& inverseProjection)
+	{
+		glm::vec2 minPixel((float)(tileX * TileSize), (float)(tileY * TileSize));
+		glm::vec2 maxPixel(std::min((float)((tileX + 1) * TileSize), (float)width), std::min((float)((tileY + 1) * TileSize), (float)height));
+
+		glm::vec3 corners[4] =
+		{
+			UnprojectPixel(minPixel, width, height, inverseProjection),
+			UnprojectPixel(glm::vec2(maxPixel.x, minPixel.y), width, height, inverseProjection),
+			UnprojectPixel(maxPixel, width, height, inverseProjection),
+			UnprojectPixel(glm::vec2(minPixel.x, maxPixel.y), width, height, inverseProjection)
+		};
+		glm::vec3 center = UnprojectPixel((minPixel + maxPixel) * 0.5f, width, height, inverseProjection);
+
+		//orient against the tile center so the result does not depend on projection handedness or y flip
+		TileFrustum frustum;
+		for (int i = 0; i < 4; ++i)
+		{
+			glm::vec3 normal = glm::normalize(glm::cross(corners[i], corners[(i + 1) % 4]));
+			if (glm::dot(normal, center) < 0.0f)
+			{
+				normal = -normal;
+			}
+			frustum.planes[i] = glm::vec4(normal, 0.0f);
+		}
+
+		return frustum;
+	}
+
+	bool SphereIntersectsTile(const TileFrustum& frustum, const glm::vec3& viewCenter, float radius, float minDepth, float maxDepth)
+	{
+		float depth = -viewCenter.z;
+		if (depth + radius < minDepth || depth - radius > maxDepth)
+			return false;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			if (glm::dot(glm::vec3(frustum.planes[i]), viewCenter) < -radius)
+				return false;
+		}
+
+		return true;
+	}
+
+	//expected is set to the lights of one reference list and any that overflowed it, sorted. overflow is sorted by list
+	//and next walks it as the lists are visited in order.
+	static void GatherExpectedLights(const uint32_t* expectedCounts, const uint32_t* expectedIndices, uint32_t list, uint32_t listStride,
+		const std::vector<LightListOverflow>& overflow, size_t& next, std::vector<uint32_t>& expected)
+	{
+		const uint32_t* expectedBegin = &expectedIndices[(size_t)list * listStride];
+		expected.assign(expectedBegin, expectedBegin + expectedCounts[list]);
+		for (; next < overflow.size() && overflow[next].list == list; ++next)
+		{
+			expected.push_back(overflow[next].light);
+		}
+		std::sort(expected.begin(), expected.end());
+	}
+
+	static std::vector<LightListOverflow> SortOverflowByList(const std::vector<LightListOverflow>& overflow)
+	{
+		std::vector<LightListOverflow> sorted = overflow;
+		std::sort(sorted.begin(), sorted.end(), [](const LightListOverflow& a, const LightListOverflow& b) { return a.list < b.list; });
+		return sorted;
+	}
+
+	uint32_t CountMismatchedLightLists(const uint32_t* expectedCounts, const uint32_t* expectedIndices,
+		const uint32_t* actualCounts, const uint32_t* actualIndices, uint32_t listCount, uint32_t listStride,
+		const std::vector<LightListOverflow>& expectedOverflow)
+	{
+		uint32_t mismatched = 0;
+		std::vector<uint32_t> expected, actual;
+		std::vector<LightListOverflow> overflow = SortOverflowByList(expectedOverflow);
+		size_t nextOverflow = 0;
+
+		for (uint32_t list = 0; list < listCount; ++list)
+		{
+			GatherExpectedLights(expectedCounts, expectedIndices, list, listStride, overflow, nextOverflow, expected);
+			if (actualCounts[list] != expectedCounts[list])
+			{
+				++mismatched;
+				continue;
+			}
+
+			const uint32_t* actualBegin = &actualIndices[(size_t)list * listStride];
+			actual.assign(actualBegin, actualBegin + actualCounts[list]);
+			std::sort(actual.begin(), actual.end());
+
+			//a full list may hold any of the candidates
+			bool full = actualCounts[list] == listStride;
+			if (full ? !std::includes(expected.begin(), expected.end(), actual.begin(), actual.end()) : expected != actual)
+			{
+				++mismatched;
+			}
+		}
+
+		return mismatched;
+	}
+
+	TileLightCuller::TileLightCuller(uint32_t width, uint32_t height)
+	{
+		m_width = width;
+		m_height = height;
+		m_tileCountX = (width + TileSize - 1) / TileSize;
+		m_tileCountY = (height + TileSize - 1) / TileSize;
+		m_lightCounts.resize(GetTileCount(), 0);
+		m_lightIndices.resize((size_t)GetTileCount() * MaxLightsPerTile, 0);
+	}
+
+	void TileLightCuller::Cull(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+		const glm::vec2* tileDepthBounds)
+	{
+		CPU_TRACE_SCOPE("reference tile light culling");
+		glm::mat4 inverseProjection = glm::inverse(projection);
+
+		m_overflow.clear();
+
+		std::vector<glm::vec3> viewCenters(lights.size());
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			viewCenters[i] = glm::vec3(view * glm::vec4(lights[i].position, 1.0f));
+		}
+
+		for (uint32_t y = 0; y < m_tileCountY; ++y)
+		{
+			for (uint32_t x = 0; x < m_tileCountX; ++x)
+			{
+				uint32_t tileIndex = y * m_tileCountX + x;
+				TileFrustum frustum = BuildTileFrustum(x, y, m_width, m_height, inverseProjection);
+				glm::vec2 depthBounds = tileDepthBounds ? tileDepthBounds[tileIndex] : glm::vec2(nearPlane, farPlane);
+
+				uint32_t count = 0;
+				uint32_t* tileLights = &m_lightIndices[(size_t)tileIndex * MaxLightsPerTile];
+
+				for (uint32_t i = 0; i < (uint32_t)lights.size(); ++i)
+				{
+					if (!SphereIntersectsTile(frustum, viewCenters[i], lights[i].radius, depthBounds.x, depthBounds.y))
+						continue;
+
+					if (count < MaxLightsPerTile)
+					{
+						tileLights[count++] = i;
+					}
+					else
+					{
+						m_overflow.push_back({ tileIndex, i });
+					}
+				}
+
+				m_lightCounts[tileIndex] = count;
+			}
+		}
+	}
+
+	uint32_t TileLightCuller::CountMismatchedTiles(const uint32_t* lightCounts, const uint32_t* lightIndices) const
+	{
+		return CountMismatchedLightLists(m_lightCounts.data(), m_lightIndices.data(), lightCounts, lightIndices, GetTileCount(), MaxLightsPerTile, m_overflow);
+	}
+}
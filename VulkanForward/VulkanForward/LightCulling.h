@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+namespace Graphics
+{
+	//handed to the shaders as TILE_SIZE and MAX_LIGHTS_PER_TILE specialization constants
+	const uint32_t TileSize = 16;
+	const uint32_t MaxLightsPerTile = 256;
+	const uint32_t MaxLights = 4096;
+
+	//constant_id of the specialization constants in Shaders/common.glsl
+	const uint32_t LightCullingModeConstantId = 0;
+	const uint32_t TileSizeConstantId = 1;
+	const uint32_t MaxLightsPerTileConstantId = 2;
+	const uint32_t MaxLightsPerClusterConstantId = 3;
+	const uint32_t HiZDepthBoundsConstantId = 5;		//HIZ_DEPTH_BOUNDS in Shaders/hiz.glsl
+
+	//how lights are binned for the forward pass, chosen at VP_InitVulkan
+	enum class LightCullingMode
+	{
+		Tiled,		//2D screen tiles bounded by depth, LIGHT_CULLING_TILED in the shaders
+		Clustered	//3D froxels with logarithmic depth slices, LIGHT_CULLING_CLUSTERED
+	};
+
+	//std430 layout of the light buffer. Spot lights store the cosine of their outer cone angle,
+	//point lights store -1. Both are culled against their bounding sphere.
+	struct Light
+	{
+		glm::vec3 position;
+		float radius;
+		glm::vec3 color;
+		float intensity;
+		glm::vec3 direction;
+		float spotCosOuter;
+	};
+
+	//view space planes through the eye bounding one screen tile, normals point into the tile.
+	struct TileFrustum
+	{
+		glm::vec4 planes[4];
+	};
+
+	//a light that passed the test for a list that was already full. The GPU keeps whichever candidates win the race for
+	//a full list's slots, so the references record the rest to check those lists against every candidate.
+	struct LightListOverflow
+	{
+		uint32_t list;
+		uint32_t light;
+	};
+
+	TileFrustum BuildTileFrustum(uint32_t tileX, uint32_t tileY, uint32_t width, uint32_t height, const glm::mat4& inverseProjection);
+	bool SphereIntersectsTile(const TileFrustum& frustum, const glm::vec3& viewCenter, float radius, float minDepth, float maxDepth);
+
+	//compares two sets of fixed stride light lists ignoring index order, returns the number of lists that differ.
+	//Full lists only need the same count and lights from the expected list or its overflow.
+	uint32_t CountMismatchedLightLists(const uint32_t* expectedCounts, const uint32_t* expectedIndices,
+		const uint32_t* actualCounts, const uint32_t* actualIndices, uint32_t listCount, uint32_t listStride,
+		const std::vector<LightListOverflow>& expectedOverflow = {});
+
+	//CPU reference of lightCulling.comp. Produces the same per tile light lists so they can be validated without a GPU.
+	class TileLightCuller
+	{
+	private:
+		uint32_t m_width;
+		uint32_t m_height;
+		uint32_t m_tileCountX;
+		uint32_t m_tileCountY;
+		std::vector<uint32_t> m_lightCounts;
+		std::vector<uint32_t> m_lightIndices;
+		std::vector<LightListOverflow> m_overflow;
+
+	public:
+		TileLightCuller(uint32_t width, uint32_t height);
+
+		//tileDepthBounds holds the nearest and farthest view depth drawn in each tile, like the GPU gets from the depth
+		//pyramid. Without it every tile spans the near to far plane.
+		void Cull(const std::vector<Light>& lights, const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane,
+			const glm::vec2* tileDepthBounds = nullptr);
+
+		//number of tiles whose light set differs from the given GPU output (indices may be in any order).
+		uint32_t CountMismatchedTiles(const uint32_t* lightCounts, const uint32_t* lightIndices) const;
+
+		inline uint32_t GetTileCountX() const { return m_tileCountX; }
+		inline uint32_t GetTileCountY() const { return m_tileCountY; }
+		inline uint32_t GetTileCount() const { return m_tileCountX * m_tileCountY; }
+		inline const std::vector<uint32_t>& GetLightCounts() const { return m_lightCounts; }
+		inline const std::vector<uint32_t>& GetLightIndices() const { return m_lightIndices; }
+		inline const std::vector<LightListOverflow>& GetOverflow() const { return m_overflow; }
+	};
+}
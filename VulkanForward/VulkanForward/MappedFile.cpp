@@ -0,0 +1,128 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Graphics
+{
+#ifdef _WIN32
+	MappedFile::MappedFile(const std::string& filename)
+	{
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("failed to open " + filename);
+		}
+		m_file = file;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			Close();
+			throw std::runtime_error("failed to read the size of " + filename);
+		}
+
+		m_size = static_cast<size_t>(size.QuadPart);
+		if (m_size == 0)
+			return;
+
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		m_data = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		if (!m_data)
+		{
+			Close();
+			throw std::runtime_error("failed to map " + filename);
+		}
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			UnmapViewOfFile(m_data);
+		if (m_mapping)
+			CloseHandle(m_mapping);
+		if (m_file)
+			CloseHandle(m_file);
+
+		m_data = nullptr;
+		m_mapping = nullptr;
+		m_file = nullptr;
+		m_size = 0;
+	}
+#else
+	MappedFile::MappedFile(const std::string& filename)
+	{
+		int file = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (file < 0)
+		{
+			throw std::runtime_error("failed to open " + filename);
+		}
+
+		struct stat status;
+		if (fstat(file, &status) != 0)
+		{
+			close(file);
+			throw std::runtime_error("failed to read the size of " + filename);
+		}
+
+		//the mapping keeps the file alive on its own, the descriptor is not needed past this point
+		m_size = static_cast<size_t>(status.st_size);
+		if (m_size > 0)
+		{
+			void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+			if (data == MAP_FAILED)
+			{
+				close(file);
+				m_size = 0;
+				throw std::runtime_error("failed to map " + filename);
+			}
+			m_data = data;
+		}
+		close(file);
+	}
+
+	void MappedFile::Close()
+	{
+		if (m_data)
+			munmap(const_cast<void*>(m_data), m_size);
+
+		m_data = nullptr;
+		m_size = 0;
+	}
+#endif
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			std::swap(m_data, other.m_data);
+			std::swap(m_size, other.m_size);
+#ifdef _WIN32
+			std::swap(m_file, other.m_file);
+			std::swap(m_mapping, other.m_mapping);
+#endif
+		}
+		return *this;
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+namespace Graphics
+{
+	//Read only view of a whole file through the OS page cache, pages are read in as they are touched and nothing
+	//is copied. The mapping starts on a page boundary, so the data is aligned for any type. On Windows the file
+	//can not be replaced while it is mapped, keep the mapping only as long as it is read.
+	class MappedFile
+	{
+	private:
+		const void* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+
+		void Close();
+
+	public:
+		//no file, no data
+		MappedFile() = default;
+
+		//throws std::runtime_error when the file can not be opened or mapped, an empty file maps to no data
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		inline const void* GetData() const { return m_data; }
+		inline const char* GetChars() const { return static_cast<const char*>(m_data); }
+		inline size_t GetSize() const { return m_size; }
+	};
+}
@@ -0,0 +1,719 @@
+#include "MemoryAllocator.h"
+#include <algorithm>
+#include <stdexcept>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Graphics
+{
+	static uint32_t FindLowestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return (uint32_t)index;
+#else
+		return (uint32_t)__builtin_ctzll(value);
+#endif
+	}
+
+	static uint32_t FindHighestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return (uint32_t)index;
+#else
+		return 63u - (uint32_t)__builtin_clzll(value);
+#endif
+	}
+
+	static uint32_t CountBits(uint32_t value)
+	{
+		uint32_t count = 0;
+		for (; value; value &= value - 1)
+		{
+			++count;
+		}
+		return count;
+	}
+
+	static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	//One VkDeviceMemory and the TLSF index over its free ranges. Chunks tile the block in offset order,
+	//neighbouring free chunks are always merged.
+	class MemoryBlock
+	{
+	public:
+		static const uint32_t Null = UINT32_MAX;
+		static const uint32_t SecondLevelBits = 4;
+		static const uint32_t SecondLevelCount = 1 << SecondLevelBits;
+		static const uint32_t FirstLevelCount = 64;
+
+		struct Chunk
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			uint32_t prevPhysical;
+			uint32_t nextPhysical;
+			uint32_t prevFree;
+			uint32_t nextFree;
+			bool free;
+		};
+
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		void* mapped;
+		uint32_t memoryTypeIndex;
+		ResourceKind kind;
+		bool dedicated;
+		uint32_t allocationCount = 0;
+		VkDeviceSize usedBytes = 0;
+
+	private:
+		std::vector<Chunk> m_chunks;
+		std::vector<uint32_t> m_unusedChunks;
+		uint64_t m_firstLevelBitmap = 0;
+		uint32_t m_secondLevelBitmap[FirstLevelCount] = {};
+		uint32_t m_freeHeads[FirstLevelCount][SecondLevelCount];
+
+		//size class of a free range: first level is the power of two, second level splits it linearly
+		static void Mapping(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+		{
+			if (size < SecondLevelCount)
+			{
+				firstLevel = 0;
+				secondLevel = (uint32_t)size;
+				return;
+			}
+
+			uint32_t log = FindHighestBit(size);
+			firstLevel = log - SecondLevelBits + 1;
+			secondLevel = (uint32_t)(size >> (log - SecondLevelBits)) - SecondLevelCount;
+		}
+
+		uint32_t NewChunk()
+		{
+			if (!m_unusedChunks.empty())
+			{
+				uint32_t index = m_unusedChunks.back();
+				m_unusedChunks.pop_back();
+				return index;
+			}
+
+			m_chunks.push_back(Chunk{});
+			return (uint32_t)m_chunks.size() - 1;
+		}
+
+		void ReleaseChunk(uint32_t index)
+		{
+			m_unusedChunks.push_back(index);
+		}
+
+		void InsertFree(uint32_t index)
+		{
+			Chunk& chunk = m_chunks[index];
+			uint32_t firstLevel, secondLevel;
+			Mapping(chunk.size, firstLevel, secondLevel);
+
+			chunk.free = true;
+			chunk.prevFree = Null;
+			chunk.nextFree = m_freeHeads[firstLevel][secondLevel];
+			if (chunk.nextFree != Null)
+			{
+				m_chunks[chunk.nextFree].prevFree = index;
+			}
+
+			m_freeHeads[firstLevel][secondLevel] = index;
+			m_firstLevelBitmap |= 1ull << firstLevel;
+			m_secondLevelBitmap[firstLevel] |= 1u << secondLevel;
+		}
+
+		void RemoveFree(uint32_t index)
+		{
+			Chunk& chunk = m_chunks[index];
+			uint32_t firstLevel, secondLevel;
+			Mapping(chunk.size, firstLevel, secondLevel);
+
+			if (chunk.prevFree != Null)
+			{
+				m_chunks[chunk.prevFree].nextFree = chunk.nextFree;
+			}
+			else
+			{
+				m_freeHeads[firstLevel][secondLevel] = chunk.nextFree;
+			}
+
+			if (chunk.nextFree != Null)
+			{
+				m_chunks[chunk.nextFree].prevFree = chunk.prevFree;
+			}
+
+			if (m_freeHeads[firstLevel][secondLevel] == Null)
+			{
+				m_secondLevelBitmap[firstLevel] &= ~(1u << secondLevel);
+				if (m_secondLevelBitmap[firstLevel] == 0)
+				{
+					m_firstLevelBitmap &= ~(1ull << firstLevel);
+				}
+			}
+
+			chunk.free = false;
+		}
+
+		//head of the first non empty list whose ranges are all at least size
+		uint32_t FindFree(VkDeviceSize size) const
+		{
+			if (size >= SecondLevelCount)
+			{
+				size += (1ull << (FindHighestBit(size) - SecondLevelBits)) - 1;
+			}
+
+			uint32_t firstLevel, secondLevel;
+			Mapping(size, firstLevel, secondLevel);
+			if (firstLevel >= FirstLevelCount)
+				return Null;
+
+			uint32_t secondLevelMap = m_secondLevelBitmap[firstLevel] & (~0u << secondLevel);
+			if (secondLevelMap == 0)
+			{
+				uint64_t firstLevelMap = (firstLevel + 1 < FirstLevelCount) ? m_firstLevelBitmap & (~0ull << (firstLevel + 1)) : 0;
+				if (firstLevelMap == 0)
+					return Null;
+
+				firstLevel = FindLowestBit(firstLevelMap);
+				secondLevelMap = m_secondLevelBitmap[firstLevel];
+			}
+
+			return m_freeHeads[firstLevel][FindLowestBit(secondLevelMap)];
+		}
+
+		//splits the tail of a chunk off into a new free chunk
+		void SplitTail(uint32_t index, VkDeviceSize size)
+		{
+			uint32_t tail = NewChunk();
+			Chunk& chunk = m_chunks[index];
+			Chunk& tailChunk = m_chunks[tail];
+
+			tailChunk.offset = chunk.offset + size;
+			tailChunk.size = chunk.size - size;
+			tailChunk.prevPhysical = index;
+			tailChunk.nextPhysical = chunk.nextPhysical;
+			if (chunk.nextPhysical != Null)
+			{
+				m_chunks[chunk.nextPhysical].prevPhysical = tail;
+			}
+
+			chunk.size = size;
+			chunk.nextPhysical = tail;
+			InsertFree(tail);
+		}
+
+		//folds a chunk into its lower neighbour, both must be out of the free lists
+		void MergeIntoPrevious(uint32_t index)
+		{
+			Chunk& chunk = m_chunks[index];
+			Chunk& previous = m_chunks[chunk.prevPhysical];
+
+			previous.size += chunk.size;
+			previous.nextPhysical = chunk.nextPhysical;
+			if (chunk.nextPhysical != Null)
+			{
+				m_chunks[chunk.nextPhysical].prevPhysical = chunk.prevPhysical;
+			}
+
+			ReleaseChunk(index);
+		}
+
+	public:
+		MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void* mapped, uint32_t memoryTypeIndex, ResourceKind kind, bool dedicated)
+			: memory(memory), size(size), mapped(mapped), memoryTypeIndex(memoryTypeIndex), kind(kind), dedicated(dedicated)
+		{
+			for (uint32_t i = 0; i < FirstLevelCount; ++i)
+			{
+				for (uint32_t j = 0; j < SecondLevelCount; ++j)
+				{
+					m_freeHeads[i][j] = Null;
+				}
+			}
+
+			uint32_t index = NewChunk();
+			m_chunks[index] = Chunk{ 0, size, Null, Null, Null, Null, false };
+			InsertFree(index);
+		}
+
+		bool Allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, VkDeviceSize& offset, uint32_t& chunkIndex)
+		{
+			uint32_t index = FindFree(allocationSize + alignment - 1);
+			if (index == Null)
+				return false;
+
+			RemoveFree(index);
+
+			//alignment padding goes back to the free lists, merged with the range below when that one is free
+			VkDeviceSize padding = AlignUp(m_chunks[index].offset, alignment) - m_chunks[index].offset;
+			if (padding > 0)
+			{
+				uint32_t previous = m_chunks[index].prevPhysical;
+				if (previous != Null && m_chunks[previous].free)
+				{
+					RemoveFree(previous);
+					m_chunks[previous].size += padding;
+					InsertFree(previous);
+				}
+				else
+				{
+					uint32_t head = NewChunk();
+					Chunk& chunk = m_chunks[index];
+					m_chunks[head] = Chunk{ chunk.offset, padding, chunk.prevPhysical, index, Null, Null, false };
+					if (chunk.prevPhysical != Null)
+					{
+						m_chunks[chunk.prevPhysical].nextPhysical = head;
+					}
+					chunk.prevPhysical = head;
+					InsertFree(head);
+				}
+
+				m_chunks[index].offset += padding;
+				m_chunks[index].size -= padding;
+			}
+
+			if (m_chunks[index].size > allocationSize)
+			{
+				SplitTail(index, allocationSize);
+			}
+
+			offset = m_chunks[index].offset;
+			chunkIndex = index;
+			usedBytes += allocationSize;
+			++allocationCount;
+			return true;
+		}
+
+		//An empty block as one allocation, used for dedicated blocks. Allocate rounds the request up to its size class
+		//first, so it fails to find a range of exactly the block size. The chunk at offset 0 is never merged away, so
+		//an empty block is that one free chunk.
+		bool AllocateWhole(VkDeviceSize& offset, uint32_t& chunkIndex)
+		{
+			if (allocationCount != 0)
+				return false;
+
+			RemoveFree(0);
+			offset = 0;
+			chunkIndex = 0;
+			usedBytes += size;
+			++allocationCount;
+			return true;
+		}
+
+		void Free(uint32_t index)
+		{
+			usedBytes -= m_chunks[index].size;
+			--allocationCount;
+
+			uint32_t next = m_chunks[index].nextPhysical;
+			if (next != Null && m_chunks[next].free)
+			{
+				RemoveFree(next);
+				MergeIntoPrevious(next);
+			}
+
+			uint32_t previous = m_chunks[index].prevPhysical;
+			if (previous != Null && m_chunks[previous].free)
+			{
+				RemoveFree(previous);
+				MergeIntoPrevious(index);
+				index = previous;
+			}
+
+			InsertFree(index);
+		}
+
+		VkDeviceSize GetLargestFreeRange() const
+		{
+			if (m_firstLevelBitmap == 0)
+				return 0;
+
+			//only the highest non empty bin can hold the largest range
+			uint32_t firstLevel = FindHighestBit(m_firstLevelBitmap);
+			uint32_t secondLevel = FindHighestBit(m_secondLevelBitmap[firstLevel]);
+
+			VkDeviceSize largest = 0;
+			for (uint32_t index = m_freeHeads[firstLevel][secondLevel]; index != Null; index = m_chunks[index].nextFree)
+			{
+				largest = std::max(largest, m_chunks[index].size);
+			}
+			return largest;
+		}
+
+		inline bool IsEmpty() const { return allocationCount == 0; }
+		inline VkDeviceSize GetChunkSize(uint32_t index) const { return m_chunks[index].size; }
+	};
+
+	VkResult VulkanMemoryBackend::AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory)
+	{
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = memoryTypeIndex;
+		return vkAllocateMemory(m_device, &allocInfo, nullptr, &memory);
+	}
+
+	void VulkanMemoryBackend::FreeMemory(VkDeviceMemory memory)
+	{
+		vkFreeMemory(m_device, memory, nullptr);
+	}
+
+	VkResult VulkanMemoryBackend::MapMemory(VkDeviceMemory memory, void*& data)
+	{
+		return vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+	}
+
+	void VulkanMemoryBackend::UnmapMemory(VkDeviceMemory memory)
+	{
+		vkUnmapMemory(m_device, memory);
+	}
+
+	VkResult VulkanMemoryBackend::FlushMemory(const VkMappedMemoryRange& range)
+	{
+		return vkFlushMappedMemoryRanges(m_device, 1, &range);
+	}
+
+	VkResult VulkanMemoryBackend::InvalidateMemory(const VkMappedMemoryRange& range)
+	{
+		return vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+	}
+
+	void MemoryStats::Print(std::ostream& out) const
+	{
+		const double MiB = 1024.0 * 1024.0;
+		out << "device memory: " << blockCount << " blocks (" << dedicatedBlockCount << " dedicated), "
+			<< allocationCount << " allocations, " << usedBytes / MiB << " / " << blockBytes / MiB << " MiB used, "
+			<< "fragmentation " << GetFragmentation() * 100.0f << "%\n";
+		out << "  gpu only " << bytesByUsage[(size_t)MemoryUsage::GpuOnly] / MiB << " MiB, cpu to gpu "
+			<< bytesByUsage[(size_t)MemoryUsage::CpuToGpu] / MiB << " MiB, gpu to cpu "
+			<< bytesByUsage[(size_t)MemoryUsage::GpuToCpu] / MiB << " MiB\n";
+		out << "  peak " << peakUsedBytes / MiB << " / " << peakBlockBytes / MiB << " MiB used\n";
+	}
+
+	DeviceMemoryAllocator::DeviceMemoryAllocator(DeviceMemoryBackend& backend, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits)
+		: m_backend(backend)
+	{
+		m_memoryProperties = memoryProperties;
+		m_nonCoherentAtomSize = std::max<VkDeviceSize>(1, limits.nonCoherentAtomSize);
+		m_maxAllocationCount = limits.maxMemoryAllocationCount;
+	}
+
+	DeviceMemoryAllocator::~DeviceMemoryAllocator()
+	{
+		for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; ++type)
+		{
+			for (auto& blocks : m_blocks[type])
+			{
+				for (auto& block : blocks)
+				{
+					if (block->mapped)
+					{
+						m_backend.UnmapMemory(block->memory);
+					}
+					m_backend.FreeMemory(block->memory);
+				}
+			}
+		}
+	}
+
+	uint32_t DeviceMemoryAllocator::FindMemoryType(uint32_t memoryTypeBits, MemoryUsage usage) const
+	{
+		VkMemoryPropertyFlags required = 0, preferred = 0, avoided = 0;
+		switch (usage)
+		{
+		case MemoryUsage::GpuOnly:
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			break;
+		case MemoryUsage::CpuToGpu:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		default:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		}
+
+		uint32_t bestType = UINT32_MAX;
+		int bestScore = 0;
+		for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
+		{
+			VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[i].propertyFlags;
+			if (!(memoryTypeBits & (1u << i)) || (flags & required) != required)
+				continue;
+
+			int score = (int)CountBits(flags & preferred) - (int)CountBits(flags & avoided);
+			if (bestType == UINT32_MAX || score > bestScore)
+			{
+				bestType = i;
+				bestScore = score;
+			}
+		}
+
+		if (bestType == UINT32_MAX)
+		{
+			throw std::runtime_error("Failed to find suitable memory type!");
+		}
+
+		return bestType;
+	}
+
+	//an eighth of small heaps so one block never takes a whole integrated or BAR heap
+	VkDeviceSize DeviceMemoryAllocator::GetBlockSize(uint32_t memoryTypeIndex) const
+	{
+		VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		return heapSize <= 1024ull * 1024 * 1024 ? AlignUp(heapSize / 8, 4096) : DefaultBlockSize;
+	}
+
+	bool DeviceMemoryAllocator::IsNonCoherent(uint32_t memoryTypeIndex) const
+	{
+		VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+		return (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	MemoryBlock* DeviceMemoryAllocator::CreateBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size, bool dedicated)
+	{
+		if (m_deviceAllocationCount >= m_maxAllocationCount)
+		{
+			throw std::runtime_error("Exceeded maxMemoryAllocationCount!");
+		}
+
+		VkDeviceMemory memory;
+		if (m_backend.AllocateMemory(memoryTypeIndex, size, memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Device Memory!");
+		}
+
+		void* mapped = nullptr;
+		if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			if (m_backend.MapMemory(memory, mapped) != VK_SUCCESS)
+			{
+				m_backend.FreeMemory(memory);
+				throw std::runtime_error("Failed to Map Device Memory!");
+			}
+		}
+
+		++m_deviceAllocationCount;
+		m_blockBytes += size;
+		m_peakBlockBytes = std::max(m_peakBlockBytes, m_blockBytes);
+		return new MemoryBlock(memory, size, mapped, memoryTypeIndex, kind, dedicated);
+	}
+
+	void DeviceMemoryAllocator::DestroyBlock(MemoryBlock* block)
+	{
+		std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_blocks[block->memoryTypeIndex][(size_t)block->kind];
+		auto it = std::find_if(blocks.begin(), blocks.end(), [block](const std::unique_ptr<MemoryBlock>& candidate) { return candidate.get() == block; });
+
+		if (block->mapped)
+		{
+			m_backend.UnmapMemory(block->memory);
+		}
+		m_backend.FreeMemory(block->memory);
+		--m_deviceAllocationCount;
+		m_blockBytes -= block->size;
+		blocks.erase(it);
+	}
+
+	Allocation DeviceMemoryAllocator::Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		uint32_t memoryTypeIndex = FindMemoryType(requirements.memoryTypeBits, usage);
+		VkDeviceSize alignment = std::max<VkDeviceSize>(1, requirements.alignment);
+		VkDeviceSize size = requirements.size;
+
+		//flushes work on whole atoms, so non coherent allocations must not share one
+		if (IsNonCoherent(memoryTypeIndex))
+		{
+			alignment = std::max(alignment, m_nonCoherentAtomSize);
+			size = AlignUp(size, m_nonCoherentAtomSize);
+		}
+
+		std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_blocks[memoryTypeIndex][(size_t)kind];
+		VkDeviceSize blockSize = GetBlockSize(memoryTypeIndex);
+
+		MemoryBlock* block = nullptr;
+		VkDeviceSize offset = 0;
+		uint32_t chunk = 0;
+
+		//anything over half a block gets its own memory rather than wasting the rest of one
+		if (size > blockSize / 2)
+		{
+			blocks.emplace_back(CreateBlock(memoryTypeIndex, kind, size, true));
+			block = blocks.back().get();
+			if (!block->AllocateWhole(offset, chunk))
+			{
+				throw std::runtime_error("Failed to Allocate Device Memory!");
+			}
+		}
+		else
+		{
+			for (auto& candidate : blocks)
+			{
+				if (!candidate->dedicated && candidate->Allocate(size, alignment, offset, chunk))
+				{
+					block = candidate.get();
+					break;
+				}
+			}
+
+			if (block == nullptr)
+			{
+				blocks.emplace_back(CreateBlock(memoryTypeIndex, kind, blockSize, false));
+				block = blocks.back().get();
+				if (!block->Allocate(size, alignment, offset, chunk))
+				{
+					throw std::runtime_error("Failed to Allocate Device Memory!");
+				}
+			}
+		}
+
+		Allocation allocation;
+		allocation.memory = block->memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+		allocation.memoryTypeIndex = memoryTypeIndex;
+		allocation.usage = usage;
+		allocation.block = block;
+		allocation.chunk = chunk;
+
+		m_bytesByUsage[(size_t)usage] += size;
+		m_usedBytes += size;
+		m_peakUsedBytes = std::max(m_peakUsedBytes, m_usedBytes);
+		return allocation;
+	}
+
+	void DeviceMemoryAllocator::Free(Allocation& allocation)
+	{
+		if (allocation.block == nullptr)
+			return;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		MemoryBlock* block = allocation.block;
+		block->Free(allocation.chunk);
+		m_bytesByUsage[(size_t)allocation.usage] -= allocation.size;
+		m_usedBytes -= allocation.size;
+
+		//keep one empty block per list around so a free/allocate pair at a boundary does not hit the driver
+		if (block->IsEmpty())
+		{
+			std::vector<std::unique_ptr<MemoryBlock>>& blocks = m_blocks[block->memoryTypeIndex][(size_t)block->kind];
+			bool otherEmpty = std::any_of(blocks.begin(), blocks.end(), [block](const std::unique_ptr<MemoryBlock>& candidate)
+				{ return candidate.get() != block && !candidate->dedicated && candidate->IsEmpty(); });
+
+			if (block->dedicated || otherEmpty)
+			{
+				DestroyBlock(block);
+			}
+		}
+
+		allocation = Allocation{};
+	}
+
+	//the range widened to whole nonCoherentAtomSize atoms, clamped to the block
+	VkMappedMemoryRange DeviceMemoryAllocator::GetAtomRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const
+	{
+		VkDeviceSize begin = allocation.offset + offset;
+		VkDeviceSize end = (size == VK_WHOLE_SIZE) ? allocation.offset + allocation.size : begin + size;
+
+		VkMappedMemoryRange range{};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = allocation.memory;
+		range.offset = begin / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+		range.size = std::min(AlignUp(end, m_nonCoherentAtomSize), allocation.block->size) - range.offset;
+		return range;
+	}
+
+	void DeviceMemoryAllocator::Flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+	{
+		if (!IsNonCoherent(allocation.memoryTypeIndex))
+			return;
+
+		if (m_backend.FlushMemory(GetAtomRange(allocation, offset, size)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Flush Device Memory!");
+		}
+	}
+
+	void DeviceMemoryAllocator::Invalidate(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size)
+	{
+		if (!IsNonCoherent(allocation.memoryTypeIndex))
+			return;
+
+		if (m_backend.InvalidateMemory(GetAtomRange(allocation, offset, size)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Invalidate Device Memory!");
+		}
+	}
+
+	MemoryStats DeviceMemoryAllocator::GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		MemoryStats stats;
+		for (uint32_t type = 0; type < VK_MAX_MEMORY_TYPES; ++type)
+		{
+			for (auto& blocks : m_blocks[type])
+			{
+				for (auto& block : blocks)
+				{
+					++stats.blockCount;
+					stats.dedicatedBlockCount += block->dedicated ? 1 : 0;
+					stats.allocationCount += block->allocationCount;
+					stats.blockBytes += block->size;
+					stats.usedBytes += block->usedBytes;
+					stats.freeBytes += block->size - block->usedBytes;
+					VkDeviceSize largestFreeRange = block->GetLargestFreeRange();
+					stats.largestFreeRange = std::max(stats.largestFreeRange, largestFreeRange);
+					stats.contiguousFreeBytes += largestFreeRange;
+				}
+			}
+		}
+
+		for (size_t usage = 0; usage < (size_t)MemoryUsage::Count; ++usage)
+		{
+			stats.bytesByUsage[usage] = m_bytesByUsage[usage];
+		}
+		stats.peakBlockBytes = m_peakBlockBytes;
+		stats.peakUsedBytes = m_peakUsedBytes;
+
+		return stats;
+	}
+
+	LinearAllocator::LinearAllocator(DeviceMemoryAllocator& allocator, const VkMemoryRequirements& requirements, MemoryUsage usage)
+		: m_allocator(allocator)
+	{
+		m_allocation = m_allocator.Allocate(requirements, usage, ResourceKind::Linear);
+	}
+
+	LinearAllocator::~LinearAllocator()
+	{
+		m_allocator.Free(m_allocation);
+	}
+
+	bool LinearAllocator::Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+	{
+		VkDeviceSize aligned = AlignUp(m_head, std::max<VkDeviceSize>(1, alignment));
+		if (aligned + size > m_allocation.size)
+			return false;
+
+		offset = aligned;
+		m_head = aligned + size;
+		return true;
+	}
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace Graphics
+{
+	//picks the memory type, the allocator keeps separate statistics for each
+	enum class MemoryUsage
+	{
+		GpuOnly,	//device local, never mapped
+		CpuToGpu,	//host visible, written by the cpu every frame or once for uploads
+		GpuToCpu,	//host visible and preferably cached, for readback
+		Count
+	};
+
+	//buffers and linear images are linear resources, optimal tiling images are not. They never share a block,
+	//so bufferImageGranularity never has to be padded for.
+	enum class ResourceKind
+	{
+		Linear,
+		Optimal,
+		Count
+	};
+
+	class MemoryBlock;
+
+	//a sub range of a VkDeviceMemory block, bind resources at memory + offset
+	struct Allocation
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;			//persistently mapped pointer to offset, null for device local memory
+		uint32_t memoryTypeIndex = 0;
+		MemoryUsage usage = MemoryUsage::GpuOnly;
+
+		MemoryBlock* block = nullptr;
+		uint32_t chunk = 0;
+	};
+
+	//everything the allocator asks of the driver, so the bookkeeping can run against a fake device
+	class DeviceMemoryBackend
+	{
+	public:
+		virtual ~DeviceMemoryBackend() = default;
+
+		virtual VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) = 0;
+		virtual void FreeMemory(VkDeviceMemory memory) = 0;
+		virtual VkResult MapMemory(VkDeviceMemory memory, void*& data) = 0;
+		virtual void UnmapMemory(VkDeviceMemory memory) = 0;
+		virtual VkResult FlushMemory(const VkMappedMemoryRange& range) = 0;
+		virtual VkResult InvalidateMemory(const VkMappedMemoryRange& range) = 0;
+	};
+
+	class VulkanMemoryBackend : public DeviceMemoryBackend
+	{
+	private:
+		VkDevice m_device;
+
+	public:
+		explicit VulkanMemoryBackend(VkDevice device) : m_device(device) {}
+
+		VkResult AllocateMemory(uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceMemory& memory) override;
+		void FreeMemory(VkDeviceMemory memory) override;
+		VkResult MapMemory(VkDeviceMemory memory, void*& data) override;
+		void UnmapMemory(VkDeviceMemory memory) override;
+		VkResult FlushMemory(const VkMappedMemoryRange& range) override;
+		VkResult InvalidateMemory(const VkMappedMemoryRange& range) override;
+	};
+
+	struct MemoryStats
+	{
+		uint32_t blockCount = 0;
+		uint32_t dedicatedBlockCount = 0;
+		uint32_t allocationCount = 0;
+		VkDeviceSize blockBytes = 0;
+		VkDeviceSize usedBytes = 0;
+		VkDeviceSize freeBytes = 0;
+		VkDeviceSize largestFreeRange = 0;
+		VkDeviceSize contiguousFreeBytes = 0;	//sum over blocks of each block's largest free range
+		VkDeviceSize bytesByUsage[(size_t)MemoryUsage::Count] = {};
+		VkDeviceSize peakBlockBytes = 0;		//high water marks since the allocator was created
+		VkDeviceSize peakUsedBytes = 0;
+
+		//0 when every block's free space is one range, towards 1 as it splinters
+		inline float GetFragmentation() const { return freeBytes ? 1.0f - (float)contiguousFreeBytes / (float)freeBytes : 0.0f; }
+		void Print(std::ostream& out) const;
+	};
+
+	//Sub-allocates buffers and images out of large VkDeviceMemory blocks, one list of blocks per memory type and
+	//resource kind. Free ranges inside a block are found with a two level segregated fit (TLSF) index, so
+	//allocation and free are O(1). Host visible blocks stay mapped for their whole life.
+	class DeviceMemoryAllocator
+	{
+	public:
+		static const VkDeviceSize DefaultBlockSize = 64ull * 1024 * 1024;
+
+	private:
+		DeviceMemoryBackend& m_backend;
+		VkPhysicalDeviceMemoryProperties m_memoryProperties;
+		VkDeviceSize m_nonCoherentAtomSize;
+		uint32_t m_maxAllocationCount;
+		uint32_t m_deviceAllocationCount = 0;
+
+		mutable std::mutex m_mutex;
+		std::vector<std::unique_ptr<MemoryBlock>> m_blocks[VK_MAX_MEMORY_TYPES][(size_t)ResourceKind::Count];
+		VkDeviceSize m_bytesByUsage[(size_t)MemoryUsage::Count] = {};
+		VkDeviceSize m_blockBytes = 0;
+		VkDeviceSize m_usedBytes = 0;
+		VkDeviceSize m_peakBlockBytes = 0;
+		VkDeviceSize m_peakUsedBytes = 0;
+
+		VkDeviceSize GetBlockSize(uint32_t memoryTypeIndex) const;
+		bool IsNonCoherent(uint32_t memoryTypeIndex) const;
+		VkMappedMemoryRange GetAtomRange(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) const;
+		MemoryBlock* CreateBlock(uint32_t memoryTypeIndex, ResourceKind kind, VkDeviceSize size, bool dedicated);
+		void DestroyBlock(MemoryBlock* block);
+
+	public:
+		DeviceMemoryAllocator(DeviceMemoryBackend& backend, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits);
+		~DeviceMemoryAllocator();
+
+		DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+		DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
+
+		//memory type with every required flag of the usage and as many preferred flags as possible
+		uint32_t FindMemoryType(uint32_t memoryTypeBits, MemoryUsage usage) const;
+
+		Allocation Allocate(const VkMemoryRequirements& requirements, MemoryUsage usage, ResourceKind kind);
+		void Free(Allocation& allocation);
+
+		//no-op on coherent memory, otherwise flushes the range widened to nonCoherentAtomSize
+		void Flush(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+		//the same for reading back, makes GPU writes visible to the cpu once their fence has signaled
+		void Invalidate(const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+		MemoryStats GetStats() const;
+	};
+
+	//Bump allocator over one sub-allocation for data that lives for a single frame. Reset once the GPU is done with it.
+	class LinearAllocator
+	{
+	private:
+		DeviceMemoryAllocator& m_allocator;
+		Allocation m_allocation;
+		VkDeviceSize m_head = 0;
+
+	public:
+		LinearAllocator(DeviceMemoryAllocator& allocator, const VkMemoryRequirements& requirements, MemoryUsage usage);
+		~LinearAllocator();
+
+		LinearAllocator(const LinearAllocator&) = delete;
+		LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+		//offset from the start of the region, false when the region is full
+		bool Allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+		inline void Reset() { m_head = 0; }
+
+		inline const Allocation& GetAllocation() const { return m_allocation; }
+		inline VkDeviceSize GetUsedBytes() const { return m_head; }
+	};
+}
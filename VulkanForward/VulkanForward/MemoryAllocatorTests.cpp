@@ -0,0 +1,205 @@
+#include "UnitTests.h"
+#include "MemoryAllocator.h"
+#include <map>
+#include <random>
+#include <algorithm>
+
+namespace Graphics
+{
+	//host memory behind fake handles, so mapped pointers can be written through
+	class FakeMemoryBackend : public DeviceMemoryBackend
+	{
+	private:
+		std::map<uint64_t, std::vector<char>> m_memory;
+		uint64_t m_nextHandle = 1;
+
+	public:
+		std::vector<VkMappedMemoryRange> flushedRanges;
+
+		VkResult AllocateMemory(uint32_t, VkDeviceSize size, VkDeviceMemory& memory) override
+		{
+			uint64_t handle = m_nextHandle++;
+			m_memory[handle].resize((size_t)size);
+			memory = (VkDeviceMemory)(uintptr_t)handle;
+			return VK_SUCCESS;
+		}
+
+		void FreeMemory(VkDeviceMemory memory) override
+		{
+			m_memory.erase((uint64_t)(uintptr_t)memory);
+		}
+
+		VkResult MapMemory(VkDeviceMemory memory, void*& data) override
+		{
+			data = m_memory.at((uint64_t)(uintptr_t)memory).data();
+			return VK_SUCCESS;
+		}
+
+		void UnmapMemory(VkDeviceMemory) override {}
+
+		VkResult FlushMemory(const VkMappedMemoryRange& range) override
+		{
+			flushedRanges.push_back(range);
+			return VK_SUCCESS;
+		}
+
+		VkResult InvalidateMemory(const VkMappedMemoryRange&) override { return VK_SUCCESS; }
+
+		inline size_t GetLiveAllocationCount() const { return m_memory.size(); }
+	};
+
+	static const VkDeviceSize MiB = 1024 * 1024;
+	static const VkDeviceSize NonCoherentAtomSize = 64;
+
+	//a discrete GPU: device local memory, a small BAR heap and cached but non coherent readback memory
+	static VkPhysicalDeviceMemoryProperties GetFakeMemoryProperties()
+	{
+		VkPhysicalDeviceMemoryProperties properties{};
+		properties.memoryHeapCount = 2;
+		properties.memoryHeaps[0] = { 8192 * MiB, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT };
+		properties.memoryHeaps[1] = { 256 * MiB, 0 };
+		properties.memoryTypeCount = 3;
+		properties.memoryTypes[0] = { VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0 };
+		properties.memoryTypes[1] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1 };
+		properties.memoryTypes[2] = { VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 1 };
+		return properties;
+	}
+
+	static VkPhysicalDeviceLimits GetFakeLimits()
+	{
+		VkPhysicalDeviceLimits limits{};
+		limits.nonCoherentAtomSize = NonCoherentAtomSize;
+		limits.maxMemoryAllocationCount = 4096;
+		return limits;
+	}
+
+	static VkMemoryRequirements Requirements(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		return VkMemoryRequirements{ size, alignment, 0x7 };
+	}
+
+	//sizes past half a block that are not a multiple of their TLSF size class
+	static void TestDedicatedAllocations(TestContext& context)
+	{
+		context.BeginTest("dedicated allocations of sizes off the size classes");
+		FakeMemoryBackend backend;
+		DeviceMemoryAllocator allocator(backend, GetFakeMemoryProperties(), GetFakeLimits());
+
+		const VkDeviceSize sizes[] = { DeviceMemoryAllocator::DefaultBlockSize / 2 + 1, 32 * MiB + 12 * 1024, 64 * MiB + 3 * 4096 + 4, 100 * MiB + 256 };
+		for (VkDeviceSize size : sizes)
+		{
+			Allocation allocation = allocator.Allocate(Requirements(size, 256), MemoryUsage::GpuOnly, ResourceKind::Linear);
+			MemoryStats stats = allocator.GetStats();
+			VF_CHECK(context, allocation.memory != VK_NULL_HANDLE);
+			VF_CHECK(context, allocation.offset == 0);
+			VF_CHECK(context, allocation.size == size);
+			VF_CHECK(context, stats.blockCount == 1 && stats.dedicatedBlockCount == 1);
+			VF_CHECK(context, stats.allocationCount == 1);
+			VF_CHECK(context, stats.usedBytes == size && stats.freeBytes == 0);
+
+			allocator.Free(allocation);
+			stats = allocator.GetStats();
+			VF_CHECK(context, stats.blockCount == 0 && stats.allocationCount == 0 && stats.usedBytes == 0);
+			VF_CHECK(context, backend.GetLiveAllocationCount() == 0);
+		}
+
+		//two at once get memory of their own each
+		Allocation first = allocator.Allocate(Requirements(40 * MiB + 12 * 1024, 256), MemoryUsage::GpuOnly, ResourceKind::Optimal);
+		Allocation second = allocator.Allocate(Requirements(40 * MiB + 12 * 1024, 256), MemoryUsage::GpuOnly, ResourceKind::Optimal);
+		VF_CHECK(context, first.memory != second.memory);
+		VF_CHECK(context, allocator.GetStats().dedicatedBlockCount == 2);
+		allocator.Free(first);
+		allocator.Free(second);
+		VF_CHECK(context, backend.GetLiveAllocationCount() == 0);
+	}
+
+	static void TestSubAllocations(TestContext& context)
+	{
+		context.BeginTest("sub-allocations are aligned, disjoint and merge back on free");
+		FakeMemoryBackend backend;
+		DeviceMemoryAllocator allocator(backend, GetFakeMemoryProperties(), GetFakeLimits());
+
+		std::mt19937 generator(7);
+		std::uniform_int_distribution<uint32_t> sizeDistribution(1, 256 * 1024);
+		std::uniform_int_distribution<uint32_t> alignmentShift(0, 12);
+
+		std::vector<Allocation> allocations;
+		for (uint32_t i = 0; i < 2000; ++i)
+		{
+			VkDeviceSize alignment = 1ull << alignmentShift(generator);
+			allocations.push_back(allocator.Allocate(Requirements(sizeDistribution(generator), alignment), MemoryUsage::GpuOnly, ResourceKind::Linear));
+			VF_CHECK(context, allocations.back().offset % alignment == 0);
+		}
+
+		std::vector<const Allocation*> sorted;
+		for (const Allocation& allocation : allocations)
+		{
+			sorted.push_back(&allocation);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const Allocation* a, const Allocation* b)
+			{ return a->memory != b->memory ? (uintptr_t)a->memory < (uintptr_t)b->memory : a->offset < b->offset; });
+
+		bool disjoint = true;
+		for (size_t i = 1; i < sorted.size(); ++i)
+		{
+			disjoint &= sorted[i - 1]->memory != sorted[i]->memory || sorted[i - 1]->offset + sorted[i - 1]->size <= sorted[i]->offset;
+		}
+		VF_CHECK(context, disjoint);
+		VF_CHECK(context, allocator.GetStats().allocationCount == allocations.size());
+
+		std::shuffle(allocations.begin(), allocations.end(), generator);
+		for (Allocation& allocation : allocations)
+		{
+			allocator.Free(allocation);
+		}
+
+		//one empty block stays around, whole again
+		MemoryStats stats = allocator.GetStats();
+		VF_CHECK(context, stats.blockCount == 1);
+		VF_CHECK(context, stats.allocationCount == 0 && stats.usedBytes == 0);
+		VF_CHECK(context, stats.largestFreeRange == stats.blockBytes);
+		VF_CHECK(context, stats.GetFragmentation() == 0.0f);
+		VF_CHECK(context, stats.peakUsedBytes > 0);
+	}
+
+	static void TestNonCoherentMemory(TestContext& context)
+	{
+		context.BeginTest("non coherent allocations own whole atoms");
+		FakeMemoryBackend backend;
+		DeviceMemoryAllocator allocator(backend, GetFakeMemoryProperties(), GetFakeLimits());
+
+		Allocation first = allocator.Allocate(Requirements(10, 4), MemoryUsage::GpuToCpu, ResourceKind::Linear);
+		Allocation second = allocator.Allocate(Requirements(100, 4), MemoryUsage::GpuToCpu, ResourceKind::Linear);
+		VF_CHECK(context, first.memoryTypeIndex == 2);
+		VF_CHECK(context, first.offset % NonCoherentAtomSize == 0 && first.size % NonCoherentAtomSize == 0);
+		VF_CHECK(context, second.offset % NonCoherentAtomSize == 0 && second.size % NonCoherentAtomSize == 0);
+		VF_CHECK(context, first.mapped != nullptr && second.mapped != nullptr);
+		VF_CHECK(context, static_cast<char*>(second.mapped) - static_cast<char*>(first.mapped) == (ptrdiff_t)second.offset - (ptrdiff_t)first.offset);
+
+		allocator.Flush(second, 70, 4);
+		VF_CHECK(context, backend.flushedRanges.size() == 1);
+		if (!backend.flushedRanges.empty())
+		{
+			const VkMappedMemoryRange& range = backend.flushedRanges[0];
+			VF_CHECK(context, range.offset % NonCoherentAtomSize == 0 && range.size % NonCoherentAtomSize == 0);
+			VF_CHECK(context, range.offset <= second.offset + 70 && range.offset + range.size >= second.offset + 74);
+		}
+
+		//coherent memory is never flushed
+		Allocation coherent = allocator.Allocate(Requirements(10, 4), MemoryUsage::CpuToGpu, ResourceKind::Linear);
+		allocator.Flush(coherent);
+		VF_CHECK(context, coherent.memoryTypeIndex == 1);
+		VF_CHECK(context, backend.flushedRanges.size() == 1);
+
+		allocator.Free(first);
+		allocator.Free(second);
+		allocator.Free(coherent);
+	}
+
+	void RunMemoryAllocatorTests(TestContext& context)
+	{
+		TestDedicatedAllocations(context);
+		TestSubAllocations(context);
+		TestNonCoherentMemory(context);
+	}
+}
@@ -0,0 +1,447 @@
+#include "Mesh.h"
+#include "MappedFile.h"
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/constants.hpp>
+#include <unordered_map>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+namespace Graphics
+{
+	static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the vertex input layout");
+
+	void OctEncodeNormal(const glm::vec3& normal, int16_t encoded[2])
+	{
+		//a zero normal has no direction to keep, it becomes +z rather than NaN
+		float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+		if (!(length > 0.0f))
+		{
+			encoded[0] = encoded[1] = 0;
+			return;
+		}
+
+		glm::vec3 n = normal / length;
+		glm::vec2 octant(n.x, n.y);
+
+		//the lower hemisphere folds over the diagonals
+		if (n.z < 0.0f)
+		{
+			octant.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			octant.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+
+		uint32_t packed = glm::packSnorm2x16(octant);
+		encoded[0] = (int16_t)(packed & 0xFFFF);
+		encoded[1] = (int16_t)(packed >> 16);
+	}
+
+	glm::vec3 OctDecodeNormal(const int16_t encoded[2])
+	{
+		glm::vec2 octant = glm::unpackSnorm2x16((uint32_t)(uint16_t)encoded[0] | ((uint32_t)(uint16_t)encoded[1] << 16));
+		glm::vec3 n(octant.x, octant.y, 1.0f - std::abs(octant.x) - std::abs(octant.y));
+
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+
+	PackedVertex PackVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv)
+	{
+		PackedVertex vertex;
+		vertex.position = position;
+		OctEncodeNormal(normal, vertex.normal);
+
+		uint32_t packedUV = glm::packHalf2x16(uv);
+		vertex.uv[0] = (uint16_t)(packedUV & 0xFFFF);
+		vertex.uv[1] = (uint16_t)(packedUV >> 16);
+		return vertex;
+	}
+
+	VertexLayout& VertexLayout::AddBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate)
+	{
+		m_bindings.push_back({ binding, stride, inputRate });
+		return *this;
+	}
+
+	VertexLayout& VertexLayout::AddAttribute(uint32_t binding, uint32_t location, VkFormat format, uint32_t offset)
+	{
+		m_attributes.push_back({ location, binding, format, offset });
+		return *this;
+	}
+
+	const VkPipelineVertexInputStateCreateInfo& VertexLayout::GetInputState()
+	{
+		m_inputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		m_inputState.vertexBindingDescriptionCount = static_cast<uint32_t>(m_bindings.size());
+		m_inputState.pVertexBindingDescriptions = m_bindings.data();
+		m_inputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(m_attributes.size());
+		m_inputState.pVertexAttributeDescriptions = m_attributes.data();
+		return m_inputState;
+	}
+
+	VertexLayout VertexLayout::Packed()
+	{
+		VertexLayout layout;
+		layout.AddBinding(0, sizeof(PackedVertex));
+		layout.AddAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PackedVertex, position));
+		layout.AddAttribute(0, 1, VK_FORMAT_R16G16_SNORM, offsetof(PackedVertex, normal));
+		layout.AddAttribute(0, 2, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv));
+		return layout;
+	}
+
+	void MeshData::ComputeBounds()
+	{
+		if (vertices.empty())
+			return;
+
+		boundsMin = boundsMax = vertices[0].position;
+		for (const PackedVertex& vertex : vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.position);
+			boundsMax = glm::max(boundsMax, vertex.position);
+		}
+	}
+
+	MeshData CreatePlane(float size, uint32_t subdivisions)
+	{
+		MeshData mesh;
+		uint32_t rowLength = subdivisions + 1;
+
+		for (uint32_t y = 0; y <= subdivisions; ++y)
+		{
+			for (uint32_t x = 0; x <= subdivisions; ++x)
+			{
+				glm::vec2 uv(x / (float)subdivisions, y / (float)subdivisions);
+				glm::vec3 position((uv.x - 0.5f) * size, (uv.y - 0.5f) * size, 0.0f);
+				mesh.vertices.push_back(PackVertex(position, glm::vec3(0.0f, 0.0f, 1.0f), uv));
+			}
+		}
+
+		for (uint32_t y = 0; y < subdivisions; ++y)
+		{
+			for (uint32_t x = 0; x < subdivisions; ++x)
+			{
+				uint32_t corner = y * rowLength + x;
+				mesh.indices.insert(mesh.indices.end(), { corner, corner + 1, corner + rowLength + 1, corner, corner + rowLength + 1, corner + rowLength });
+			}
+		}
+
+		mesh.ComputeBounds();
+		return mesh;
+	}
+
+	MeshData CreateSphere(float radius, uint32_t segments, uint32_t rings)
+	{
+		MeshData mesh;
+		uint32_t rowLength = segments + 1;
+
+		for (uint32_t ring = 0; ring <= rings; ++ring)
+		{
+			float theta = glm::pi<float>() * ring / rings;
+			for (uint32_t segment = 0; segment <= segments; ++segment)
+			{
+				float phi = glm::two_pi<float>() * segment / segments;
+				glm::vec3 normal(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+				mesh.vertices.push_back(PackVertex(normal * radius, normal, glm::vec2(segment / (float)segments, ring / (float)rings)));
+			}
+		}
+
+		for (uint32_t ring = 0; ring < rings; ++ring)
+		{
+			for (uint32_t segment = 0; segment < segments; ++segment)
+			{
+				uint32_t corner = ring * rowLength + segment;
+				mesh.indices.insert(mesh.indices.end(), { corner, corner + rowLength, corner + rowLength + 1, corner, corner + rowLength + 1, corner + 1 });
+			}
+		}
+
+		mesh.ComputeBounds();
+		return mesh;
+	}
+
+	//position, uv and normal index of an OBJ face corner, -1 when the corner has none
+	struct ObjCorner
+	{
+		int position, uv, normal;
+
+		inline bool operator==(const ObjCorner& other) const { return position == other.position && uv == other.uv && normal == other.normal; }
+	};
+
+	struct ObjCornerHash
+	{
+		size_t operator()(const ObjCorner& corner) const
+		{
+			uint64_t hash = (uint32_t)corner.position * 0x9E3779B97F4A7C15ull;
+			hash = (hash ^ (uint32_t)corner.uv) * 0xFF51AFD7ED558CCDull;
+			hash = (hash ^ (uint32_t)corner.normal) * 0xC4CEB9FE1A85EC53ull;
+			return (size_t)(hash ^ (hash >> 32));
+		}
+	};
+
+	//1 based, or negative counting back from the last element read so far. 0 is what a missing field parses to.
+	static int ResolveObjIndex(int index, size_t count, bool required, const std::string& filename)
+	{
+		if (index == 0)
+		{
+			if (required)
+				throw std::runtime_error(filename + ": OBJ face corner without a position");
+			return -1;
+		}
+
+		int resolved = index < 0 ? (int)count + index : index - 1;
+		if (resolved < 0 || resolved >= (int)count)
+			throw std::runtime_error(filename + ": OBJ face index " + std::to_string(index) + " out of range");
+		return resolved;
+	}
+
+	static inline bool IsObjSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	//the next whitespace separated token of the line, empty at its end. Points into the mapped file.
+	static std::string_view NextObjToken(const char*& cursor, const char* lineEnd)
+	{
+		while (cursor < lineEnd && IsObjSpace(*cursor))
+			++cursor;
+		const char* begin = cursor;
+		while (cursor < lineEnd && !IsObjSpace(*cursor))
+			++cursor;
+		return std::string_view(begin, cursor - begin);
+	}
+
+	//the first required coordinates must be there, the rest default to 0
+	static void ParseObjFloats(const char*& cursor, const char* lineEnd, float* values, uint32_t required, uint32_t count, const std::string& filename)
+	{
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			std::string_view token = NextObjToken(cursor, lineEnd);
+			if (token.empty())
+			{
+				if (i < required)
+					throw std::runtime_error(filename + ": OBJ vertex with too few coordinates");
+				values[i] = 0.0f;
+				continue;
+			}
+
+			//from_chars takes no leading plus sign
+			const char* begin = token.data();
+			const char* end = begin + token.size();
+			if (*begin == '+')
+				++begin;
+			std::from_chars_result result = std::from_chars(begin, end, values[i]);
+			if (result.ec != std::errc() || result.ptr != end)
+				throw std::runtime_error(filename + ": malformed OBJ number " + std::string(token));
+		}
+	}
+
+	//v, v/t, v//n or v/t/n, an empty field is 0
+	static ObjCorner ParseObjCorner(std::string_view token, const std::string& filename)
+	{
+		ObjCorner corner{ 0, 0, 0 };
+		int* fields[3] = { &corner.position, &corner.uv, &corner.normal };
+		const char* field = token.data();
+		const char* tokenEnd = field + token.size();
+		for (int i = 0; i < 3; ++i)
+		{
+			const char* fieldEnd = std::find(field, tokenEnd, '/');
+			if (field != fieldEnd)
+			{
+				std::from_chars_result result = std::from_chars(field, fieldEnd, *fields[i]);
+				if (result.ec != std::errc() || result.ptr != fieldEnd)
+					throw std::runtime_error(filename + ": malformed OBJ face corner " + std::string(token));
+			}
+			if (fieldEnd == tokenEnd)
+				return corner;
+			field = fieldEnd + 1;
+		}
+		throw std::runtime_error(filename + ": malformed OBJ face corner " + std::string(token));
+	}
+
+	//parsed in place from the mapped file, nothing is copied per line or per token
+	MeshData LoadObj(const std::string& filename)
+	{
+		MappedFile file(filename);
+		const char* cursor = file.GetChars();
+		const char* fileEnd = cursor + file.GetSize();
+
+		std::vector<glm::vec3> positions, normals;
+		std::vector<glm::vec2> uvs;
+
+		MeshData mesh;
+		std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertexCache;
+		std::vector<ObjCorner> corners;
+		std::vector<uint32_t> faceIndices;
+
+		while (cursor < fileEnd)
+		{
+			const char* lineEnd = std::find(cursor, fileEnd, '\n');
+			const char* line = cursor;
+			cursor = (lineEnd == fileEnd) ? fileEnd : lineEnd + 1;
+			std::string_view tag = NextObjToken(line, lineEnd);
+
+			if (tag == "v")
+			{
+				glm::vec3 p;
+				ParseObjFloats(line, lineEnd, &p.x, 3, 3, filename);
+				positions.push_back(p);
+			}
+			else if (tag == "vn")
+			{
+				glm::vec3 n;
+				ParseObjFloats(line, lineEnd, &n.x, 3, 3, filename);
+				normals.push_back(n);
+			}
+			else if (tag == "vt")
+			{
+				glm::vec2 t;
+				ParseObjFloats(line, lineEnd, &t.x, 1, 2, filename);
+				uvs.push_back(t);
+			}
+			else if (tag == "f")
+			{
+				//negative indices count back from the end
+				corners.clear();
+				for (std::string_view token = NextObjToken(line, lineEnd); !token.empty(); token = NextObjToken(line, lineEnd))
+				{
+					ObjCorner corner = ParseObjCorner(token, filename);
+					corner.position = ResolveObjIndex(corner.position, positions.size(), true, filename);
+					corner.uv = ResolveObjIndex(corner.uv, uvs.size(), false, filename);
+					corner.normal = ResolveObjIndex(corner.normal, normals.size(), false, filename);
+					corners.push_back(corner);
+				}
+
+				if (corners.size() < 3)
+					continue;
+
+				//a degenerate face has no direction, OctEncodeNormal turns the zero vector into +z
+				glm::vec3 faceNormal = glm::cross(positions[corners[1].position] - positions[corners[0].position],
+					positions[corners[2].position] - positions[corners[0].position]);
+				float faceNormalLength = glm::length(faceNormal);
+				faceNormal = faceNormalLength > 0.0f ? faceNormal / faceNormalLength : glm::vec3(0.0f);
+
+				faceIndices.clear();
+				for (const ObjCorner& corner : corners)
+				{
+					//faces without their own normal get a flat one, they must not share vertices with smooth faces
+					auto cached = (corner.normal >= 0) ? vertexCache.find(corner) : vertexCache.end();
+					if (cached != vertexCache.end())
+					{
+						faceIndices.push_back(cached->second);
+						continue;
+					}
+
+					glm::vec3 normal = (corner.normal >= 0) ? normals[corner.normal] : faceNormal;
+					glm::vec2 uv = (corner.uv >= 0) ? uvs[corner.uv] : glm::vec2(0.0f);
+
+					uint32_t index = static_cast<uint32_t>(mesh.vertices.size());
+					mesh.vertices.push_back(PackVertex(positions[corner.position], normal, uv));
+					if (corner.normal >= 0)
+					{
+						vertexCache[corner] = index;
+					}
+					faceIndices.push_back(index);
+				}
+
+				//fan triangulation, OBJ polygons are convex
+				for (size_t i = 1; i + 1 < faceIndices.size(); ++i)
+				{
+					mesh.indices.insert(mesh.indices.end(), { faceIndices[0], faceIndices[i], faceIndices[i + 1] });
+				}
+			}
+		}
+
+		mesh.ComputeBounds();
+		return mesh;
+	}
+
+	MeshPool::MeshPool(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploadService, uint32_t vertexCapacity, uint32_t index16Capacity, uint32_t index32Capacity)
+		: m_device(device), m_allocator(allocator), m_uploadService(uploadService)
+	{
+		m_vertexCapacity = vertexCapacity;
+		m_indexCapacities[0] = index16Capacity;
+		m_indexCapacities[1] = index32Capacity;
+
+		CreateBuffer(sizeof(PackedVertex) * (VkDeviceSize)vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, m_vertexBuffer, m_vertexAllocation);
+		CreateBuffer(sizeof(uint16_t) * (VkDeviceSize)index16Capacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffers[0], m_indexAllocations[0]);
+		CreateBuffer(sizeof(uint32_t) * (VkDeviceSize)index32Capacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, m_indexBuffers[1], m_indexAllocations[1]);
+	}
+
+	MeshPool::~MeshPool()
+	{
+		vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
+		m_allocator.Free(m_vertexAllocation);
+
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			vkDestroyBuffer(m_device, m_indexBuffers[i], nullptr);
+			m_allocator.Free(m_indexAllocations[i]);
+		}
+	}
+
+	void MeshPool::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, Allocation& allocation)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = std::max<VkDeviceSize>(size, 4);
+		bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_device, buffer, &memRequirements);
+
+		allocation = m_allocator.Allocate(memRequirements, MemoryUsage::GpuOnly, ResourceKind::Linear);
+		vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+	}
+
+	uint32_t MeshPool::AddMesh(const MeshData& mesh)
+	{
+		uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size());
+		bool shortIndices = vertexCount <= 65536;
+		uint32_t indexBuffer = shortIndices ? 0 : 1;
+
+		if (m_vertexCount + vertexCount > m_vertexCapacity || m_indexCounts[indexBuffer] + indexCount > m_indexCapacities[indexBuffer])
+		{
+			throw std::runtime_error("Mesh pool is full!");
+		}
+
+		MeshRange range;
+		range.firstIndex = m_indexCounts[indexBuffer];
+		range.indexCount = indexCount;
+		range.vertexOffset = static_cast<int32_t>(m_vertexCount);
+		range.indexType = shortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		range.boundsMin = mesh.boundsMin;
+		range.boundsMax = mesh.boundsMax;
+
+		m_uploadService.UploadBuffer(m_vertexBuffer, sizeof(PackedVertex) * (VkDeviceSize)m_vertexCount, mesh.vertices.data(), sizeof(PackedVertex) * (VkDeviceSize)vertexCount,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+		if (shortIndices)
+		{
+			std::vector<uint16_t> shortData(mesh.indices.begin(), mesh.indices.end());
+			m_uploadService.UploadBuffer(m_indexBuffers[0], sizeof(uint16_t) * (VkDeviceSize)range.firstIndex, shortData.data(), sizeof(uint16_t) * (VkDeviceSize)indexCount,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+		}
+		else
+		{
+			m_uploadService.UploadBuffer(m_indexBuffers[1], sizeof(uint32_t) * (VkDeviceSize)range.firstIndex, mesh.indices.data(), sizeof(uint32_t) * (VkDeviceSize)indexCount,
+				VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
+		}
+
+		m_vertexCount += vertexCount;
+		m_indexCounts[indexBuffer] += indexCount;
+		m_meshes.push_back(range);
+		return static_cast<uint32_t>(m_meshes.size()) - 1;
+	}
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+#include "MemoryAllocator.h"
+#include "UploadService.h"
+
+namespace Graphics
+{
+	//20 bytes instead of the 32 of float position/normal/uv. Normals are octahedron encoded into two snorm16,
+	//uvs are half floats so tiling coordinates outside [0, 1] still work.
+	struct PackedVertex
+	{
+		glm::vec3 position;
+		int16_t normal[2];
+		uint16_t uv[2];
+	};
+
+	void OctEncodeNormal(const glm::vec3& normal, int16_t encoded[2]);
+	glm::vec3 OctDecodeNormal(const int16_t encoded[2]);
+	PackedVertex PackVertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv);
+
+	//vertex buffer bindings and attributes of a pipeline's vertex input state
+	class VertexLayout
+	{
+	private:
+		std::vector<VkVertexInputBindingDescription> m_bindings;
+		std::vector<VkVertexInputAttributeDescription> m_attributes;
+		VkPipelineVertexInputStateCreateInfo m_inputState{};
+
+	public:
+		VertexLayout& AddBinding(uint32_t binding, uint32_t stride, VkVertexInputRate inputRate = VK_VERTEX_INPUT_RATE_VERTEX);
+		VertexLayout& AddAttribute(uint32_t binding, uint32_t location, VkFormat format, uint32_t offset);
+
+		//points into this layout, which must outlive the pipeline creation
+		const VkPipelineVertexInputStateCreateInfo& GetInputState();
+
+		inline const std::vector<VkVertexInputBindingDescription>& GetBindings() const { return m_bindings; }
+		inline const std::vector<VkVertexInputAttributeDescription>& GetAttributes() const { return m_attributes; }
+
+		//PackedVertex in binding 0: position at location 0, normal at 1, uv at 2
+		static VertexLayout Packed();
+	};
+
+	struct MeshData
+	{
+		std::vector<PackedVertex> vertices;
+		std::vector<uint32_t> indices;
+		glm::vec3 boundsMin = glm::vec3(0.0f);
+		glm::vec3 boundsMax = glm::vec3(0.0f);
+
+		void ComputeBounds();
+	};
+
+	//counter clockwise front faces, z up
+	MeshData CreatePlane(float size, uint32_t subdivisions);
+	MeshData CreateSphere(float radius, uint32_t segments, uint32_t rings);
+
+	//triangulated positions, normals and uvs of a Wavefront OBJ, faces without normals get flat ones.
+	//Throws std::runtime_error when the file can not be read, a number is malformed or a face index is out of range.
+	MeshData LoadObj(const std::string& filename);
+
+	//where a mesh lives inside a MeshPool
+	struct MeshRange
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t vertexOffset;
+		VkIndexType indexType;
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+	};
+
+	//All meshes share one device local vertex buffer and two index buffers. Indices are relative to the mesh's first vertex,
+	//so any mesh under 65536 vertices goes in the 16 bit buffer. Data is streamed through the UploadService.
+	class MeshPool
+	{
+	private:
+		VkDevice m_device;
+		DeviceMemoryAllocator& m_allocator;
+		UploadService& m_uploadService;
+
+		VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
+		VkBuffer m_indexBuffers[2] = {};		//16 then 32 bit
+		Allocation m_vertexAllocation;
+		Allocation m_indexAllocations[2];
+
+		uint32_t m_vertexCapacity;
+		uint32_t m_indexCapacities[2];
+		uint32_t m_vertexCount = 0;
+		uint32_t m_indexCounts[2] = {};
+
+		std::vector<MeshRange> m_meshes;
+
+		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, Allocation& allocation);
+
+	public:
+		MeshPool(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploadService, uint32_t vertexCapacity, uint32_t index16Capacity, uint32_t index32Capacity);
+		~MeshPool();
+
+		MeshPool(const MeshPool&) = delete;
+		MeshPool& operator=(const MeshPool&) = delete;
+
+		//queues the upload and returns the mesh id, throws when the pool is full
+		uint32_t AddMesh(const MeshData& mesh);
+
+		inline const MeshRange& GetMesh(uint32_t mesh) const { return m_meshes[mesh]; }
+		inline uint32_t GetMeshCount() const { return static_cast<uint32_t>(m_meshes.size()); }
+		inline VkBuffer GetVertexBuffer() const { return m_vertexBuffer; }
+		inline VkBuffer GetIndexBuffer(VkIndexType indexType) const { return m_indexBuffers[indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1]; }
+	};
+}
@@ -0,0 +1,205 @@
+#include "UnitTests.h"
+#include "Mesh.h"
+#include <glm/gtc/packing.hpp>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <cmath>
+
+namespace Graphics
+{
+	static bool IsFinite(const glm::vec3& v)
+	{
+		return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+	}
+
+	static glm::vec3 GetNormal(const PackedVertex& vertex)
+	{
+		return OctDecodeNormal(vertex.normal);
+	}
+
+	static glm::vec2 GetUV(const PackedVertex& vertex)
+	{
+		return glm::unpackHalf2x16((uint32_t)vertex.uv[0] | ((uint32_t)vertex.uv[1] << 16));
+	}
+
+	//an OBJ in the temp directory, removed again when the test is done with it
+	class TemporaryObj
+	{
+	private:
+		std::string m_filename;
+
+	public:
+		TemporaryObj(const char* name, const char* contents)
+		{
+			m_filename = (std::filesystem::temp_directory_path() / name).string();
+			std::ofstream file(m_filename, std::ios::binary | std::ios::trunc);
+			file << contents;
+		}
+
+		~TemporaryObj()
+		{
+			std::error_code error;
+			std::filesystem::remove(m_filename, error);
+		}
+
+		inline const std::string& GetFilename() const { return m_filename; }
+	};
+
+	static void TestOctEncoding(TestContext& context)
+	{
+		context.BeginTest("octahedron normals survive encoding");
+
+		std::vector<glm::vec3> normals = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+			glm::normalize(glm::vec3(1, 1, -1)), glm::normalize(glm::vec3(-1, -1, -1)), glm::normalize(glm::vec3(0.001f, 0, -1)) };
+
+		std::mt19937 generator(3);
+		std::normal_distribution<float> gaussian;
+		for (uint32_t i = 0; i < 10000; ++i)
+		{
+			normals.push_back(glm::normalize(glm::vec3(gaussian(generator), gaussian(generator), gaussian(generator))));
+		}
+
+		//two snorm16 keep the direction to well under a hundredth of a degree
+		float worstCosine = 1.0f;
+		for (const glm::vec3& normal : normals)
+		{
+			int16_t encoded[2];
+			OctEncodeNormal(normal, encoded);
+			glm::vec3 decoded = OctDecodeNormal(encoded);
+			worstCosine = std::min(worstCosine, IsFinite(decoded) ? glm::dot(normal, decoded) : -1.0f);
+		}
+		VF_CHECK(context, worstCosine > 0.99999f);
+
+		//unnormalized input is normalized by the encoding
+		int16_t encoded[2];
+		OctEncodeNormal(glm::vec3(0.0f, 3.0f, 4.0f), encoded);
+		VF_CHECK(context, glm::dot(OctDecodeNormal(encoded), glm::vec3(0.0f, 0.6f, 0.8f)) > 0.99999f);
+
+		//a zero normal must not turn into NaN
+		OctEncodeNormal(glm::vec3(0.0f), encoded);
+		glm::vec3 decoded = OctDecodeNormal(encoded);
+		VF_CHECK(context, IsFinite(decoded) && decoded.z > 0.99999f);
+	}
+
+	static void TestObjLoading(TestContext& context)
+	{
+		context.BeginTest("OBJ faces are triangulated and corners shared");
+		{
+			TemporaryObj obj("vf_test_quad.obj",
+				"# quad\n"
+				"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+				"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+				"vn 0 0 1\n"
+				"f 1/1/1 2/2/1 3/3/1\n"
+				"f 1/1/1 3/3/1 4/4/1\n");
+			MeshData mesh = LoadObj(obj.GetFilename());
+			VF_CHECK(context, mesh.vertices.size() == 4);
+			VF_CHECK(context, mesh.indices.size() == 6);
+			VF_CHECK(context, mesh.boundsMin == glm::vec3(0.0f) && mesh.boundsMax == glm::vec3(1.0f, 1.0f, 0.0f));
+			if (mesh.vertices.size() == 4)
+			{
+				VF_CHECK(context, GetUV(mesh.vertices[2]) == glm::vec2(1.0f, 1.0f));
+				VF_CHECK(context, glm::dot(GetNormal(mesh.vertices[0]), glm::vec3(0, 0, 1)) > 0.9999f);
+			}
+		}
+
+		context.BeginTest("OBJ polygons, negative indices and flat normals");
+		{
+			TemporaryObj obj("vf_test_polygon.obj",
+				"v 0 0 0\nv 2 0 0\nv 2 0 2\nv 0 0 2\nv 1 0 3\n"
+				"f -5 -1 -2 -3 -4\n");
+			MeshData mesh = LoadObj(obj.GetFilename());
+			VF_CHECK(context, mesh.indices.size() == 9);
+			VF_CHECK(context, mesh.vertices.size() == 5);
+
+			//counter clockwise seen from -y
+			bool flat = true;
+			for (const PackedVertex& vertex : mesh.vertices)
+			{
+				flat &= glm::dot(GetNormal(vertex), glm::vec3(0, -1, 0)) > 0.9999f;
+			}
+			VF_CHECK(context, flat);
+		}
+
+		context.BeginTest("OBJ degenerate faces get finite normals");
+		{
+			TemporaryObj obj("vf_test_degenerate.obj", "v 0 0 0\nv 1 1 1\nv 2 2 2\nf 1 2 3\nf 1 1 1\n");
+			MeshData mesh = LoadObj(obj.GetFilename());
+			bool finite = mesh.vertices.size() == 6;
+			for (const PackedVertex& vertex : mesh.vertices)
+			{
+				finite &= IsFinite(GetNormal(vertex));
+			}
+			VF_CHECK(context, finite);
+		}
+
+		context.BeginTest("OBJ whitespace, signs, exponents and short uvs");
+		{
+			//CRLF line ends, tabs, no newline after the last face
+			TemporaryObj obj("vf_test_format.obj",
+				"v\t+1.5e0 -2 0.25\r\n"
+				"v  3 -2   0.25\r\n"
+				"v 1.5 4E-1 0.25 1.0\r\n"
+				"vt 0.5\r\n"
+				"f 1/1 2/1\t3/1");
+			MeshData mesh = LoadObj(obj.GetFilename());
+			VF_CHECK(context, mesh.vertices.size() == 3 && mesh.indices.size() == 3);
+			VF_CHECK(context, mesh.boundsMin == glm::vec3(1.5f, -2.0f, 0.25f) && mesh.boundsMax == glm::vec3(3.0f, 0.4f, 0.25f));
+			if (mesh.vertices.size() == 3)
+			{
+				VF_CHECK(context, GetUV(mesh.vertices[0]) == glm::vec2(0.5f, 0.0f));
+			}
+		}
+
+		context.BeginTest("OBJ files with bad numbers throw");
+		{
+			TemporaryObj shortVertex("vf_test_short.obj", "v 0 0\n");
+			VF_CHECK_THROWS(context, LoadObj(shortVertex.GetFilename()));
+
+			TemporaryObj badFloat("vf_test_float.obj", "v 0 x 0\n");
+			VF_CHECK_THROWS(context, LoadObj(badFloat.GetFilename()));
+
+			TemporaryObj trailing("vf_test_trailing.obj", "vn 0 0 1f\n");
+			VF_CHECK_THROWS(context, LoadObj(trailing.GetFilename()));
+
+			TemporaryObj fields("vf_test_fields.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/1/1/1 2 3\n");
+			VF_CHECK_THROWS(context, LoadObj(fields.GetFilename()));
+
+			TemporaryObj suffix("vf_test_suffix.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2x 3\n");
+			VF_CHECK_THROWS(context, LoadObj(suffix.GetFilename()));
+		}
+
+		context.BeginTest("OBJ files with bad indices throw");
+		{
+			TemporaryObj outOfRange("vf_test_range.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n");
+			VF_CHECK_THROWS(context, LoadObj(outOfRange.GetFilename()));
+
+			TemporaryObj zero("vf_test_zero.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n");
+			VF_CHECK_THROWS(context, LoadObj(zero.GetFilename()));
+
+			TemporaryObj negative("vf_test_negative.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 -4\n");
+			VF_CHECK_THROWS(context, LoadObj(negative.GetFilename()));
+
+			TemporaryObj uv("vf_test_uv.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nf 1/1 2/2 3/1\n");
+			VF_CHECK_THROWS(context, LoadObj(uv.GetFilename()));
+
+			TemporaryObj normal("vf_test_normal.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvn 0 0 1\nf 1//1 2//1 3//2\n");
+			VF_CHECK_THROWS(context, LoadObj(normal.GetFilename()));
+
+			TemporaryObj missing("vf_test_missing.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 /1/1 3\n");
+			VF_CHECK_THROWS(context, LoadObj(missing.GetFilename()));
+
+			TemporaryObj garbage("vf_test_garbage.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 x 3\n");
+			VF_CHECK_THROWS(context, LoadObj(garbage.GetFilename()));
+
+			VF_CHECK_THROWS(context, LoadObj((std::filesystem::temp_directory_path() / "vf_test_does_not_exist.obj").string()));
+		}
+	}
+
+	void RunMeshTests(TestContext& context)
+	{
+		TestOctEncoding(context);
+		TestObjLoading(context);
+	}
+}
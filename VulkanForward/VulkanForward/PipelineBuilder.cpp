@@ -0,0 +1,264 @@
+#include "PipelineBuilder.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Graphics
+{
+	SpecializationConstants& SpecializationConstants::Set(uint32_t id, uint32_t value)
+	{
+		auto position = std::lower_bound(m_entries.begin(), m_entries.end(), id,
+			[](const VkSpecializationMapEntry& entry, uint32_t id) { return entry.constantID < id; });
+		size_t index = position - m_entries.begin();
+		if (position != m_entries.end() && position->constantID == id)
+		{
+			m_values[index] = value;
+			return *this;
+		}
+
+		m_entries.insert(position, { id, 0, sizeof(uint32_t) });
+		m_values.insert(m_values.begin() + index, value);
+		for (size_t i = index; i < m_entries.size(); ++i)
+		{
+			m_entries[i].offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+		}
+		return *this;
+	}
+
+	const VkSpecializationInfo* SpecializationConstants::GetInfo()
+	{
+		if (m_entries.empty())
+			return nullptr;
+
+		m_info.mapEntryCount = static_cast<uint32_t>(m_entries.size());
+		m_info.pMapEntries = m_entries.data();
+		m_info.dataSize = m_values.size() * sizeof(uint32_t);
+		m_info.pData = m_values.data();
+		return &m_info;
+	}
+
+	PipelineBuilder::PipelineBuilder(VkDevice device, JobSystem& jobSystem, ShaderLibrary& shaders, VkPipelineCache cache)
+		: m_device(device), m_jobSystem(jobSystem), m_shaders(shaders), m_cache(cache)
+	{
+	}
+
+	PipelineBuilder::~PipelineBuilder()
+	{
+		//jobs still point at their requests
+		for (std::unique_ptr<Request>& request : m_requests)
+		{
+			m_jobSystem.Wait(request->counter);
+		}
+	}
+
+	PipelineHandle PipelineBuilder::Submit(const GraphicsPipelineDesc& desc)
+	{
+		std::unique_ptr<Request> request = std::make_unique<Request>();
+		request->graphics = desc;
+		request->isCompute = false;
+		request->modules[0] = m_shaders.Load(desc.vertexShader).GetModule();
+		if (!desc.fragmentShader.empty())
+		{
+			request->modules[1] = m_shaders.Load(desc.fragmentShader).GetModule();
+		}
+		return Submit(std::move(request));
+	}
+
+	PipelineHandle PipelineBuilder::Submit(const ComputePipelineDesc& desc)
+	{
+		std::unique_ptr<Request> request = std::make_unique<Request>();
+		request->compute = desc;
+		request->isCompute = true;
+		request->modules[0] = m_shaders.Load(desc.shader).GetModule();
+		return Submit(std::move(request));
+	}
+
+	PipelineHandle PipelineBuilder::Submit(std::unique_ptr<Request> request)
+	{
+		request->builder = this;
+		Request* job = request.get();
+		m_requests.push_back(std::move(request));
+
+		m_jobSystem.Run(BuildJob, job, 0, 1, &job->counter);
+		return static_cast<PipelineHandle>(m_requests.size()) - 1;
+	}
+
+	bool PipelineBuilder::IsReady(PipelineHandle handle) const
+	{
+		return m_requests[handle]->counter.IsDone();
+	}
+
+	VkPipeline PipelineBuilder::Get(PipelineHandle handle)
+	{
+		Request& request = *m_requests[handle];
+		m_jobSystem.Wait(request.counter);
+
+		if (!request.error.empty())
+		{
+			throw std::runtime_error(request.error);
+		}
+		return request.pipeline;
+	}
+
+	void PipelineBuilder::WaitAll()
+	{
+		for (PipelineHandle handle = 0; handle < m_requests.size(); ++handle)
+		{
+			Get(handle);
+		}
+	}
+
+	//one job per request, so the range is always [0, 1)
+	//exceptions must not escape a job, they are handed to Get instead
+	void PipelineBuilder::BuildJob(void* data, uint32_t, uint32_t)
+	{
+		Request* request = static_cast<Request*>(data);
+		try
+		{
+			if (request->isCompute)
+			{
+				request->pipeline = request->builder->BuildCompute(request->compute, request->modules[0]);
+			}
+			else
+			{
+				request->pipeline = request->builder->BuildGraphics(request->graphics, request->modules[0], request->modules[1]);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			request->error = e.what();
+		}
+	}
+
+	//modules are shared through the library and outlive the pipeline
+	VkPipeline PipelineBuilder::BuildGraphics(GraphicsPipelineDesc& desc, VkShaderModule vertexModule, VkShaderModule fragModule) const
+	{
+		//depth only pipelines leave out the fragment stage
+		uint32_t stageCount = (fragModule != VK_NULL_HANDLE) ? 2 : 1;
+		VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = vertexModule;
+		shaderStages[0].pName = "main";
+		shaderStages[0].pSpecializationInfo = desc.specialization.GetInfo();
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = fragModule;
+		shaderStages[1].pName = "main";
+		shaderStages[1].pSpecializationInfo = desc.specialization.GetInfo();
+
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo = desc.vertexLayout.GetInputState();
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = desc.topology;
+		inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+		VkViewport viewport{};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = (float)desc.extent.width;
+		viewport.height = (float)desc.extent.height;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+
+		VkRect2D scissor{};
+		scissor.offset = { 0, 0 };
+		scissor.extent = desc.extent;
+
+		VkPipelineViewportStateCreateInfo viewportState{};
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.pViewports = &viewport;
+		viewportState.scissorCount = 1;
+		viewportState.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = VK_FALSE;
+		rasterizer.rasterizerDiscardEnable = VK_FALSE;
+		rasterizer.polygonMode = desc.polygonMode;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = desc.cullMode;
+		rasterizer.frontFace = desc.frontFace;
+		rasterizer.depthBiasEnable = VK_FALSE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.sampleShadingEnable = VK_FALSE;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisampling.minSampleShading = 1.0f;
+
+		VkPipelineDepthStencilStateCreateInfo depthStencil{};
+		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+		depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+		depthStencil.depthCompareOp = desc.depthCompare;
+		depthStencil.depthBoundsTestEnable = VK_FALSE;
+		depthStencil.stencilTestEnable = VK_FALSE;
+		depthStencil.minDepthBounds = 0.0f;
+		depthStencil.maxDepthBounds = 1.0f;
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		colorBlendAttachment.blendEnable = desc.alphaBlend ? VK_TRUE : VK_FALSE;
+		colorBlendAttachment.srcColorBlendFactor = desc.alphaBlend ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstColorBlendFactor = desc.alphaBlend ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.logicOpEnable = VK_FALSE;
+		colorBlending.logicOp = VK_LOGIC_OP_COPY;
+		colorBlending.attachmentCount = desc.colorAttachmentCount;
+		colorBlending.pAttachments = &colorBlendAttachment;
+
+		VkGraphicsPipelineCreateInfo graphicsPipelineInfo{};
+		graphicsPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		graphicsPipelineInfo.stageCount = stageCount;
+		graphicsPipelineInfo.pStages = shaderStages;
+		graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
+		graphicsPipelineInfo.pInputAssemblyState = &inputAssembly;
+		graphicsPipelineInfo.pViewportState = &viewportState;
+		graphicsPipelineInfo.pRasterizationState = &rasterizer;
+		graphicsPipelineInfo.pMultisampleState = &multisampling;
+		graphicsPipelineInfo.pDepthStencilState = (desc.depthTest || desc.depthWrite) ? &depthStencil : nullptr;
+		graphicsPipelineInfo.pColorBlendState = &colorBlending;
+		graphicsPipelineInfo.pDynamicState = nullptr;
+		graphicsPipelineInfo.layout = desc.layout;
+		graphicsPipelineInfo.renderPass = desc.renderPass;
+		graphicsPipelineInfo.subpass = desc.subpass;
+		graphicsPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		graphicsPipelineInfo.basePipelineIndex = -1;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vkCreateGraphicsPipelines(m_device, m_cache, 1, &graphicsPipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Graphics Pipeline");
+		}
+		return pipeline;
+	}
+
+	VkPipeline PipelineBuilder::BuildCompute(ComputePipelineDesc& desc, VkShaderModule computeModule) const
+	{
+		VkComputePipelineCreateInfo computePipelineInfo{};
+		computePipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		computePipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		computePipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		computePipelineInfo.stage.module = computeModule;
+		computePipelineInfo.stage.pName = "main";
+		computePipelineInfo.stage.pSpecializationInfo = desc.specialization.GetInfo();
+		computePipelineInfo.layout = desc.layout;
+		computePipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		computePipelineInfo.basePipelineIndex = -1;
+
+		VkPipeline pipeline = VK_NULL_HANDLE;
+		if (vkCreateComputePipelines(m_device, m_cache, 1, &computePipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Compute Pipeline");
+		}
+		return pipeline;
+	}
+}
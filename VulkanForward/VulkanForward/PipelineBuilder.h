@@ -0,0 +1,117 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <vulkan/vulkan.h>
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "Shader.h"
+
+namespace Graphics
+{
+	//32 bit specialization constants handed to every stage of a pipeline, a stage ignores ids it does not declare.
+	//Kept sorted by id, so the same constants set in any order describe the same pipeline.
+	class SpecializationConstants
+	{
+	private:
+		std::vector<VkSpecializationMapEntry> m_entries;
+		std::vector<uint32_t> m_values;
+		VkSpecializationInfo m_info{};
+
+	public:
+		SpecializationConstants& Set(uint32_t id, uint32_t value);
+
+		//points into these constants, null when none are set
+		const VkSpecializationInfo* GetInfo();
+
+		inline uint32_t GetCount() const { return static_cast<uint32_t>(m_entries.size()); }
+		inline uint32_t GetId(uint32_t index) const { return m_entries[index].constantID; }
+		inline uint32_t GetValue(uint32_t index) const { return m_values[index]; }
+	};
+
+	//everything that goes into a graphics pipeline, shaders are SPIR-V file names loaded through the ShaderLibrary
+	struct GraphicsPipelineDesc
+	{
+		std::string vertexShader;
+		std::string fragmentShader;		//empty for depth only pipelines
+		VertexLayout vertexLayout;
+		SpecializationConstants specialization;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		uint64_t layoutKey = 0;			//HashPipelineLayoutCompatibility of layout, required by the PipelineRegistry
+		VkRenderPass renderPass = VK_NULL_HANDLE;
+		uint64_t renderPassKey = 0;		//HashRenderPassCompatibility of renderPass, required by the PipelineRegistry
+		uint32_t subpass = 0;
+		VkExtent2D extent = { 0, 0 };
+
+		VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+		VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+		VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+		bool depthTest = false;
+		bool depthWrite = false;
+		VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+		bool alphaBlend = false;
+		uint32_t colorAttachmentCount = 1;		//of the subpass, 0 for depth only passes
+	};
+
+	struct ComputePipelineDesc
+	{
+		std::string shader;
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+		uint64_t layoutKey = 0;			//HashPipelineLayoutCompatibility of layout, required by the PipelineRegistry
+		SpecializationConstants specialization;
+	};
+
+	typedef uint32_t PipelineHandle;
+
+	//Compiles pipelines on the job system into one shared VkPipelineCache, which the driver synchronizes internally.
+	//Submit returns at once with a handle; Get waits for that pipeline, running other jobs meanwhile, and rethrows
+	//any error from its build. Submit and Get must be called from the thread that created the job system.
+	//The pipelines belong to the caller.
+	class PipelineBuilder
+	{
+	private:
+		struct Request
+		{
+			PipelineBuilder* builder;
+			GraphicsPipelineDesc graphics;
+			ComputePipelineDesc compute;
+			bool isCompute;
+			VkShaderModule modules[2] = {};		//vertex and fragment (null when depth only) or compute, resolved at submit so a reload can not change an in flight build
+
+			JobCounter counter;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			std::string error;
+		};
+
+		VkDevice m_device;
+		JobSystem& m_jobSystem;
+		ShaderLibrary& m_shaders;
+		VkPipelineCache m_cache;
+		std::deque<std::unique_ptr<Request>> m_requests;
+
+		static void BuildJob(void* data, uint32_t, uint32_t);
+		VkPipeline BuildGraphics(GraphicsPipelineDesc& desc, VkShaderModule vertexModule, VkShaderModule fragModule) const;
+		VkPipeline BuildCompute(ComputePipelineDesc& desc, VkShaderModule computeModule) const;
+		PipelineHandle Submit(std::unique_ptr<Request> request);
+
+	public:
+		PipelineBuilder(VkDevice device, JobSystem& jobSystem, ShaderLibrary& shaders, VkPipelineCache cache);
+		~PipelineBuilder();
+
+		PipelineBuilder(const PipelineBuilder&) = delete;
+		PipelineBuilder& operator=(const PipelineBuilder&) = delete;
+
+		PipelineHandle Submit(const GraphicsPipelineDesc& desc);
+		PipelineHandle Submit(const ComputePipelineDesc& desc);
+
+		bool IsReady(PipelineHandle handle) const;
+		VkPipeline Get(PipelineHandle handle);
+
+		//waits for every submitted pipeline, throws the first build error
+		void WaitAll();
+
+		inline uint32_t GetSubmittedCount() const { return static_cast<uint32_t>(m_requests.size()); }
+	};
+}
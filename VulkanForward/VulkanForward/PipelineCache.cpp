@@ -0,0 +1,111 @@
+#include "PipelineCache.h"
+#include "MappedFile.h"
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+namespace Graphics
+{
+	PipelineCache::PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& filename)
+		: m_device(device), m_filename(filename)
+	{
+		//no file is a cold start. The driver copies the data, the mapping is gone before Save replaces the file
+		MappedFile file;
+		try
+		{
+			file = MappedFile(filename);
+		}
+		catch (const std::runtime_error&)
+		{
+		}
+
+		size_t size = file.GetSize();
+		if (!IsCompatible(file.GetChars(), size, properties))
+		{
+			size = 0;
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = size;
+		cacheInfo.pInitialData = size == 0 ? nullptr : file.GetData();
+
+		//the header checks out but the driver may still reject the contents, start cold rather than fail
+		if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+		{
+			cacheInfo.initialDataSize = 0;
+			cacheInfo.pInitialData = nullptr;
+			size = 0;
+			if (vkCreatePipelineCache(m_device, &cacheInfo, nullptr, &m_cache) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Create Pipeline Cache!");
+			}
+		}
+
+		m_loadedBytes = size;
+	}
+
+	PipelineCache::~PipelineCache()
+	{
+		vkDestroyPipelineCache(m_device, m_cache, nullptr);
+	}
+
+	bool PipelineCache::IsCompatible(const char* data, size_t size, const VkPhysicalDeviceProperties& properties)
+	{
+		//VkPipelineCacheHeaderVersionOne, read field by field since the file may be anything
+		const size_t headerSize = 16 + VK_UUID_SIZE;
+		if (size < headerSize)
+			return false;
+
+		uint32_t fields[4];
+		memcpy(fields, data, sizeof(fields));
+
+		if (fields[0] < headerSize || fields[0] > size)
+			return false;
+		if (fields[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+			return false;
+		if (fields[2] != properties.vendorID || fields[3] != properties.deviceID)
+			return false;
+
+		return memcmp(data + sizeof(fields), properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+	}
+
+	bool PipelineCache::Save() const
+	{
+		size_t size = 0;
+		if (vkGetPipelineCacheData(m_device, m_cache, &size, nullptr) != VK_SUCCESS || size == 0)
+			return false;
+
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+			return false;
+
+		std::string tempFilename = m_filename + ".tmp";
+		{
+			std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return false;
+
+			file.write(data.data(), size);
+			file.flush();
+			if (!file)
+			{
+				file.close();
+				std::remove(tempFilename.c_str());
+				return false;
+			}
+		}
+
+		//replaces an existing file in one step on both windows and posix
+		std::error_code error;
+		std::filesystem::rename(tempFilename, m_filename, error);
+		if (error)
+		{
+			std::filesystem::remove(tempFilename, error);
+			return false;
+		}
+		return true;
+	}
+}
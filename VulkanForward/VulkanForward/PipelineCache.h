@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace Graphics
+{
+	//VkPipelineCache backed by a file. The file is only handed to the driver when its header matches this device's
+	//vendor, device and pipelineCacheUUID, since some drivers crash on foreign data instead of ignoring it.
+	class PipelineCache
+	{
+	private:
+		VkDevice m_device;
+		VkPipelineCache m_cache = VK_NULL_HANDLE;
+		std::string m_filename;
+		size_t m_loadedBytes = 0;
+
+		static bool IsCompatible(const char* data, size_t size, const VkPhysicalDeviceProperties& properties);
+
+	public:
+		PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& filename);
+		~PipelineCache();
+
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+
+		//writes to a temporary file and renames it over the old one, so a crash mid write never leaves a torn cache.
+		//returns false when the data could not be written, the old file is then left as it was.
+		bool Save() const;
+
+		inline VkPipelineCache Get() const { return m_cache; }
+		inline bool WasLoaded() const { return m_loadedBytes > 0; }
+		inline size_t GetLoadedBytes() const { return m_loadedBytes; }
+	};
+}
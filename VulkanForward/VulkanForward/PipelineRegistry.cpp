@@ -0,0 +1,329 @@
+#include "PipelineRegistry.h"
+#include <iomanip>
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+
+namespace Graphics
+{
+	uint64_t HashRenderPassCompatibility(const VkRenderPassCreateInfo& renderPassInfo)
+	{
+		//formats, sample counts and how subpasses reference them; load/store ops and layouts do not matter
+		StateHasher hasher;
+		hasher.Add(renderPassInfo.attachmentCount);
+		for (uint32_t i = 0; i < renderPassInfo.attachmentCount; ++i)
+		{
+			hasher.Add(renderPassInfo.pAttachments[i].format);
+			hasher.Add(renderPassInfo.pAttachments[i].samples);
+		}
+
+		hasher.Add(renderPassInfo.subpassCount);
+		for (uint32_t i = 0; i < renderPassInfo.subpassCount; ++i)
+		{
+			const VkSubpassDescription& subpass = renderPassInfo.pSubpasses[i];
+			hasher.Add(subpass.inputAttachmentCount);
+			for (uint32_t a = 0; a < subpass.inputAttachmentCount; ++a)
+				hasher.Add(subpass.pInputAttachments[a].attachment);
+			hasher.Add(subpass.colorAttachmentCount);
+			for (uint32_t a = 0; a < subpass.colorAttachmentCount; ++a)
+				hasher.Add(subpass.pColorAttachments[a].attachment);
+			hasher.Add(subpass.pResolveAttachments != nullptr);
+			for (uint32_t a = 0; subpass.pResolveAttachments && a < subpass.colorAttachmentCount; ++a)
+				hasher.Add(subpass.pResolveAttachments[a].attachment);
+			hasher.Add(subpass.pDepthStencilAttachment ? subpass.pDepthStencilAttachment->attachment : VK_ATTACHMENT_UNUSED);
+		}
+		return hasher.Get();
+	}
+
+	uint64_t HashPipelineLayoutCompatibility(const ReflectedLayout& layout)
+	{
+		//bindings are kept sorted, so equal layouts hash equally whatever order the shaders were added in
+		StateHasher hasher;
+		hasher.Add(layout.sets.size());
+		for (const std::vector<VkDescriptorSetLayoutBinding>& set : layout.sets)
+		{
+			hasher.Add(set.size());
+			for (const VkDescriptorSetLayoutBinding& binding : set)
+			{
+				hasher.Add(binding.binding);
+				hasher.Add(binding.descriptorType);
+				hasher.Add(binding.descriptorCount);
+				hasher.Add(binding.stageFlags);
+			}
+		}
+
+		hasher.Add(layout.pushConstants.size());
+		for (const VkPushConstantRange& range : layout.pushConstants)
+		{
+			hasher.Add(range.stageFlags);
+			hasher.Add(range.offset);
+			hasher.Add(range.size);
+		}
+		return hasher.Get();
+	}
+
+	//constants no stage declares do not change the pipeline, leaving them out lets such permutations share one
+	static void HashSpecialization(StateHasher& hasher, const SpecializationConstants& specialization, std::initializer_list<const Shader*> stages)
+	{
+		for (uint32_t i = 0; i < specialization.GetCount(); ++i)
+		{
+			uint32_t id = specialization.GetId(i);
+			for (const Shader* stage : stages)
+			{
+				const std::vector<uint32_t>& declared = stage->GetReflection().specConstants;
+				if (std::binary_search(declared.begin(), declared.end(), id))
+				{
+					hasher.Add(id);
+					hasher.Add(specialization.GetValue(i));
+					break;
+				}
+			}
+		}
+	}
+
+	uint64_t HashPipelineDesc(const GraphicsPipelineDesc& desc, ShaderLibrary& shaders, std::string* key)
+	{
+		if (desc.layoutKey == 0 || desc.renderPassKey == 0)
+		{
+			throw std::runtime_error("graphics pipeline description is missing its layout or render pass key");
+		}
+		const Shader& vertexShader = shaders.Load(desc.vertexShader);
+
+		StateHasher hasher(key);
+		hasher.Add(VK_PIPELINE_BIND_POINT_GRAPHICS);
+		hasher.Add(vertexShader.GetHash());
+		if (desc.fragmentShader.empty())
+		{
+			hasher.Add(uint64_t(0));
+			HashSpecialization(hasher, desc.specialization, { &vertexShader });
+		}
+		else
+		{
+			const Shader& fragmentShader = shaders.Load(desc.fragmentShader);
+			hasher.Add(fragmentShader.GetHash());
+			HashSpecialization(hasher, desc.specialization, { &vertexShader, &fragmentShader });
+		}
+
+		hasher.Add(desc.vertexLayout.GetBindings().size());
+		for (const VkVertexInputBindingDescription& binding : desc.vertexLayout.GetBindings())
+		{
+			hasher.Add(binding.binding);
+			hasher.Add(binding.stride);
+			hasher.Add(binding.inputRate);
+		}
+		hasher.Add(desc.vertexLayout.GetAttributes().size());
+		for (const VkVertexInputAttributeDescription& attribute : desc.vertexLayout.GetAttributes())
+		{
+			hasher.Add(attribute.location);
+			hasher.Add(attribute.binding);
+			hasher.Add(attribute.format);
+			hasher.Add(attribute.offset);
+		}
+
+		hasher.Add(desc.layoutKey);
+		hasher.Add(desc.renderPassKey);
+		hasher.Add(desc.subpass);
+		hasher.Add(desc.extent.width);
+		hasher.Add(desc.extent.height);
+
+		hasher.Add(desc.topology);
+		hasher.Add(desc.polygonMode);
+		hasher.Add(desc.cullMode);
+		hasher.Add(desc.frontFace);
+		hasher.Add(desc.depthTest);
+		hasher.Add(desc.depthWrite);
+		hasher.Add(desc.depthCompare);
+		hasher.Add(desc.alphaBlend);
+		hasher.Add(desc.colorAttachmentCount);
+		return hasher.Get();
+	}
+
+	uint64_t HashPipelineDesc(const ComputePipelineDesc& desc, ShaderLibrary& shaders, std::string* key)
+	{
+		if (desc.layoutKey == 0)
+		{
+			throw std::runtime_error("compute pipeline description is missing its layout key");
+		}
+		const Shader& shader = shaders.Load(desc.shader);
+
+		StateHasher hasher(key);
+		hasher.Add(VK_PIPELINE_BIND_POINT_COMPUTE);
+		hasher.Add(shader.GetHash());
+		HashSpecialization(hasher, desc.specialization, { &shader });
+		hasher.Add(desc.layoutKey);
+		return hasher.Get();
+	}
+
+	void PipelineRegistryStats::Print(std::ostream& out) const
+	{
+		uint64_t requests = hits + misses;
+		uint64_t bindRequests = binds + skippedBinds;
+
+		out << "pipelines: " << pipelineCount << ", " << hits << " hits / " << misses << " misses";
+		if (requests)
+		{
+			out << " (" << std::fixed << std::setprecision(1) << 100.0 * hits / requests << "% hit)";
+		}
+		out << ", " << binds << " binds, " << skippedBinds << " redundant binds skipped";
+		if (bindRequests)
+		{
+			out << " (" << std::fixed << std::setprecision(1) << 100.0 * skippedBinds / bindRequests << "%)";
+		}
+		out << "\n";
+	}
+
+	PipelineRegistry::PipelineRegistry(VkDevice device, JobSystem& jobSystem, ShaderLibrary& shaders, VkPipelineCache cache)
+		: m_device(device), m_shaders(shaders), m_builder(device, jobSystem, shaders, cache)
+	{
+	}
+
+	PipelineRegistry::~PipelineRegistry()
+	{
+		for (auto& pipeline : m_pipelines)
+		{
+			try
+			{
+				vkDestroyPipeline(m_device, Resolve(pipeline.second), nullptr);
+			}
+			catch (const std::exception&)
+			{
+				//failed builds have nothing to destroy
+			}
+		}
+
+		for (RetiredPipeline& retired : m_retired)
+		{
+			vkDestroyPipeline(m_device, retired.pipeline, nullptr);
+		}
+	}
+
+	//the 64 bit hash only picks the entry, two different descriptions sharing one must not share a pipeline
+	static void CheckKey(const std::string& stored, const std::string& key)
+	{
+		if (stored != key)
+		{
+			throw std::runtime_error("two pipeline descriptions share a hash");
+		}
+	}
+
+	template<typename Desc>
+	PipelineRegistry::Entry& PipelineRegistry::Find(const Desc& desc, bool prefetch)
+	{
+		std::string key;
+		uint64_t hash = HashPipelineDesc(desc, m_shaders, &key);
+		auto found = m_pipelines.find(hash);
+		if (found != m_pipelines.end())
+		{
+			Entry& entry = found->second;
+			CheckKey(entry.key, key);
+			if (prefetch || !entry.prefetched)
+			{
+				++m_hits;
+			}
+			entry.prefetched = prefetch;
+			return entry;
+		}
+
+		++m_misses;
+		Entry& entry = m_pipelines[hash];
+		entry.key = std::move(key);
+		entry.handle = m_builder.Submit(desc);
+		entry.pipeline = VK_NULL_HANDLE;
+		entry.prefetched = prefetch;
+		return entry;
+	}
+
+	template<typename Desc>
+	bool PipelineRegistry::IsEntryReady(const Desc& desc) const
+	{
+		std::string key;
+		auto found = m_pipelines.find(HashPipelineDesc(desc, m_shaders, &key));
+		if (found == m_pipelines.end())
+			return false;
+
+		CheckKey(found->second.key, key);
+		return found->second.pipeline != VK_NULL_HANDLE || m_builder.IsReady(found->second.handle);
+	}
+
+	VkPipeline PipelineRegistry::Resolve(Entry& entry)
+	{
+		if (entry.pipeline == VK_NULL_HANDLE)
+		{
+			entry.pipeline = m_builder.Get(entry.handle);
+		}
+		return entry.pipeline;
+	}
+
+	void PipelineRegistry::Prefetch(const GraphicsPipelineDesc& desc)
+	{
+		Find(desc, true);
+	}
+
+	void PipelineRegistry::Prefetch(const ComputePipelineDesc& desc)
+	{
+		Find(desc, true);
+	}
+
+	VkPipeline PipelineRegistry::GetGraphics(const GraphicsPipelineDesc& desc)
+	{
+		return Resolve(Find(desc, false));
+	}
+
+	VkPipeline PipelineRegistry::GetCompute(const ComputePipelineDesc& desc)
+	{
+		return Resolve(Find(desc, false));
+	}
+
+	bool PipelineRegistry::IsReady(const GraphicsPipelineDesc& desc) const
+	{
+		return IsEntryReady(desc);
+	}
+
+	bool PipelineRegistry::IsReady(const ComputePipelineDesc& desc) const
+	{
+		return IsEntryReady(desc);
+	}
+
+	void PipelineRegistry::Retire(VkPipeline pipeline, uint32_t framesInFlight)
+	{
+		if (pipeline == VK_NULL_HANDLE)
+			return;
+
+		for (auto entry = m_pipelines.begin(); entry != m_pipelines.end(); ++entry)
+		{
+			if (entry->second.pipeline == pipeline)
+			{
+				m_pipelines.erase(entry);
+				m_retired.push_back({ pipeline, framesInFlight });
+				return;
+			}
+		}
+	}
+
+	void PipelineRegistry::BeginFrame()
+	{
+		for (size_t i = 0; i < m_retired.size();)
+		{
+			if (--m_retired[i].framesLeft > 0)
+			{
+				++i;
+				continue;
+			}
+
+			vkDestroyPipeline(m_device, m_retired[i].pipeline, nullptr);
+			m_retired[i] = m_retired.back();
+			m_retired.pop_back();
+		}
+	}
+
+	PipelineRegistryStats PipelineRegistry::GetStats() const
+	{
+		PipelineRegistryStats stats;
+		stats.hits = m_hits;
+		stats.misses = m_misses;
+		stats.pipelineCount = static_cast<uint32_t>(m_pipelines.size());
+		stats.binds = m_binds.load(std::memory_order_relaxed);
+		stats.skippedBinds = m_skippedBinds.load(std::memory_order_relaxed);
+		return stats;
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+#include "PipelineBuilder.h"
+#include "Hash.h"
+
+namespace Graphics
+{
+	//render passes with equal keys are compatible, so a pipeline built for one can be used with the other
+	uint64_t HashRenderPassCompatibility(const VkRenderPassCreateInfo& renderPassInfo);
+
+	//pipeline layouts created from layouts with equal keys are identically defined, so their pipelines are interchangeable
+	uint64_t HashPipelineLayoutCompatibility(const ReflectedLayout& layout);
+
+	//every field that changes the compiled pipeline, hashed member by member so padding never leaks in.
+	//shaders are keyed by their contents rather than their file names, specialization constants by the ones they declare,
+	//the layout and render pass by their compatibility keys rather than their handles. Throws when a key is missing.
+	//When key is given the hashed bytes are appended to it.
+	uint64_t HashPipelineDesc(const GraphicsPipelineDesc& desc, ShaderLibrary& shaders, std::string* key = nullptr);
+	uint64_t HashPipelineDesc(const ComputePipelineDesc& desc, ShaderLibrary& shaders, std::string* key = nullptr);
+
+	struct PipelineRegistryStats
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint32_t pipelineCount = 0;
+		uint64_t binds = 0;
+		uint64_t skippedBinds = 0;
+
+		void Print(std::ostream& out) const;
+	};
+
+	//Owns every pipeline, keyed by the hash of its description. A request for a known state returns the existing
+	//pipeline, a new one is built on the PipelineBuilder. Prefetch starts builds without waiting so several can be in
+	//flight at startup; the Get that collects a prefetched pipeline completes the same request and is not counted
+	//again. A hash match is checked against the full description key before it is trusted. Pipelines replaced by a
+	//shader reload are retired and destroyed once no frame can still use them. Render thread only, apart from CountBinds.
+	class PipelineRegistry
+	{
+	private:
+		struct Entry
+		{
+			std::string key;
+			PipelineHandle handle;
+			VkPipeline pipeline;
+			bool prefetched;		//requested by Prefetch and not collected by a Get yet
+		};
+
+		struct RetiredPipeline
+		{
+			VkPipeline pipeline;
+			uint32_t framesLeft;
+		};
+
+		VkDevice m_device;
+		ShaderLibrary& m_shaders;
+		PipelineBuilder m_builder;
+		std::unordered_map<uint64_t, Entry> m_pipelines;
+		std::vector<RetiredPipeline> m_retired;
+
+		uint64_t m_hits = 0;
+		uint64_t m_misses = 0;
+		std::atomic<uint64_t> m_binds{ 0 };
+		std::atomic<uint64_t> m_skippedBinds{ 0 };
+
+		template<typename Desc>
+		Entry& Find(const Desc& desc, bool prefetch);
+		template<typename Desc>
+		bool IsEntryReady(const Desc& desc) const;
+		VkPipeline Resolve(Entry& entry);
+
+	public:
+		PipelineRegistry(VkDevice device, JobSystem& jobSystem, ShaderLibrary& shaders, VkPipelineCache cache);
+		~PipelineRegistry();
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+		void Prefetch(const GraphicsPipelineDesc& desc);
+		void Prefetch(const ComputePipelineDesc& desc);
+
+		VkPipeline GetGraphics(const GraphicsPipelineDesc& desc);
+		VkPipeline GetCompute(const ComputePipelineDesc& desc);
+
+		//true once a prefetched pipeline has finished building, successfully or not. Does not count as a request.
+		bool IsReady(const GraphicsPipelineDesc& desc) const;
+		bool IsReady(const ComputePipelineDesc& desc) const;
+
+		//drops the pipeline from the registry, it is destroyed after framesInFlight more calls to BeginFrame
+		void Retire(VkPipeline pipeline, uint32_t framesInFlight);
+
+		//call once per frame after its fence wait
+		void BeginFrame();
+
+		//PipelineBindState totals, added once per recorded command buffer
+		inline void CountBinds(uint64_t binds, uint64_t skipped)
+		{
+			m_binds.fetch_add(binds, std::memory_order_relaxed);
+			m_skippedBinds.fetch_add(skipped, std::memory_order_relaxed);
+		}
+
+		PipelineRegistryStats GetStats() const;
+	};
+
+	//the pipeline bound on one command buffer, repeated binds of the same pipeline are dropped
+	class PipelineBindState
+	{
+	private:
+		VkPipeline m_bound[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };		//graphics, compute
+		uint64_t m_binds = 0;
+		uint64_t m_skipped = 0;
+
+	public:
+		inline void Bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipeline pipeline)
+		{
+			VkPipeline& bound = m_bound[bindPoint == VK_PIPELINE_BIND_POINT_COMPUTE ? 1 : 0];
+			if (bound == pipeline)
+			{
+				++m_skipped;
+				return;
+			}
+
+			vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+			bound = pipeline;
+			++m_binds;
+		}
+
+		inline uint64_t GetBinds() const { return m_binds; }
+		inline uint64_t GetSkipped() const { return m_skipped; }
+	};
+}
@@ -0,0 +1,99 @@
+#include "PipelineStatistics.h"
+#include <stdexcept>
+#include <iomanip>
+
+namespace Graphics
+{
+	PipelineStatisticsQueries::PipelineStatisticsQueries(VkDevice device, const char* const* passNames, uint32_t passCount, uint32_t framesInFlight)
+		: m_device(device), m_passCount(passCount), m_begunPasses(framesInFlight, 0), m_passes(passCount)
+	{
+		for (uint32_t pass = 0; pass < passCount; ++pass)
+		{
+			m_passes[pass].name = passNames[pass];
+		}
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		poolInfo.queryCount = passCount * framesInFlight;
+		poolInfo.pipelineStatistics = Statistics;
+
+		if (vkCreateQueryPool(m_device, &poolInfo, nullptr, &m_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Query Pool!");
+		}
+	}
+
+	PipelineStatisticsQueries::~PipelineStatisticsQueries()
+	{
+		vkDestroyQueryPool(m_device, m_pool, nullptr);
+	}
+
+	void PipelineStatisticsQueries::BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+	{
+		m_begunPasses[frameIndex] = 0;
+		vkCmdResetQueryPool(commandBuffer, m_pool, frameIndex * m_passCount, m_passCount);
+	}
+
+	void PipelineStatisticsQueries::Begin(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass)
+	{
+		m_begunPasses[frameIndex] |= 1u << pass;
+		vkCmdBeginQuery(commandBuffer, m_pool, frameIndex * m_passCount + pass, 0);
+	}
+
+	void PipelineStatisticsQueries::End(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass)
+	{
+		vkCmdEndQuery(commandBuffer, m_pool, frameIndex * m_passCount + pass);
+	}
+
+	void PipelineStatisticsQueries::ReadFrame(uint32_t frameIndex)
+	{
+		for (uint32_t pass = 0; pass < m_passCount; ++pass)
+		{
+			if (!(m_begunPasses[frameIndex] & (1u << pass)))
+				continue;
+
+			uint64_t values[StatisticCount];
+			if (vkGetQueryPoolResults(m_device, m_pool, frameIndex * m_passCount + pass, 1, sizeof(values), values, sizeof(values), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+				continue;
+
+			PassStatistics& statistics = m_passes[pass];
+			++statistics.frameCount;
+			statistics.vertexInvocations += values[0];
+			statistics.clippingInvocations += values[1];
+			statistics.clippingPrimitives += values[2];
+			statistics.fragmentInvocations += values[3];
+			statistics.computeInvocations += values[4];
+		}
+	}
+
+	void PipelineStatisticsQueries::Print(std::ostream& out, uint64_t screenPixels) const
+	{
+		out << std::fixed << std::setprecision(2);
+		out << "pipeline statistics per frame:\n";
+		for (const PassStatistics& pass : m_passes)
+		{
+			if (pass.frameCount == 0)
+				continue;
+
+			double frames = (double)pass.frameCount;
+			out << "  " << pass.name << ":";
+			if (pass.clippingInvocations > 0)
+			{
+				double culled = 1.0 - (double)pass.clippingPrimitives / (double)pass.clippingInvocations;
+				out << " " << pass.vertexInvocations / frames << " vertex invocations, " << pass.clippingPrimitives / frames << " of "
+					<< pass.clippingInvocations / frames << " primitives past clipping (" << culled * 100.0 << "% culled)";
+			}
+			//helper invocations included, so even a single layer of coverage is a little over 1
+			if (pass.fragmentInvocations > 0 && screenPixels > 0)
+			{
+				out << ", " << pass.fragmentInvocations / frames / screenPixels << " fragment invocations per pixel";
+			}
+			if (pass.computeInvocations > 0)
+			{
+				out << " " << pass.computeInvocations / frames << " compute invocations";
+			}
+			out << " (" << pass.frameCount << " frames)\n";
+		}
+	}
+}
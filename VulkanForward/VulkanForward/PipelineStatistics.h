@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <ostream>
+#include <vulkan/vulkan.h>
+
+namespace Graphics
+{
+	//what the passes of a frame did, summed over the frames read
+	struct PassStatistics
+	{
+		const char* name;
+		uint64_t frameCount = 0;
+		uint64_t vertexInvocations = 0;
+		uint64_t clippingInvocations = 0;		//primitives reaching the clipper
+		uint64_t clippingPrimitives = 0;		//primitives it passed on to the rasterizer
+		uint64_t fragmentInvocations = 0;
+		uint64_t computeInvocations = 0;
+	};
+
+	//One VK_QUERY_TYPE_PIPELINE_STATISTICS query per pass and frame in flight. Like the timestamps they are read once the
+	//frame's fence has signaled, without waiting. Needs the pipelineStatisticsQuery feature, secondary command buffers
+	//executed while a query is active must inherit Statistics.
+	class PipelineStatisticsQueries
+	{
+	public:
+		//results come back in bit order, the ReadFrame layout depends on it
+		static const VkQueryPipelineStatisticFlags Statistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+			VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+		static const uint32_t StatisticCount = 5;
+
+	private:
+		VkDevice m_device;
+		VkQueryPool m_pool = VK_NULL_HANDLE;
+		uint32_t m_passCount;
+		std::vector<uint32_t> m_begunPasses;		//bit per pass, per frame in flight
+		std::vector<PassStatistics> m_passes;
+
+	public:
+		PipelineStatisticsQueries(VkDevice device, const char* const* passNames, uint32_t passCount, uint32_t framesInFlight);
+		~PipelineStatisticsQueries();
+
+		PipelineStatisticsQueries(const PipelineStatisticsQueries&) = delete;
+		PipelineStatisticsQueries& operator=(const PipelineStatisticsQueries&) = delete;
+
+		//resets the frame's queries outside any render pass, the GPU must be done with the frame's previous use
+		void BeginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+		//a pass is counted once per frame, begun and ended outside its render pass
+		void Begin(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass);
+		void End(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass);
+
+		//the frame's fence must have signaled, passes without results are skipped
+		void ReadFrame(uint32_t frameIndex);
+
+		inline const std::vector<PassStatistics>& GetPasses() const { return m_passes; }
+
+		//per frame averages: vertices, primitives culled by clipping, fragments per screen pixel, compute invocations
+		void Print(std::ostream& out, uint64_t screenPixels) const;
+	};
+
+	//counts a pass of the current frame, does nothing without queries
+	class PipelineStatisticsScope
+	{
+	private:
+		PipelineStatisticsQueries* m_queries;
+		VkCommandBuffer m_commandBuffer;
+		uint32_t m_frameIndex;
+		uint32_t m_pass;
+
+	public:
+		PipelineStatisticsScope(PipelineStatisticsQueries* queries, VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t pass)
+			: m_queries(queries), m_commandBuffer(commandBuffer), m_frameIndex(frameIndex), m_pass(pass)
+		{
+			if (m_queries)
+			{
+				m_queries->Begin(commandBuffer, frameIndex, pass);
+			}
+		}
+
+		~PipelineStatisticsScope()
+		{
+			if (m_queries)
+			{
+				m_queries->End(m_commandBuffer, m_frameIndex, m_pass);
+			}
+		}
+
+		PipelineStatisticsScope(const PipelineStatisticsScope&) = delete;
+		PipelineStatisticsScope& operator=(const PipelineStatisticsScope&) = delete;
+	};
+}
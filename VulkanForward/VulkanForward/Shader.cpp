@@ -1,48 +1,684 @@
 #include "Shader.h"
-#include <fstream>
+#include "Hash.h"
+#include <spirv-headers/spirv.hpp>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
-namespace Graphics 
+namespace Graphics
 {
-	static std::vector<char> readFile(const std::string& filename)
+	namespace
 	{
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
+		//everything the reflection needs to know about one SPIR-V id
+		struct SpirvId
+		{
+			uint32_t opcode = 0;
+			std::vector<uint32_t> operands;		//words after the result id
+			uint32_t storageClass = 0;
+			uint64_t constant = 0;
+
+			uint32_t set = ~0u;
+			uint32_t binding = ~0u;
+			uint32_t location = ~0u;
+			bool builtIn = false;
+			bool block = false;
+			bool bufferBlock = false;
+			uint32_t arrayStride = 0;
+			uint32_t specId = ~0u;
+			std::vector<uint32_t> memberOffsets;
+			std::vector<uint32_t> memberMatrixStrides;
+
+			uint32_t size = ~0u;		//TypeSize without a matrix stride, once known
+			bool sizing = false;		//TypeSize is inside this type
+		};
+
+		struct SpirvModule
+		{
+			std::vector<SpirvId> ids;
+			std::vector<uint32_t> variables;
+			std::vector<uint32_t> specConstants;
+
+			SpirvId& Get(uint32_t id)
+			{
+				if (id >= ids.size())
+				{
+					throw std::runtime_error("SPIR-V id out of bounds");
+				}
+				return ids[id];
+			}
+
+			uint32_t Operand(uint32_t id, size_t index)
+			{
+				SpirvId& type = Get(id);
+				if (index >= type.operands.size())
+				{
+					throw std::runtime_error("malformed SPIR-V type");
+				}
+				return type.operands[index];
+			}
+		};
+
+		//universal limits from the SPIR-V specification, anything above is a corrupt module
+		const uint32_t MaxIdBound = 0x3FFFFF;
+		const uint32_t MaxStructMembers = 16383;
+		const uint32_t MaxTypeNesting = 255;
+
+		void SetMember(std::vector<uint32_t>& members, uint32_t member, uint32_t value)
+		{
+			if (member >= MaxStructMembers)
+			{
+				throw std::runtime_error("malformed SPIR-V member decoration");
+			}
+			if (member >= members.size())
+			{
+				members.resize(member + 1, 0);
+			}
+			members[member] = value;
+		}
+
+		uint32_t TypeSize(SpirvModule& module, uint32_t typeId, uint32_t matrixStride, uint32_t depth);
+
+		uint32_t ElementsSize(SpirvModule& module, uint32_t typeId, uint32_t matrixStride, uint32_t depth)
+		{
+			SpirvId& type = module.Get(typeId);
+			switch (type.opcode)
+			{
+			case spv::OpTypeBool:
+				return 4;
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+				return module.Operand(typeId, 0) / 8;
+			case spv::OpTypeVector:
+				return module.Operand(typeId, 1) * TypeSize(module, module.Operand(typeId, 0), 0, depth + 1);
+			case spv::OpTypeMatrix:
+				return module.Operand(typeId, 1) * (matrixStride ? matrixStride : TypeSize(module, module.Operand(typeId, 0), 0, depth + 1));
+			case spv::OpTypeArray:
+			{
+				uint32_t length = static_cast<uint32_t>(module.Get(module.Operand(typeId, 1)).constant);
+				return length * (type.arrayStride ? type.arrayStride : TypeSize(module, module.Operand(typeId, 0), matrixStride, depth + 1));
+			}
+			case spv::OpTypeStruct:
+			{
+				uint32_t size = 0;
+				for (size_t member = 0; member < type.operands.size(); ++member)
+				{
+					uint32_t offset = member < type.memberOffsets.size() ? type.memberOffsets[member] : size;
+					uint32_t stride = member < type.memberMatrixStrides.size() ? type.memberMatrixStrides[member] : 0;
+					size = std::max(size, offset + TypeSize(module, type.operands[member], stride, depth + 1));
+				}
+				return size;
+			}
+			default:
+				return 0;
+			}
+		}
+
+		//a type can not contain itself, and sizes are remembered so types shared by many members are walked once
+		uint32_t TypeSize(SpirvModule& module, uint32_t typeId, uint32_t matrixStride, uint32_t depth)
+		{
+			SpirvId& type = module.Get(typeId);
+			if (type.sizing || depth > MaxTypeNesting)
+			{
+				throw std::runtime_error("recursive SPIR-V type");
+			}
+			if (matrixStride == 0 && type.size != ~0u)
+			{
+				return type.size;
+			}
+
+			type.sizing = true;
+			uint32_t size = ElementsSize(module, typeId, matrixStride, depth);
+			type.sizing = false;
+
+			if (matrixStride == 0)
+			{
+				type.size = size;
+			}
+			return size;
+		}
+
+		VkFormat InputFormat(SpirvModule& module, uint32_t typeId)
+		{
+			uint32_t components = 1;
+			if (module.Get(typeId).opcode == spv::OpTypeVector)
+			{
+				components = module.Operand(typeId, 1);
+				typeId = module.Operand(typeId, 0);
+			}
+
+			SpirvId& scalar = module.Get(typeId);
+			if (components < 1 || components > 4 || scalar.operands.empty() || scalar.operands[0] != 32)
+				return VK_FORMAT_UNDEFINED;
+
+			static const VkFormat floatFormats[] = { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT };
+			static const VkFormat intFormats[] = { VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT };
+			static const VkFormat uintFormats[] = { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT };
+
+			if (scalar.opcode == spv::OpTypeFloat)
+				return floatFormats[components - 1];
+			if (scalar.opcode == spv::OpTypeInt)
+				return (scalar.operands.size() > 1 && scalar.operands[1]) ? intFormats[components - 1] : uintFormats[components - 1];
+			return VK_FORMAT_UNDEFINED;
+		}
+
+		//VK_DESCRIPTOR_TYPE_MAX_ENUM for variables that are not descriptors
+		VkDescriptorType DescriptorType(SpirvModule& module, uint32_t typeId, uint32_t storageClass)
+		{
+			SpirvId& type = module.Get(typeId);
+			switch (type.opcode)
+			{
+			case spv::OpTypeStruct:
+				if (storageClass == spv::StorageClassStorageBuffer || type.bufferBlock)
+					return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			case spv::OpTypeSampler:
+				return VK_DESCRIPTOR_TYPE_SAMPLER;
+			case spv::OpTypeSampledImage:
+				return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			case spv::OpTypeImage:
+			{
+				uint32_t dim = module.Operand(typeId, 1);
+				uint32_t sampled = module.Operand(typeId, 5);
+				if (dim == spv::DimSubpassData)
+					return VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+				if (dim == spv::DimBuffer)
+					return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+				return sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+			}
+			default:
+				return VK_DESCRIPTOR_TYPE_MAX_ENUM;
+			}
+		}
+
+		VkShaderStageFlagBits ShaderStage(uint32_t executionModel)
+		{
+			switch (executionModel)
+			{
+			case spv::ExecutionModelVertex: return VK_SHADER_STAGE_VERTEX_BIT;
+			case spv::ExecutionModelTessellationControl: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+			case spv::ExecutionModelTessellationEvaluation: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+			case spv::ExecutionModelGeometry: return VK_SHADER_STAGE_GEOMETRY_BIT;
+			case spv::ExecutionModelFragment: return VK_SHADER_STAGE_FRAGMENT_BIT;
+			case spv::ExecutionModelGLCompute: return VK_SHADER_STAGE_COMPUTE_BIT;
+			default: return VK_SHADER_STAGE_ALL;
+			}
+		}
+	}
+
+	ShaderReflection ReflectSpirv(const uint32_t* code, size_t wordCount)
+	{
+		if (wordCount < 5 || code[0] != spv::MagicNumber || code[3] > MaxIdBound)
+		{
+			throw std::runtime_error("not a SPIR-V module");
+		}
+
+		ShaderReflection reflection;
+		SpirvModule module;
+		module.ids.resize(code[3]);
+		bool entryPointFound = false;
+
+		for (size_t word = 5; word < wordCount;)
+		{
+			uint32_t opcode = code[word] & spv::OpCodeMask;
+			uint32_t length = code[word] >> spv::WordCountShift;
+			if (length == 0 || word + length > wordCount)
+			{
+				throw std::runtime_error("truncated SPIR-V instruction");
+			}
+			const uint32_t* operands = code + word + 1;
+			uint32_t operandCount = length - 1;
+
+			switch (opcode)
+			{
+			case spv::OpEntryPoint:
+				//the first entry point is the one the engine uses
+				if (!entryPointFound && operandCount >= 3)
+				{
+					reflection.stage = ShaderStage(operands[0]);
+					const char* name = reinterpret_cast<const char*>(operands + 2);
+					reflection.entryPoint.assign(name, strnlen(name, (operandCount - 2) * sizeof(uint32_t)));
+					entryPointFound = true;
+				}
+				break;
+
+			case spv::OpExecutionMode:
+				if (operandCount >= 5 && operands[1] == spv::ExecutionModeLocalSize)
+				{
+					reflection.localSize[0] = operands[2];
+					reflection.localSize[1] = operands[3];
+					reflection.localSize[2] = operands[4];
+				}
+				break;
+
+			case spv::OpDecorate:
+				if (operandCount >= 2)
+				{
+					SpirvId& target = module.Get(operands[0]);
+					uint32_t value = operandCount >= 3 ? operands[2] : 0;
+					switch (operands[1])
+					{
+					case spv::DecorationDescriptorSet: target.set = value; break;
+					case spv::DecorationBinding: target.binding = value; break;
+					case spv::DecorationLocation: target.location = value; break;
+					case spv::DecorationBuiltIn: target.builtIn = true; break;
+					case spv::DecorationBlock: target.block = true; break;
+					case spv::DecorationBufferBlock: target.bufferBlock = true; break;
+					case spv::DecorationArrayStride: target.arrayStride = value; break;
+					case spv::DecorationSpecId: target.specId = value; break;
+					default: break;
+					}
+				}
+				break;
+
+			case spv::OpMemberDecorate:
+				if (operandCount >= 4)
+				{
+					SpirvId& target = module.Get(operands[0]);
+					if (operands[2] == spv::DecorationOffset)
+						SetMember(target.memberOffsets, operands[1], operands[3]);
+					else if (operands[2] == spv::DecorationMatrixStride)
+						SetMember(target.memberMatrixStrides, operands[1], operands[3]);
+				}
+				break;
+
+			case spv::OpTypeBool:
+			case spv::OpTypeInt:
+			case spv::OpTypeFloat:
+			case spv::OpTypeVector:
+			case spv::OpTypeMatrix:
+			case spv::OpTypeImage:
+			case spv::OpTypeSampler:
+			case spv::OpTypeSampledImage:
+			case spv::OpTypeArray:
+			case spv::OpTypeRuntimeArray:
+			case spv::OpTypeStruct:
+			case spv::OpTypePointer:
+				if (operandCount >= 1)
+				{
+					SpirvId& type = module.Get(operands[0]);
+					type.opcode = opcode;
+					type.operands.assign(operands + 1, operands + operandCount);
+				}
+				break;
+
+			case spv::OpConstant:
+			case spv::OpSpecConstant:
+				//array lengths, a specialization constant counts with its default value
+				if (operandCount >= 3)
+				{
+					SpirvId& constant = module.Get(operands[1]);
+					constant.opcode = opcode;
+					constant.constant = operands[2];
+					if (operandCount >= 4)
+						constant.constant |= (uint64_t)operands[3] << 32;
+					if (opcode == spv::OpSpecConstant)
+						module.specConstants.push_back(operands[1]);
+				}
+				break;
+
+			case spv::OpSpecConstantTrue:
+			case spv::OpSpecConstantFalse:
+				if (operandCount >= 2)
+				{
+					SpirvId& constant = module.Get(operands[1]);
+					constant.opcode = opcode;
+					constant.constant = (opcode == spv::OpSpecConstantTrue) ? 1 : 0;
+					module.specConstants.push_back(operands[1]);
+				}
+				break;
+
+			case spv::OpVariable:
+				if (operandCount >= 3)
+				{
+					SpirvId& variable = module.Get(operands[1]);
+					variable.opcode = opcode;
+					variable.operands.assign(1, operands[0]);
+					variable.storageClass = operands[2];
+					module.variables.push_back(operands[1]);
+				}
+				break;
+
+			default:
+				break;
+			}
+
+			word += length;
+		}
+
+		if (!entryPointFound)
+		{
+			throw std::runtime_error("SPIR-V module has no entry point");
+		}
+
+		for (uint32_t variableId : module.variables)
+		{
+			SpirvId& variable = module.Get(variableId);
+			uint32_t pointerType = variable.operands[0];
+			if (module.Get(pointerType).opcode != spv::OpTypePointer)
+			{
+				throw std::runtime_error("SPIR-V variable is not a pointer");
+			}
+			uint32_t typeId = module.Operand(pointerType, 1);
+
+			switch (variable.storageClass)
+			{
+			case spv::StorageClassUniformConstant:
+			case spv::StorageClassUniform:
+			case spv::StorageClassStorageBuffer:
+			{
+				if (variable.set == ~0u || variable.binding == ~0u)
+					break;
+
+				//arrays of descriptors
+				uint32_t count = 1;
+				for (uint32_t depth = 0; module.Get(typeId).opcode == spv::OpTypeArray || module.Get(typeId).opcode == spv::OpTypeRuntimeArray; ++depth)
+				{
+					if (depth == MaxTypeNesting)
+					{
+						throw std::runtime_error("recursive SPIR-V type");
+					}
+					if (module.Get(typeId).opcode == spv::OpTypeRuntimeArray)
+						count = 0;
+					else
+						count *= static_cast<uint32_t>(module.Get(module.Operand(typeId, 1)).constant);
+					typeId = module.Operand(typeId, 0);
+				}
+
+				VkDescriptorType type = DescriptorType(module, typeId, variable.storageClass);
+				if (type != VK_DESCRIPTOR_TYPE_MAX_ENUM)
+				{
+					reflection.bindings.push_back({ variable.set, variable.binding, type, count });
+				}
+				break;
+			}
+
+			case spv::StorageClassPushConstant:
+			{
+				SpirvId& block = module.Get(typeId);
+				uint32_t offset = block.memberOffsets.empty() ? 0 : *std::min_element(block.memberOffsets.begin(), block.memberOffsets.end());
+				uint32_t size = TypeSize(module, typeId, 0, 0);
+				if (size > offset)
+				{
+					VkPushConstantRange range{};
+					range.stageFlags = reflection.stage;
+					range.offset = offset;
+					range.size = size - offset;
+					reflection.pushConstants.push_back(range);
+				}
+				break;
+			}
+
+			case spv::StorageClassInput:
+				if (reflection.stage == VK_SHADER_STAGE_VERTEX_BIT && !variable.builtIn && variable.location != ~0u)
+				{
+					reflection.inputs.push_back({ variable.location, InputFormat(module, typeId) });
+				}
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		std::sort(reflection.bindings.begin(), reflection.bindings.end(),
+			[](const ReflectedBinding& a, const ReflectedBinding& b) { return a.set != b.set ? a.set < b.set : a.binding < b.binding; });
+		std::sort(reflection.inputs.begin(), reflection.inputs.end(),
+			[](const ReflectedInput& a, const ReflectedInput& b) { return a.location < b.location; });
+
+		//constants without a SpecId are only derived from other specialization constants
+		for (uint32_t constantId : module.specConstants)
+		{
+			uint32_t specId = module.Get(constantId).specId;
+			if (specId != ~0u)
+			{
+				reflection.specConstants.push_back(specId);
+			}
+		}
+		std::sort(reflection.specConstants.begin(), reflection.specConstants.end());
+		reflection.specConstants.erase(std::unique(reflection.specConstants.begin(), reflection.specConstants.end()), reflection.specConstants.end());
+		return reflection;
+	}
 
-		if (!file.is_open())
+	void ReflectedLayout::Add(const ShaderReflection& reflection)
+	{
+		for (const ReflectedBinding& reflected : reflection.bindings)
 		{
-			throw std::runtime_error("FAILED TO OPEN FILE");
+			if (reflected.set >= sets.size())
+			{
+				sets.resize(reflected.set + 1);
+			}
+
+			std::vector<VkDescriptorSetLayoutBinding>& set = sets[reflected.set];
+			auto existing = std::find_if(set.begin(), set.end(), [&](const VkDescriptorSetLayoutBinding& b) { return b.binding == reflected.binding; });
+			if (existing == set.end())
+			{
+				VkDescriptorSetLayoutBinding binding{};
+				binding.binding = reflected.binding;
+				binding.descriptorType = reflected.type;
+				binding.descriptorCount = reflected.count;
+				binding.stageFlags = reflection.stage;
+				set.insert(std::upper_bound(set.begin(), set.end(), binding,
+					[](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; }), binding);
+				continue;
+			}
+
+			if (existing->descriptorType != reflected.type)
+			{
+				throw std::runtime_error("shaders disagree on the type of a descriptor binding");
+			}
+			existing->descriptorCount = std::max(existing->descriptorCount, reflected.count);
+			existing->stageFlags |= reflection.stage;
 		}
 
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> buffer(fileSize);
+		for (const VkPushConstantRange& reflected : reflection.pushConstants)
+		{
+			auto existing = std::find_if(pushConstants.begin(), pushConstants.end(),
+				[&](const VkPushConstantRange& r) { return r.offset == reflected.offset && r.size == reflected.size; });
+			if (existing != pushConstants.end())
+			{
+				existing->stageFlags |= reflected.stageFlags;
+			}
+			else
+			{
+				pushConstants.push_back(reflected);
+			}
+		}
+	}
 
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
+	void ReflectedLayout::SetDescriptorType(uint32_t set, uint32_t binding, VkDescriptorType type)
+	{
+		if (set < sets.size())
+		{
+			for (VkDescriptorSetLayoutBinding& existing : sets[set])
+			{
+				if (existing.binding == binding)
+				{
+					existing.descriptorType = type;
+					return;
+				}
+			}
+		}
+		throw std::runtime_error("no shader declares the descriptor binding");
+	}
+
+	static VkDescriptorType PlainDescriptorType(VkDescriptorType type)
+	{
+		if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC)
+			return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
+			return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		return type;
+	}
 
-		file.close();
+	bool ReflectedLayout::Covers(const ShaderReflection& reflection) const
+	{
+		for (const ReflectedBinding& reflected : reflection.bindings)
+		{
+			if (reflected.set >= sets.size())
+				return false;
 
-		return buffer;
+			const std::vector<VkDescriptorSetLayoutBinding>& set = sets[reflected.set];
+			auto existing = std::find_if(set.begin(), set.end(), [&](const VkDescriptorSetLayoutBinding& b) { return b.binding == reflected.binding; });
+			if (existing == set.end() || !(existing->stageFlags & reflection.stage) || existing->descriptorCount < reflected.count)
+				return false;
+			if (PlainDescriptorType(existing->descriptorType) != PlainDescriptorType(reflected.type))
+				return false;
+		}
+
+		for (const VkPushConstantRange& reflected : reflection.pushConstants)
+		{
+			auto existing = std::find_if(pushConstants.begin(), pushConstants.end(), [&](const VkPushConstantRange& r)
+				{
+					return r.offset <= reflected.offset && reflected.offset + reflected.size <= r.offset + r.size &&
+						(r.stageFlags & reflected.stageFlags) == reflected.stageFlags;
+				});
+			if (existing == pushConstants.end())
+				return false;
+		}
+		return true;
+	}
+
+	VkDescriptorSetLayout ReflectedLayout::CreateSetLayout(VkDevice device, uint32_t set) const
+	{
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = set < sets.size() ? static_cast<uint32_t>(sets[set].size()) : 0;
+		layoutInfo.pBindings = layoutInfo.bindingCount ? sets[set].data() : nullptr;
+
+		VkDescriptorSetLayout setLayout;
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Descriptor Set Layout!");
+		}
+		return setLayout;
 	}
 
-	Shader::Shader(const std::string& filename, VkDevice& device)
+	VkPipelineLayout ReflectedLayout::CreatePipelineLayout(VkDevice device, const std::vector<VkDescriptorSetLayout>& setLayouts) const
 	{
-		m_shaderCode = readFile(filename);
-		m_device = device;
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+		pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstants.size());
+		pipelineLayoutInfo.pPushConstantRanges = pushConstants.data();
+
+		VkPipelineLayout pipelineLayout;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+		return pipelineLayout;
+	}
 
-		VkShaderModuleCreateInfo createInfo;
+	Shader::Shader(VkDevice device, const std::string& filename, const uint32_t* code, size_t wordCount, uint64_t hash)
+		: m_device(device), m_filename(filename), m_hash(hash)
+	{
+		m_reflection = ReflectSpirv(code, wordCount);
 
+		VkShaderModuleCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = m_shaderCode.size();
-		createInfo.pCode = reinterpret_cast <const uint32_t*>(m_shaderCode.data());
+		createInfo.codeSize = wordCount * sizeof(uint32_t);
+		createInfo.pCode = code;
 
-		if (vkCreateShaderModule(device, &createInfo, nullptr, &m_module) != VK_SUCCESS) 
+		if (vkCreateShaderModule(device, &createInfo, nullptr, &m_module) != VK_SUCCESS)
 		{
 			throw std::runtime_error(" Failed to Create ShaderModule!");
 		}
 	}
 
-	Shader::~Shader() 
+	Shader::~Shader()
 	{
 		vkDestroyShaderModule(m_device, m_module, nullptr);
 	}
 
-}
\ No newline at end of file
+	MappedFile ShaderLibrary::MapSpirv(const std::string& filename)
+	{
+		MappedFile file(filename);
+		if (file.GetSize() == 0 || file.GetSize() % sizeof(uint32_t) != 0)
+		{
+			throw std::runtime_error(filename + " is not a SPIR-V module");
+		}
+		return file;
+	}
+
+	const Shader& ShaderLibrary::Load(const std::string& filename)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_requests;
+			auto found = m_byName.find(filename);
+			if (found != m_byName.end())
+			{
+				return *found->second;
+			}
+		}
+
+		return LoadFile(filename);
+	}
+
+	bool ShaderLibrary::Reload(const std::string& filename)
+	{
+		const Shader* previous = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto found = m_byName.find(filename);
+			if (found != m_byName.end())
+			{
+				previous = found->second;
+			}
+		}
+
+		return &LoadFile(filename) != previous;
+	}
+
+	const Shader& ShaderLibrary::LoadFile(const std::string& filename)
+	{
+		//mapping and hashing happen outside the lock, jobs load different shaders at the same time.
+		//the driver copies the code, so the mapping is released once the module exists
+		MappedFile file = MapSpirv(filename);
+		const uint32_t* code = static_cast<const uint32_t*>(file.GetData());
+		size_t wordCount = file.GetSize() / sizeof(uint32_t);
+
+		StateHasher hasher;
+		hasher.Add(code, file.GetSize());
+		uint64_t hash = hasher.Get();
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_fileLoads;
+
+		std::unique_ptr<Shader>& shader = m_byHash[hash];
+		if (!shader)
+		{
+			try
+			{
+				shader = std::make_unique<Shader>(m_device, filename, code, wordCount, hash);
+			}
+			catch (...)
+			{
+				m_byHash.erase(hash);
+				throw;
+			}
+		}
+
+		m_byName[filename] = shader.get();
+		return *shader;
+	}
+
+	uint32_t ShaderLibrary::GetModuleCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return static_cast<uint32_t>(m_byHash.size());
+	}
+
+	uint64_t ShaderLibrary::GetRequestCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_requests;
+	}
+
+	uint64_t ShaderLibrary::GetFileLoadCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_fileLoads;
+	}
+}
@@ -1,23 +1,116 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vulkan/vulkan.h>
+#include "MappedFile.h"
 
-namespace Graphics 
+namespace Graphics
 {
+	struct ReflectedBinding
+	{
+		uint32_t set;
+		uint32_t binding;
+		VkDescriptorType type;
+		uint32_t count;		//0 for runtime sized arrays
+	};
+
+	struct ReflectedInput
+	{
+		uint32_t location;
+		VkFormat format;	//32 bit format of the shader side type, packed vertex formats come from the VertexLayout
+	};
+
+	//what a SPIR-V module declares, read straight from the binary without a device
+	struct ShaderReflection
+	{
+		VkShaderStageFlagBits stage = VK_SHADER_STAGE_ALL;
+		std::string entryPoint;
+		std::vector<ReflectedBinding> bindings;
+		std::vector<VkPushConstantRange> pushConstants;
+		std::vector<ReflectedInput> inputs;		//vertex shaders only
+		uint32_t localSize[3] = { 1, 1, 1 };	//compute shaders only
+		std::vector<uint32_t> specConstants;	//ids of the specialization constants the module declares, sorted
+	};
+
+	//throws std::runtime_error on anything that is not well formed SPIR-V
+	ShaderReflection ReflectSpirv(const uint32_t* code, size_t wordCount);
+
+	//descriptor set layouts and push constant ranges for the union of several shaders
+	struct ReflectedLayout
+	{
+		std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets;
+		std::vector<VkPushConstantRange> pushConstants;
+
+		//throws when the shader declares a binding with a different type than an earlier one
+		void Add(const ShaderReflection& reflection);
+
+		//reflection can not tell a dynamic buffer from a plain one, the engine says which ones are
+		void SetDescriptorType(uint32_t set, uint32_t binding, VkDescriptorType type);
+
+		//true when a pipeline with this layout can use the shader, dynamic buffers match their plain type
+		bool Covers(const ShaderReflection& reflection) const;
+
+		VkDescriptorSetLayout CreateSetLayout(VkDevice device, uint32_t set) const;
+		VkPipelineLayout CreatePipelineLayout(VkDevice device, const std::vector<VkDescriptorSetLayout>& setLayouts) const;
+	};
 
-	class Shader 
+	//a loaded SPIR-V module, identified by the hash of its contents
+	class Shader
 	{
 	private:
-		VkShaderModule m_module;
 		VkDevice m_device;
-		std::vector<char> m_shaderCode;
-
-	public: 
+		VkShaderModule m_module = VK_NULL_HANDLE;
+		std::string m_filename;
+		uint64_t m_hash;
+		ShaderReflection m_reflection;
 
+	public:
+		Shader(VkDevice device, const std::string& filename, const uint32_t* code, size_t wordCount, uint64_t hash);
 		~Shader();
 
+		Shader(const Shader&) = delete;
+		Shader& operator=(const Shader&) = delete;
+
 		inline VkShaderModule GetModule() const { return m_module; }
-		Shader(const std::string& filename, VkDevice& device);
+		inline const std::string& GetFilename() const { return m_filename; }
+		inline uint64_t GetHash() const { return m_hash; }
+		inline const ShaderReflection& GetReflection() const { return m_reflection; }
+	};
+
+	//Every shader module the engine uses. Files with identical contents share one module, and a file is only read
+	//the first time it is asked for. Shaders live as long as the library. Thread safe.
+	class ShaderLibrary
+	{
+	private:
+		VkDevice m_device;
+		mutable std::mutex m_mutex;
+		std::unordered_map<std::string, Shader*> m_byName;
+		std::unordered_map<uint64_t, std::unique_ptr<Shader>> m_byHash;
+		uint64_t m_requests = 0;
+		uint64_t m_fileLoads = 0;
+
+		const Shader& LoadFile(const std::string& filename);
+
+	public:
+		explicit ShaderLibrary(VkDevice device) : m_device(device) {}
+
+		ShaderLibrary(const ShaderLibrary&) = delete;
+		ShaderLibrary& operator=(const ShaderLibrary&) = delete;
+
+		//throws unless the file could hold SPIR-V words
+		static MappedFile MapSpirv(const std::string& filename);
+
+		const Shader& Load(const std::string& filename);
+
+		//reads the file again and points its name at the new contents, true when they changed. The previous
+		//module stays alive since pipelines may still be built from it.
+		bool Reload(const std::string& filename);
+
+		uint32_t GetModuleCount() const;
+		uint64_t GetRequestCount() const;
+		uint64_t GetFileLoadCount() const;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,266 @@
+#include "UnitTests.h"
+#include "Shader.h"
+#include <spirv-headers/spirv.hpp>
+#include <initializer_list>
+
+namespace Graphics
+{
+	//assembles a SPIR-V module word by word, ids are whatever the test hands in
+	class SpirvWriter
+	{
+	private:
+		std::vector<uint32_t> m_words;
+
+	public:
+		explicit SpirvWriter(uint32_t idBound = 64)
+		{
+			m_words = { spv::MagicNumber, spv::Version, 0, idBound, 0 };
+		}
+
+		SpirvWriter& Op(spv::Op opcode, std::initializer_list<uint32_t> operands)
+		{
+			m_words.push_back(static_cast<uint32_t>(operands.size() + 1) << spv::WordCountShift | opcode);
+			m_words.insert(m_words.end(), operands);
+			return *this;
+		}
+
+		//"main" packed into words with its terminator
+		SpirvWriter& EntryPoint(spv::ExecutionModel model, uint32_t function)
+		{
+			return Op(spv::OpEntryPoint, { model, function, 0x6E69616D, 0 });
+		}
+
+		ShaderReflection Reflect() const
+		{
+			return ReflectSpirv(m_words.data(), m_words.size());
+		}
+
+		inline std::vector<uint32_t>& GetWords() { return m_words; }
+	};
+
+	static void TestComputeReflection(TestContext& context)
+	{
+		context.BeginTest("compute module reflection");
+
+		enum : uint32_t
+		{
+			Main = 1, Float, Vec4, Mat4, Uint, Three, PushBlock, PushPointer, PushVariable,
+			UniformBlock, UniformPointer, UniformVariable, Image, SampledImage, SamplerArray, SamplerPointer, Samplers,
+			RuntimeArray, StorageBlock, StoragePointer, StorageVariable, SpecConstant
+		};
+
+		SpirvWriter writer;
+		writer.EntryPoint(spv::ExecutionModelGLCompute, Main)
+			.Op(spv::OpExecutionMode, { Main, spv::ExecutionModeLocalSize, 8, 4, 1 })
+			.Op(spv::OpDecorate, { PushBlock, spv::DecorationBlock })
+			.Op(spv::OpMemberDecorate, { PushBlock, 0, spv::DecorationOffset, 16 })
+			.Op(spv::OpMemberDecorate, { PushBlock, 1, spv::DecorationOffset, 32 })
+			.Op(spv::OpMemberDecorate, { PushBlock, 1, spv::DecorationMatrixStride, 16 })
+			.Op(spv::OpDecorate, { UniformBlock, spv::DecorationBlock })
+			.Op(spv::OpDecorate, { UniformVariable, spv::DecorationDescriptorSet, 0 })
+			.Op(spv::OpDecorate, { UniformVariable, spv::DecorationBinding, 1 })
+			.Op(spv::OpDecorate, { Samplers, spv::DecorationDescriptorSet, 1 })
+			.Op(spv::OpDecorate, { Samplers, spv::DecorationBinding, 0 })
+			.Op(spv::OpDecorate, { RuntimeArray, spv::DecorationArrayStride, 4 })
+			.Op(spv::OpDecorate, { StorageBlock, spv::DecorationBlock })
+			.Op(spv::OpDecorate, { StorageVariable, spv::DecorationDescriptorSet, 0 })
+			.Op(spv::OpDecorate, { StorageVariable, spv::DecorationBinding, 3 })
+			.Op(spv::OpDecorate, { SpecConstant, spv::DecorationSpecId, 7 })
+			.Op(spv::OpTypeFloat, { Float, 32 })
+			.Op(spv::OpTypeVector, { Vec4, Float, 4 })
+			.Op(spv::OpTypeMatrix, { Mat4, Vec4, 4 })
+			.Op(spv::OpTypeInt, { Uint, 32, 0 })
+			.Op(spv::OpConstant, { Uint, Three, 3 })
+			.Op(spv::OpSpecConstant, { Uint, SpecConstant, 16 })
+			.Op(spv::OpTypeStruct, { PushBlock, Vec4, Mat4 })
+			.Op(spv::OpTypePointer, { PushPointer, spv::StorageClassPushConstant, PushBlock })
+			.Op(spv::OpVariable, { PushPointer, PushVariable, spv::StorageClassPushConstant })
+			.Op(spv::OpTypeStruct, { UniformBlock, Vec4 })
+			.Op(spv::OpTypePointer, { UniformPointer, spv::StorageClassUniform, UniformBlock })
+			.Op(spv::OpVariable, { UniformPointer, UniformVariable, spv::StorageClassUniform })
+			.Op(spv::OpTypeImage, { Image, Float, spv::Dim2D, 0, 0, 0, 1, spv::ImageFormatUnknown })
+			.Op(spv::OpTypeSampledImage, { SampledImage, Image })
+			.Op(spv::OpTypeArray, { SamplerArray, SampledImage, Three })
+			.Op(spv::OpTypePointer, { SamplerPointer, spv::StorageClassUniformConstant, SamplerArray })
+			.Op(spv::OpVariable, { SamplerPointer, Samplers, spv::StorageClassUniformConstant })
+			.Op(spv::OpTypeRuntimeArray, { RuntimeArray, Uint })
+			.Op(spv::OpTypeStruct, { StorageBlock, RuntimeArray })
+			.Op(spv::OpTypePointer, { StoragePointer, spv::StorageClassStorageBuffer, StorageBlock })
+			.Op(spv::OpVariable, { StoragePointer, StorageVariable, spv::StorageClassStorageBuffer });
+
+		ShaderReflection reflection = writer.Reflect();
+		VF_CHECK(context, reflection.stage == VK_SHADER_STAGE_COMPUTE_BIT);
+		VF_CHECK(context, reflection.entryPoint == "main");
+		VF_CHECK(context, reflection.localSize[0] == 8 && reflection.localSize[1] == 4 && reflection.localSize[2] == 1);
+
+		//sorted by set then binding
+		if (VF_CHECK(context, reflection.bindings.size() == 3))
+		{
+			VF_CHECK(context, reflection.bindings[0].set == 0 && reflection.bindings[0].binding == 1);
+			VF_CHECK(context, reflection.bindings[0].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER && reflection.bindings[0].count == 1);
+			VF_CHECK(context, reflection.bindings[1].set == 0 && reflection.bindings[1].binding == 3);
+			VF_CHECK(context, reflection.bindings[1].type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER && reflection.bindings[1].count == 1);
+			VF_CHECK(context, reflection.bindings[2].set == 1 && reflection.bindings[2].binding == 0);
+			VF_CHECK(context, reflection.bindings[2].type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER && reflection.bindings[2].count == 3);
+		}
+
+		//vec4 at 16 and a mat4 with a 16 byte stride at 32
+		if (VF_CHECK(context, reflection.pushConstants.size() == 1))
+		{
+			VF_CHECK(context, reflection.pushConstants[0].offset == 16);
+			VF_CHECK(context, reflection.pushConstants[0].size == 80);
+			VF_CHECK(context, reflection.pushConstants[0].stageFlags == VK_SHADER_STAGE_COMPUTE_BIT);
+		}
+
+		VF_CHECK(context, reflection.specConstants == std::vector<uint32_t>{ 7 });
+	}
+
+	static void TestVertexInputs(TestContext& context)
+	{
+		context.BeginTest("vertex input reflection");
+
+		enum : uint32_t { Main = 1, Float, Vec3, Int, Ivec2, Vec3Pointer, Ivec2Pointer, Position, Index, Builtin };
+
+		SpirvWriter writer;
+		writer.EntryPoint(spv::ExecutionModelVertex, Main)
+			.Op(spv::OpDecorate, { Position, spv::DecorationLocation, 2 })
+			.Op(spv::OpDecorate, { Index, spv::DecorationLocation, 0 })
+			.Op(spv::OpDecorate, { Builtin, spv::DecorationBuiltIn, spv::BuiltInVertexIndex })
+			.Op(spv::OpTypeFloat, { Float, 32 })
+			.Op(spv::OpTypeVector, { Vec3, Float, 3 })
+			.Op(spv::OpTypeInt, { Int, 32, 1 })
+			.Op(spv::OpTypeVector, { Ivec2, Int, 2 })
+			.Op(spv::OpTypePointer, { Vec3Pointer, spv::StorageClassInput, Vec3 })
+			.Op(spv::OpTypePointer, { Ivec2Pointer, spv::StorageClassInput, Ivec2 })
+			.Op(spv::OpVariable, { Vec3Pointer, Position, spv::StorageClassInput })
+			.Op(spv::OpVariable, { Ivec2Pointer, Index, spv::StorageClassInput })
+			.Op(spv::OpVariable, { Ivec2Pointer, Builtin, spv::StorageClassInput });
+
+		ShaderReflection reflection = writer.Reflect();
+		VF_CHECK(context, reflection.stage == VK_SHADER_STAGE_VERTEX_BIT);
+		if (VF_CHECK(context, reflection.inputs.size() == 2))
+		{
+			VF_CHECK(context, reflection.inputs[0].location == 0 && reflection.inputs[0].format == VK_FORMAT_R32G32_SINT);
+			VF_CHECK(context, reflection.inputs[1].location == 2 && reflection.inputs[1].format == VK_FORMAT_R32G32B32_SFLOAT);
+		}
+	}
+
+	static void TestMalformedModules(TestContext& context)
+	{
+		context.BeginTest("malformed modules throw");
+
+		enum : uint32_t { Main = 1, Array, Length, Pointer, Variable, Struct, Uint };
+
+		VF_CHECK_THROWS(context, ReflectSpirv(nullptr, 0));
+
+		SpirvWriter badMagic;
+		badMagic.EntryPoint(spv::ExecutionModelGLCompute, Main);
+		badMagic.GetWords()[0] = 0x12345678;
+		VF_CHECK_THROWS(context, badMagic.Reflect());
+
+		SpirvWriter hugeBound(0x400000);
+		hugeBound.EntryPoint(spv::ExecutionModelGLCompute, Main);
+		VF_CHECK_THROWS(context, hugeBound.Reflect());
+
+		SpirvWriter noEntryPoint;
+		noEntryPoint.Op(spv::OpTypeInt, { Uint, 32, 0 });
+		VF_CHECK_THROWS(context, noEntryPoint.Reflect());
+
+		//the instruction claims more words than the module has
+		SpirvWriter truncated;
+		truncated.EntryPoint(spv::ExecutionModelGLCompute, Main).Op(spv::OpTypeInt, { Uint, 32, 0 });
+		truncated.GetWords().pop_back();
+		VF_CHECK_THROWS(context, truncated.Reflect());
+
+		SpirvWriter zeroLength;
+		zeroLength.EntryPoint(spv::ExecutionModelGLCompute, Main);
+		zeroLength.GetWords().push_back(spv::OpNop);
+		VF_CHECK_THROWS(context, zeroLength.Reflect());
+
+		SpirvWriter idOutOfBounds(8);
+		idOutOfBounds.EntryPoint(spv::ExecutionModelGLCompute, Main).Op(spv::OpTypeInt, { 40, 32, 0 });
+		VF_CHECK_THROWS(context, idOutOfBounds.Reflect());
+
+		SpirvWriter memberOutOfBounds;
+		memberOutOfBounds.EntryPoint(spv::ExecutionModelGLCompute, Main).Op(spv::OpMemberDecorate, { Struct, 20000, spv::DecorationOffset, 0 });
+		VF_CHECK_THROWS(context, memberOutOfBounds.Reflect());
+
+		SpirvWriter notPointer;
+		notPointer.EntryPoint(spv::ExecutionModelGLCompute, Main)
+			.Op(spv::OpTypeInt, { Uint, 32, 0 })
+			.Op(spv::OpVariable, { Uint, Variable, spv::StorageClassUniform });
+		VF_CHECK_THROWS(context, notPointer.Reflect());
+
+		//an array of itself must not hang the descriptor array walk
+		SpirvWriter arrayCycle;
+		arrayCycle.EntryPoint(spv::ExecutionModelGLCompute, Main)
+			.Op(spv::OpDecorate, { Variable, spv::DecorationDescriptorSet, 0 })
+			.Op(spv::OpDecorate, { Variable, spv::DecorationBinding, 0 })
+			.Op(spv::OpTypeArray, { Array, Array, Length })
+			.Op(spv::OpTypePointer, { Pointer, spv::StorageClassUniform, Array })
+			.Op(spv::OpVariable, { Pointer, Variable, spv::StorageClassUniform });
+		VF_CHECK_THROWS(context, arrayCycle.Reflect());
+
+		//nor the push constant size
+		SpirvWriter pushArrayCycle;
+		pushArrayCycle.EntryPoint(spv::ExecutionModelGLCompute, Main)
+			.Op(spv::OpTypeArray, { Array, Array, Length })
+			.Op(spv::OpTypePointer, { Pointer, spv::StorageClassPushConstant, Array })
+			.Op(spv::OpVariable, { Pointer, Variable, spv::StorageClassPushConstant });
+		VF_CHECK_THROWS(context, pushArrayCycle.Reflect());
+
+		//a struct holding itself twice would take exponential time with a depth limit alone
+		SpirvWriter structCycle;
+		structCycle.EntryPoint(spv::ExecutionModelGLCompute, Main)
+			.Op(spv::OpTypeStruct, { Struct, Struct, Struct })
+			.Op(spv::OpTypePointer, { Pointer, spv::StorageClassPushConstant, Struct })
+			.Op(spv::OpVariable, { Pointer, Variable, spv::StorageClassPushConstant });
+		VF_CHECK_THROWS(context, structCycle.Reflect());
+	}
+
+	//a valid but deep chain of structs that each overlay two copies of the next one, sized once per type
+	static void TestSharedTypes(TestContext& context)
+	{
+		context.BeginTest("shared member types are sized once");
+
+		const uint32_t depth = 200;
+		enum : uint32_t { Main = 1, Uint, Pointer, Variable, FirstStruct };
+
+		SpirvWriter writer(FirstStruct + depth);
+		writer.EntryPoint(spv::ExecutionModelGLCompute, Main).Op(spv::OpTypeInt, { Uint, 32, 0 });
+		for (uint32_t i = 0; i < depth; ++i)
+		{
+			uint32_t member = i == 0 ? Uint : FirstStruct + i - 1;
+			writer.Op(spv::OpMemberDecorate, { FirstStruct + i, 0, spv::DecorationOffset, 0 })
+				.Op(spv::OpMemberDecorate, { FirstStruct + i, 1, spv::DecorationOffset, 0 })
+				.Op(spv::OpTypeStruct, { FirstStruct + i, member, member });
+		}
+		writer.Op(spv::OpTypePointer, { Pointer, spv::StorageClassPushConstant, FirstStruct + depth - 1 })
+			.Op(spv::OpVariable, { Pointer, Variable, spv::StorageClassPushConstant });
+
+		ShaderReflection reflection = writer.Reflect();
+		if (VF_CHECK(context, reflection.pushConstants.size() == 1))
+		{
+			VF_CHECK(context, reflection.pushConstants[0].size == 4);
+		}
+
+		//past the nesting limit
+		SpirvWriter tooDeep(FirstStruct + 300);
+		tooDeep.EntryPoint(spv::ExecutionModelGLCompute, Main).Op(spv::OpTypeInt, { Uint, 32, 0 });
+		for (uint32_t i = 0; i < 300; ++i)
+		{
+			tooDeep.Op(spv::OpTypeStruct, { FirstStruct + i, i == 0 ? Uint : FirstStruct + i - 1 });
+		}
+		tooDeep.Op(spv::OpTypePointer, { Pointer, spv::StorageClassPushConstant, FirstStruct + 299 })
+			.Op(spv::OpVariable, { Pointer, Variable, spv::StorageClassPushConstant });
+		VF_CHECK_THROWS(context, tooDeep.Reflect());
+	}
+
+	void RunShaderTests(TestContext& context)
+	{
+		TestComputeReflection(context);
+		TestVertexInputs(context);
+		TestMalformedModules(context);
+		TestSharedTypes(context);
+	}
+}
@@ -0,0 +1,304 @@
+#include "ShaderWatcher.h"
+#include "MappedFile.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace Graphics
+{
+	static std::string ReadEnvironment(const char* name)
+	{
+#ifdef _WIN32
+		char* value = nullptr;
+		size_t length = 0;
+		if (_dupenv_s(&value, &length, name) != 0 || value == nullptr)
+			return std::string();
+
+		std::string result(value);
+		free(value);
+		return result;
+#else
+		const char* value = std::getenv(name);
+		return value ? std::string(value) : std::string();
+#endif
+	}
+
+	ShaderWatcher::ShaderWatcher(const std::string& directory, const ShaderSource* sources, size_t sourceCount, const std::string& compiler)
+		: m_directory(directory), m_sources(sources, sources + sourceCount), m_compiler(compiler), m_includes(sourceCount)
+	{
+		for (size_t i = 0; i < m_sources.size(); ++i)
+		{
+			ScanIncludes(i);
+		}
+
+#ifdef __linux__
+		m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_inotify >= 0 && inotify_add_watch(m_inotify, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			close(m_inotify);
+			m_inotify = -1;
+		}
+#endif
+
+		//the current times are the baseline, nothing is compiled until a file is saved again
+		if (!UsesInotify())
+		{
+			for (size_t i = 0; i < m_sources.size(); ++i)
+			{
+				TrackWriteTime(m_sources[i].source);
+				for (const std::string& include : m_includes[i])
+				{
+					TrackWriteTime(include);
+				}
+			}
+		}
+
+		m_thread = std::thread(&ShaderWatcher::Run, this);
+	}
+
+	ShaderWatcher::~ShaderWatcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		m_thread.join();
+
+#ifdef __linux__
+		if (m_inotify >= 0)
+		{
+			close(m_inotify);
+		}
+#endif
+	}
+
+	std::vector<std::string> ShaderWatcher::TakeCompiled()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<std::string> compiled;
+		compiled.swap(m_compiled);
+		return compiled;
+	}
+
+	std::string ShaderWatcher::FindCompiler()
+	{
+#ifdef _WIN32
+		const char* executable = "glslc.exe";
+#else
+		const char* executable = "glslc";
+#endif
+		std::error_code error;
+		std::string sdk = ReadEnvironment("VULKAN_SDK");
+		if (!sdk.empty())
+		{
+			//Bin on Windows, bin in the Linux SDK
+			for (const char* bin : { "Bin", "bin" })
+			{
+				std::filesystem::path path = std::filesystem::path(sdk) / bin / executable;
+				if (std::filesystem::exists(path, error))
+					return path.string();
+			}
+		}
+
+		std::filesystem::path bundled = std::filesystem::path("..") / ".." / "1.2.148.1" / "Bin32" / executable;
+		if (std::filesystem::exists(bundled, error))
+			return bundled.string();
+
+		return executable;
+	}
+
+	void ShaderWatcher::Run()
+	{
+		std::vector<std::string> changed;
+		while (!m_stop)
+		{
+			changed.clear();
+			if (UsesInotify())
+			{
+				WaitForInotify(changed);
+			}
+			else
+			{
+				Poll(changed);
+			}
+
+			if (!changed.empty() && !m_stop)
+			{
+				Compile(changed);
+			}
+		}
+	}
+
+	void ShaderWatcher::WaitForInotify(std::vector<std::string>& changed)
+	{
+#ifdef __linux__
+		//the timeout is only there to notice the watcher stopping
+		pollfd descriptor{ m_inotify, POLLIN, 0 };
+		if (poll(&descriptor, 1, 100) <= 0)
+			return;
+
+		//editors save in bursts, so everything arriving shortly after the first event is taken along
+		alignas(inotify_event) char buffer[4096];
+		do
+		{
+			ssize_t length;
+			while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0)
+			{
+				for (char* event = buffer; event < buffer + length;)
+				{
+					const inotify_event* info = reinterpret_cast<const inotify_event*>(event);
+					if (info->len > 0)
+					{
+						changed.push_back(info->name);
+					}
+					event += sizeof(inotify_event) + info->len;
+				}
+			}
+		} while (poll(&descriptor, 1, 50) > 0);
+#endif
+	}
+
+	void ShaderWatcher::Poll(std::vector<std::string>& changed)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait_for(lock, std::chrono::milliseconds(250), [this] { return m_stop.load(); });
+		}
+
+		for (auto& tracked : m_writeTimes)
+		{
+			std::error_code error;
+			std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(m_directory + "/" + tracked.first, error);
+			if (!error && writeTime != tracked.second)
+			{
+				tracked.second = writeTime;
+				changed.push_back(tracked.first);
+			}
+		}
+	}
+
+	void ShaderWatcher::Compile(const std::vector<std::string>& changed)
+	{
+		for (size_t i = 0; i < m_sources.size(); ++i)
+		{
+			const std::vector<std::string>& includes = m_includes[i];
+			bool dirty = false;
+			for (const std::string& file : changed)
+			{
+				dirty |= file == m_sources[i].source || std::find(includes.begin(), includes.end(), file) != includes.end();
+			}
+			if (!dirty)
+				continue;
+
+			std::string source = m_directory + "/" + m_sources[i].source;
+			std::string output = m_directory + "/" + m_sources[i].output;
+			std::string temporary = output + ".tmp";
+
+			std::string command = "\"" + m_compiler + "\" \"" + source + "\" -o \"" + temporary + "\"";
+#ifdef _WIN32
+			//cmd drops the first and last quote of the line
+			command = "\"" + command + "\"";
+#endif
+
+			//compiler errors go straight to the console
+			FrameClock::time_point start = FrameClock::now();
+			std::error_code error;
+			if (std::system(command.c_str()) != 0)
+			{
+				std::cerr << "shader reload: " << m_sources[i].source << " failed to compile\n";
+				std::filesystem::remove(temporary, error);
+				continue;
+			}
+
+			std::filesystem::rename(temporary, output, error);
+			if (error)
+			{
+				std::cerr << "shader reload: failed to replace " << output << ": " << error.message() << "\n";
+				continue;
+			}
+
+			std::cout << "shader reload: compiled " << m_sources[i].source << " in " << ElapsedMicroseconds(start, FrameClock::now()) / 1000.0 << " ms\n";
+
+			//the edit may have added includes
+			ScanIncludes(i);
+			if (!UsesInotify())
+			{
+				for (const std::string& include : m_includes[i])
+				{
+					TrackWriteTime(include);
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (std::find(m_compiled.begin(), m_compiled.end(), output) == m_compiled.end())
+			{
+				m_compiled.push_back(output);
+			}
+		}
+	}
+
+	//#include "file" lines, followed through the included files
+	void ShaderWatcher::ScanIncludes(size_t source)
+	{
+		std::vector<std::string>& includes = m_includes[source];
+		includes.clear();
+
+		std::vector<std::string> pending = { m_sources[source].source };
+		while (!pending.empty())
+		{
+			std::string filename = m_directory + "/" + pending.back();
+			pending.pop_back();
+
+			MappedFile file;
+			try
+			{
+				file = MappedFile(filename);
+			}
+			catch (const std::runtime_error&)
+			{
+				//the compiler reports missing includes
+				continue;
+			}
+
+			const char* cursor = file.GetChars();
+			const char* fileEnd = cursor + file.GetSize();
+			while (cursor < fileEnd)
+			{
+				const char* lineEnd = std::find(cursor, fileEnd, '\n');
+				std::string line(cursor, lineEnd);
+				cursor = (lineEnd == fileEnd) ? fileEnd : lineEnd + 1;
+
+				size_t directive = line.find("#include");
+				size_t open = (directive == std::string::npos) ? std::string::npos : line.find('"', directive);
+				size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+				if (close == std::string::npos)
+					continue;
+
+				std::string include = line.substr(open + 1, close - open - 1);
+				if (std::find(includes.begin(), includes.end(), include) == includes.end())
+				{
+					includes.push_back(include);
+					pending.push_back(include);
+				}
+			}
+		}
+	}
+
+	void ShaderWatcher::TrackWriteTime(const std::string& file)
+	{
+		if (m_writeTimes.count(file))
+			return;
+
+		std::error_code error;
+		m_writeTimes[file] = std::filesystem::last_write_time(m_directory + "/" + file, error);
+	}
+}
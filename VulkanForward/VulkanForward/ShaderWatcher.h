@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+
+namespace Graphics
+{
+	//a GLSL file and the SPIR-V file it compiles to, both relative to the watched directory
+	struct ShaderSource
+	{
+		const char* source;
+		const char* output;
+	};
+
+	//Watches a shader directory and recompiles a source when it, or a file it includes, is saved. Saves are seen through
+	//inotify on Linux, and by polling modification times on other platforms or when inotify is not available.
+	//Compiling runs on the watcher's own thread, the new SPIR-V replaces the old file with one rename so a reader
+	//never sees half of it. Picking up the result is left to the render thread through TakeCompiled.
+	class ShaderWatcher
+	{
+	private:
+		std::string m_directory;
+		std::vector<ShaderSource> m_sources;
+		std::string m_compiler;
+		std::vector<std::vector<std::string>> m_includes;		//per source, every file it includes directly or not
+		std::unordered_map<std::string, std::filesystem::file_time_type> m_writeTimes;		//polling only
+		int m_inotify = -1;
+
+		std::thread m_thread;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::atomic<bool> m_stop{ false };
+		std::vector<std::string> m_compiled;
+
+		void Run();
+		void WaitForInotify(std::vector<std::string>& changed);
+		void Poll(std::vector<std::string>& changed);
+		void Compile(const std::vector<std::string>& changed);
+		void ScanIncludes(size_t source);
+		void TrackWriteTime(const std::string& file);
+
+	public:
+		//starts watching right away, sources are only compiled once they change
+		ShaderWatcher(const std::string& directory, const ShaderSource* sources, size_t sourceCount, const std::string& compiler);
+		~ShaderWatcher();
+
+		ShaderWatcher(const ShaderWatcher&) = delete;
+		ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+		//SPIR-V files rebuilt since the last call, as directory/output
+		std::vector<std::string> TakeCompiled();
+
+		inline bool UsesInotify() const { return m_inotify >= 0; }
+
+		//glslc from $VULKAN_SDK, then from the SDK next to the repository like CompileShaders.bat, then from the PATH
+		static std::string FindCompiler();
+	};
+}
@@ -1,3 +1,8 @@
 %~dp0..\..\..\1.2.148.1\Bin32\glslc.exe vShader.vert -o vert.spv
 %~dp0..\..\..\1.2.148.1\Bin32\glslc.exe pShader.frag -o frag.spv
+%~dp0..\..\..\1.2.148.1\Bin32\glslc.exe lightCulling.comp -o lightCulling.spv
+%~dp0..\..\..\1.2.148.1\Bin32\glslc.exe clusterBounds.comp -o clusterBounds.spv
+%~dp0..\..\..\1.2.148.1\Bin32\glslc.exe clusterAssign.comp -o clusterAssign.spv
+%~dp0..\..\..\1.2.148.1\Bin32\glslc.exe hizDownsample.comp -o hizDownsample.spv
+%~dp0..\..\..\1.2.148.1\Bin32\glslc.exe occlusionCull.comp -o occlusionCull.spv
 pause
\ No newline at end of file
@@ -0,0 +1,93 @@
+// shared declarations for the forward+ shaders, keep in sync with LightCulling.h, LightClustering.h and VulkanProject.h
+
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_COUNT (CLUSTER_COUNT_X * CLUSTER_COUNT_Y * CLUSTER_COUNT_Z)
+
+// levels of the min/max depth pyramid, HiZMaxLevels in VulkanProject.h
+#define HIZ_MAX_LEVELS 12
+
+#define LIGHT_CULLING_TILED 0
+#define LIGHT_CULLING_CLUSTERED 1
+
+// specialization constants, the engine sets them from LightCulling.h so the defaults only matter to tools.
+// ids are the *ConstantId values there
+layout(constant_id = 0) const uint LIGHT_CULLING_MODE = LIGHT_CULLING_TILED;
+layout(constant_id = 1) const uint TILE_SIZE = 16;
+layout(constant_id = 2) const uint MAX_LIGHTS_PER_TILE = 256;
+layout(constant_id = 3) const uint MAX_LIGHTS_PER_CLUSTER = 256;
+
+struct Light
+{
+    vec3 position;
+    float radius;
+    vec3 color;
+    float intensity;
+    vec3 direction;
+    float spotCosOuter;
+};
+
+layout(set = 0, binding = 0) uniform CameraData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 inverseProjection;
+    vec4 position;
+    vec2 screenSize;
+    float nearPlane;
+    float farPlane;
+    uint lightCount;
+    uint tileCountX;
+    uint tileCountY;
+} camera;
+
+layout(std430, set = 0, binding = 1) readonly buffer LightBuffer
+{
+    Light lights[];
+};
+
+struct ClusterAABB
+{
+    vec4 minPoint;
+    vec4 maxPoint;
+};
+
+uint GetClusterIndex(uvec3 cluster)
+{
+    return (cluster.z * CLUSTER_COUNT_Y + cluster.y) * CLUSTER_COUNT_X + cluster.x;
+}
+
+float GetClusterSliceDepth(uint slice)
+{
+    return camera.nearPlane * pow(camera.farPlane / camera.nearPlane, float(slice) / float(CLUSTER_COUNT_Z));
+}
+
+vec3 ShadeLight(Light light, vec3 position, vec3 normal)
+{
+    vec3 toLight = light.position - position;
+    float distance = length(toLight);
+    if (distance >= light.radius)
+        return vec3(0.0);
+
+    vec3 lightDir = toLight / distance;
+    float falloff = 1.0 - distance / light.radius;
+    falloff *= falloff;
+
+    float spot = 1.0;
+    if (light.spotCosOuter > -1.0)
+    {
+        spot = smoothstep(light.spotCosOuter, mix(light.spotCosOuter, 1.0, 0.2), dot(-lightDir, light.direction));
+    }
+
+    return light.color * light.intensity * max(dot(normal, lightDir), 0.0) * falloff * spot;
+}
+
+// inverse of OctEncodeNormal in Mesh.cpp, the input is the snorm16 pair already in [-1, 1]
+vec3 OctDecode(vec2 octant)
+{
+    vec3 n = vec3(octant, 1.0 - abs(octant.x) - abs(octant.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
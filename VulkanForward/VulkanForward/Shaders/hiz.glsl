@@ -0,0 +1,42 @@
+// min/max depth pyramid built by hizDownsample.comp from the depth pre-pass, include after common.glsl.
+// level 0 texels cover 2x2 screen pixels and every level above doubles that, x holds the nearest depth and y the farthest
+
+// set when the pyramid is built, so the light culler can bound its tiles and clusters by the depth actually on screen.
+// the id is HiZDepthBoundsConstantId in LightCulling.h
+layout(constant_id = 5) const bool HIZ_DEPTH_BOUNDS = false;
+
+layout(set = 0, binding = 7) uniform sampler2D hiZ;
+
+// nearest and farthest depth buffer value over the screen rectangle [pixelMin, pixelMax), from at most 2x2 texels
+vec2 HiZBounds(vec2 pixelMin, vec2 pixelMax)
+{
+    vec2 span = max(pixelMax - pixelMin, vec2(1.0));
+    int level = max(int(ceil(log2(max(span.x, span.y)))) - 1, 0);
+    if (level >= textureQueryLevels(hiZ))
+        return vec2(0.0, 1.0);
+
+    // the rectangle is at most one texel wide, so it touches two texels per axis at most
+    ivec2 lastTexel = textureSize(hiZ, level) - 1;
+    float texelSize = exp2(float(level + 1));
+    ivec2 texelMin = clamp(ivec2(floor(pixelMin / texelSize)), ivec2(0), lastTexel);
+    ivec2 texelMax = clamp(ivec2(floor(pixelMax / texelSize)), texelMin, lastTexel);
+
+    vec2 a = texelFetch(hiZ, texelMin, level).xy;
+    vec2 b = texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).xy;
+    vec2 c = texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).xy;
+    vec2 d = texelFetch(hiZ, texelMax, level).xy;
+    return vec2(min(min(a.x, b.x), min(c.x, d.x)), max(max(a.y, b.y), max(c.y, d.y)));
+}
+
+float ViewDepth(float depth)
+{
+    vec4 view = camera.inverseProjection * vec4(0.0, 0.0, depth, 1.0);
+    return -view.z / view.w;
+}
+
+// HiZBounds as view space distances, widened a little so depth buffer precision never drops a surface
+vec2 HiZViewDepthBounds(vec2 pixelMin, vec2 pixelMax)
+{
+    vec2 bounds = HiZBounds(pixelMin, pixelMax);
+    return vec2(ViewDepth(bounds.x) * 0.99, ViewDepth(bounds.y) * 1.01);
+}
@@ -1,10 +1,77 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
+
+// depth is tested before shading, so fragments hidden by the pre-pass never run and never reach the counter
+layout(early_fragment_tests) in;
+
+// set when the engine measures overdraw, the id is CountOverdrawConstantId in VulkanProject.h
+layout(constant_id = 4) const bool COUNT_OVERDRAW = false;
 
 layout(location = 0) in vec3 fragColor;
+layout(location = 1) in vec3 fragWorldPosition;
+layout(location = 2) in vec3 fragNormal;
 
 layout(location = 0) out vec4 outColor;
 
+// per tile or per cluster lists, depending on LIGHT_CULLING_MODE
+layout(std430, set = 0, binding = 2) readonly buffer LightGridCounts
+{
+    uint lightGridCounts[];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer LightGridIndices
+{
+    uint lightGridIndices[];
+};
+
+layout(std430, set = 0, binding = 5) buffer OverdrawCounter
+{
+    uint shadedFragments;
+    uint visibleDraws;     // written by occlusionCull.comp
+};
+
+uint GetTileIndex()
+{
+    uvec2 tile = uvec2(gl_FragCoord.xy) / TILE_SIZE;
+    return tile.y * camera.tileCountX + tile.x;
+}
+
+uint GetFragmentClusterIndex()
+{
+    float viewDepth = -(camera.view * vec4(fragWorldPosition, 1.0)).z;
+    float slice = log(viewDepth / camera.nearPlane) / log(camera.farPlane / camera.nearPlane) * float(CLUSTER_COUNT_Z);
+
+    uvec3 cluster;
+    cluster.xy = uvec2(gl_FragCoord.xy / camera.screenSize * vec2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y));
+    cluster.z = uint(max(slice, 0.0));
+    cluster = min(cluster, uvec3(CLUSTER_COUNT_X - 1, CLUSTER_COUNT_Y - 1, CLUSTER_COUNT_Z - 1));
+
+    return GetClusterIndex(cluster);
+}
+
 void main() {
-    outColor = vec4(fragColor, 1.0);
-}
\ No newline at end of file
+    if (COUNT_OVERDRAW)
+    {
+        atomicAdd(shadedFragments, 1);
+    }
+
+    // specialization constants, the driver folds the branch away
+    bool clustered = LIGHT_CULLING_MODE == LIGHT_CULLING_CLUSTERED;
+    uint gridIndex = clustered ? GetFragmentClusterIndex() : GetTileIndex();
+    uint listSize = clustered ? MAX_LIGHTS_PER_CLUSTER : MAX_LIGHTS_PER_TILE;
+    uint lightCount = lightGridCounts[gridIndex];
+
+    vec3 normal = normalize(fragNormal);
+    vec3 lighting = vec3(0.03);
+
+    for (uint i = 0; i < lightCount; ++i)
+    {
+        uint lightIndex = lightGridIndices[gridIndex * listSize + i];
+        lighting += ShadeLight(lights[lightIndex], fragWorldPosition, normal);
+    }
+
+    outColor = vec4(fragColor * lighting, 1.0);
+}
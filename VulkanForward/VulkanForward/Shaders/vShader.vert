@@ -1,21 +1,40 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
 
-layout(location = 0) out vec3 fragColor;
+#include "common.glsl"
+
+// PackedVertex in Mesh.h
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec2 inNormal;
+layout(location = 2) in vec2 inUV;
+
+// DrawData in VulkanProject.h, one per draw item. Every draw passes its item's index as the first instance,
+// so the same lookup works for direct draws and for the ones occlusionCull.comp compacts
+struct DrawData
+{
+    mat4 model;
+    vec4 color;
+};
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(std430, set = 0, binding = 12) readonly buffer DrawDataBuffer
+{
+    DrawData drawData[];
+};
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec3 fragWorldPosition;
+layout(location = 2) out vec3 fragNormal;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+// the depth pre-pass and the forward pass must produce bit identical depth for the EQUAL test
+invariant gl_Position;
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+    DrawData draw = drawData[gl_InstanceIndex];
+    vec4 worldPosition = draw.model * vec4(inPosition, 1.0);
+    gl_Position = camera.projection * camera.view * worldPosition;
+    fragColor = draw.color.rgb;
+    fragWorldPosition = worldPosition.xyz;
+    // models are only translated and uniformly scaled, so the model matrix transforms normals as well
+    fragNormal = mat3(draw.model) * OctDecode(inNormal);
+}
@@ -0,0 +1,59 @@
+#include "Trace.h"
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+
+namespace Graphics
+{
+	static void WriteJsonString(std::ostream& out, const char* text)
+	{
+		out << '"';
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				out << '\\';
+			}
+			out << *c;
+		}
+		out << '"';
+	}
+
+	bool WriteChromeTrace(const std::string& filename, const std::vector<TraceEvent>& events, const std::vector<std::string>& trackNames)
+	{
+		std::ofstream file(filename, std::ios::trunc);
+		if (!file)
+			return false;
+
+		double origin = std::numeric_limits<double>::max();
+		for (const TraceEvent& event : events)
+		{
+			origin = std::min(origin, event.beginMicroseconds);
+		}
+
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+		//metadata events name the rows
+		bool first = true;
+		for (size_t track = 0; track < trackNames.size(); ++track)
+		{
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":";
+			WriteJsonString(file, trackNames[track].c_str());
+			file << "}}";
+			first = false;
+		}
+
+		for (const TraceEvent& event : events)
+		{
+			file << (first ? "" : ",\n") << "{\"name\":";
+			WriteJsonString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track << ",\"ts\":" << event.beginMicroseconds - origin << ",\"dur\":" << event.durationMicroseconds << "}";
+			first = false;
+		}
+
+		file << "\n]}\n";
+		return file.good();
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "FrameStats.h"
+
+namespace Graphics
+{
+	//one complete event of a Chrome trace (chrome://tracing, ui.perfetto.dev). GPU and CPU events share the
+	//FrameClock timeline, so both show up on one time axis.
+	struct TraceEvent
+	{
+		const char* name;		//string literal, events only keep the pointer
+		double beginMicroseconds;
+		double durationMicroseconds;
+		uint32_t track;			//index into the track names, one row in the viewer
+	};
+
+	inline double ToTraceMicroseconds(FrameClock::time_point time)
+	{
+		return std::chrono::duration<double, std::micro>(time.time_since_epoch()).count();
+	}
+
+	//Chrome trace JSON, times relative to the earliest event. False when the file can not be written.
+	bool WriteChromeTrace(const std::string& filename, const std::vector<TraceEvent>& events, const std::vector<std::string>& trackNames);
+}
@@ -0,0 +1,34 @@
+#include "UnitTests.h"
+
+namespace Graphics
+{
+	void TestContext::BeginTest(const char* name)
+	{
+		m_test = name;
+		++m_testCount;
+	}
+
+	bool TestContext::Check(bool condition, const char* expression, const char* file, int line)
+	{
+		++m_checkCount;
+		if (!condition)
+		{
+			++m_failureCount;
+			m_out << "FAILED " << m_test << ": " << expression << " (" << file << ":" << line << ")\n";
+		}
+		return condition;
+	}
+
+	uint32_t RunUnitTests(std::ostream& out)
+	{
+		TestContext context(out);
+		RunImageFileTests(context);
+		RunLightClusteringTests(context);
+		RunMemoryAllocatorTests(context);
+		RunMeshTests(context);
+		RunShaderTests(context);
+
+		out << context.GetTestCount() << " tests, " << context.GetCheckCount() << " checks, " << context.GetFailureCount() << " failed\n";
+		return context.GetFailureCount();
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <ostream>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Graphics
+{
+	//Counts checks and reports the failing ones with their test, file and line. Tests keep going after a failure.
+	class TestContext
+	{
+	private:
+		std::ostream& m_out;
+		const char* m_test = "";
+		uint32_t m_testCount = 0;
+		uint32_t m_checkCount = 0;
+		uint32_t m_failureCount = 0;
+
+	public:
+		explicit TestContext(std::ostream& out) : m_out(out) {}
+
+		void BeginTest(const char* name);
+		bool Check(bool condition, const char* expression, const char* file, int line);
+
+		inline uint32_t GetTestCount() const { return m_testCount; }
+		inline uint32_t GetCheckCount() const { return m_checkCount; }
+		inline uint32_t GetFailureCount() const { return m_failureCount; }
+	};
+
+#define VF_CHECK(context, condition) (context).Check((condition), #condition, __FILE__, __LINE__)
+
+	//passes when the statement throws std::runtime_error, anything else thrown is a failure as well
+#define VF_CHECK_THROWS(context, statement) \
+	do \
+	{ \
+		bool thrown = false; \
+		try { statement; } \
+		catch (const std::runtime_error&) { thrown = true; } \
+		catch (...) {} \
+		(context).Check(thrown, #statement " throws std::runtime_error", __FILE__, __LINE__); \
+	} while (false)
+
+	//one function per area, each in <Area>Tests.cpp next to the code it covers
+	void RunImageFileTests(TestContext& context);
+	void RunLightClusteringTests(TestContext& context);
+	void RunMemoryAllocatorTests(TestContext& context);
+	void RunMeshTests(TestContext& context);
+	void RunShaderTests(TestContext& context);
+
+	//CPU only tests of the engine's device independent code, the device is faked where one is needed.
+	//run with --unit-tests, returns the number of failed checks
+	uint32_t RunUnitTests(std::ostream& out);
+}
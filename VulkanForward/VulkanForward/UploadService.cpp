@@ -0,0 +1,469 @@
+#include "UploadService.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Graphics
+{
+	//satisfies vkCmdCopyBufferToImage's offset rule for every format up to 16 byte texels
+	static const VkDeviceSize StagingAlignment = 16;
+
+	static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	UploadService::UploadService(VkDevice device, DeviceMemoryAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, VkDeviceSize stagingSize)
+		: m_device(device), m_allocator(allocator)
+	{
+		m_transferQueue = transferQueue;
+		m_transferFamily = transferFamily;
+		m_graphicsFamily = graphicsFamily;
+		m_stagingSize = AlignUp(stagingSize, StagingAlignment);
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = m_stagingSize;
+		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &m_stagingBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_device, m_stagingBuffer, &memRequirements);
+		m_stagingAllocation = m_allocator.Allocate(memRequirements, MemoryUsage::CpuToGpu, ResourceKind::Linear);
+		vkBindBufferMemory(m_device, m_stagingBuffer, m_stagingAllocation.memory, m_stagingAllocation.offset);
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = m_transferFamily;
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+		if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Command Pool!");
+		}
+
+		VkSemaphoreTypeCreateInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		timelineInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &timelineInfo;
+
+		if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_timeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Semaphore Creation Failed");
+		}
+	}
+
+	UploadService::~UploadService()
+	{
+		if (m_lastSubmittedValue > 0)
+		{
+			Wait(m_lastSubmittedValue);
+		}
+
+		vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+		vkDestroySemaphore(m_device, m_timeline, nullptr);
+		vkDestroyBuffer(m_device, m_stagingBuffer, nullptr);
+		m_allocator.Free(m_stagingAllocation);
+	}
+
+	uint64_t UploadService::GetCompletedValue() const
+	{
+		uint64_t value = 0;
+		vkGetSemaphoreCounterValue(m_device, m_timeline, &value);
+		return value;
+	}
+
+	//hands back the staging space and command buffers of finished batches
+	void UploadService::Reclaim()
+	{
+		if (m_inFlight.empty())
+			return;
+
+		uint64_t completed = GetCompletedValue();
+		while (!m_inFlight.empty() && m_inFlight.front().value <= completed)
+		{
+			m_stagingTail = m_inFlight.front().stagingEnd;
+			m_freeCommandBuffers.push_back(m_inFlight.front().commandBuffer);
+			m_inFlight.pop_front();
+		}
+	}
+
+	//contiguous range of the staging ring, flushes the open batch or waits on the oldest one when the ring is full
+	VkDeviceSize UploadService::AllocateStaging(VkDeviceSize size)
+	{
+		size = AlignUp(size, StagingAlignment);
+		if (size > m_stagingSize)
+		{
+			throw std::runtime_error("Upload does not fit in the staging buffer!");
+		}
+
+		for (;;)
+		{
+			Reclaim();
+
+			//ranges never wrap, the end of the ring is skipped instead
+			VkDeviceSize position = m_stagingHead % m_stagingSize;
+			VkDeviceSize skip = (position + size > m_stagingSize) ? m_stagingSize - position : 0;
+			if (m_stagingHead + skip + size - m_stagingTail <= m_stagingSize)
+			{
+				m_stagingHead += skip;
+				VkDeviceSize offset = m_stagingHead % m_stagingSize;
+				m_stagingHead += size;
+				return offset;
+			}
+
+			if (!m_bufferCopies.empty() || !m_imageCopies.empty())
+			{
+				FlushLocked();
+			}
+			else if (!m_inFlight.empty())
+			{
+				Wait(m_inFlight.front().value);
+			}
+			else
+			{
+				//the ring is empty, restart it at the beginning
+				m_stagingHead = AlignUp(m_stagingHead, m_stagingSize);
+				m_stagingTail = m_stagingHead;
+			}
+		}
+	}
+
+	void UploadService::AddDestination(const Destination& destination)
+	{
+		for (Destination& existing : m_destinations)
+		{
+			bool sameBuffer = destination.buffer != VK_NULL_HANDLE && existing.buffer == destination.buffer &&
+				existing.offset == destination.offset && existing.size == destination.size;
+			bool sameImage = destination.image != VK_NULL_HANDLE && existing.image == destination.image &&
+				existing.range.baseMipLevel == destination.range.baseMipLevel && existing.range.baseArrayLayer == destination.range.baseArrayLayer;
+
+			if (sameBuffer || sameImage)
+			{
+				existing.dstStage |= destination.dstStage;
+				existing.dstAccess |= destination.dstAccess;
+				return;
+			}
+		}
+
+		m_destinations.push_back(destination);
+	}
+
+	uint64_t UploadService::UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		//large uploads go in pieces so they cannot starve the ring
+		const VkDeviceSize maxPiece = m_stagingSize / 4;
+		const char* source = static_cast<const char*>(data);
+		m_uploadedBytes += size;
+
+		Destination destination{};
+		destination.buffer = buffer;
+		destination.offset = offset;
+		destination.size = size;
+		destination.dstStage = dstStage;
+		destination.dstAccess = dstAccess;
+
+		while (size > 0)
+		{
+			VkDeviceSize piece = std::min(size, maxPiece);
+			VkDeviceSize stagingOffset = AllocateStaging(piece);
+
+			memcpy(static_cast<char*>(m_stagingAllocation.mapped) + stagingOffset, source, (size_t)piece);
+			m_allocator.Flush(m_stagingAllocation, stagingOffset, piece);
+
+			m_bufferCopies.push_back({ buffer, { stagingOffset, offset, piece } });
+			++m_copyCount;
+
+			source += piece;
+			offset += piece;
+			size -= piece;
+		}
+
+		//added after the copies, a flush in the middle must not release the range before its last piece is written
+		AddDestination(destination);
+
+		return m_nextValue;
+	}
+
+	uint64_t UploadService::UploadImage(VkImage image, const VkImageSubresourceLayers& subresource, VkExtent3D extent, const void* data, VkDeviceSize size,
+		VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		VkDeviceSize stagingOffset = AllocateStaging(size);
+		memcpy(static_cast<char*>(m_stagingAllocation.mapped) + stagingOffset, data, (size_t)size);
+		m_allocator.Flush(m_stagingAllocation, stagingOffset, size);
+
+		VkBufferImageCopy region{};
+		region.bufferOffset = stagingOffset;
+		region.imageSubresource = subresource;
+		region.imageExtent = extent;
+
+		m_imageCopies.push_back({ image, region });
+		++m_copyCount;
+		m_uploadedBytes += size;
+
+		Destination destination{};
+		destination.image = image;
+		destination.range = { subresource.aspectMask, subresource.mipLevel, 1, subresource.baseArrayLayer, subresource.layerCount };
+		destination.finalLayout = finalLayout;
+		destination.dstStage = dstStage;
+		destination.dstAccess = dstAccess;
+		AddDestination(destination);
+
+		return m_nextValue;
+	}
+
+	uint64_t UploadService::Flush()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return FlushLocked();
+	}
+
+	uint64_t UploadService::FlushLocked()
+	{
+		if (m_bufferCopies.empty() && m_imageCopies.empty())
+			return m_lastSubmittedValue;
+
+		VkCommandBuffer commandBuffer;
+		if (!m_freeCommandBuffers.empty())
+		{
+			commandBuffer = m_freeCommandBuffers.back();
+			m_freeCommandBuffers.pop_back();
+		}
+		else
+		{
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = m_commandPool;
+			allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			allocInfo.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Allocate Command Buffers!");
+			}
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to begin recording command  buffer");
+		}
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		for (const Destination& destination : m_destinations)
+		{
+			if (destination.image == VK_NULL_HANDLE)
+				continue;
+
+			VkImageMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.image = destination.image;
+			barrier.subresourceRange = destination.range;
+			imageBarriers.push_back(barrier);
+		}
+
+		if (!imageBarriers.empty())
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+				0, nullptr, 0, nullptr, (uint32_t)imageBarriers.size(), imageBarriers.data());
+		}
+
+		//one copy command per destination buffer with all of its regions
+		std::stable_sort(m_bufferCopies.begin(), m_bufferCopies.end(), [](const BufferCopy& a, const BufferCopy& b) { return a.buffer < b.buffer; });
+
+		std::vector<VkBufferCopy> regions;
+		for (size_t first = 0; first < m_bufferCopies.size();)
+		{
+			size_t last = first;
+			regions.clear();
+			while (last < m_bufferCopies.size() && m_bufferCopies[last].buffer == m_bufferCopies[first].buffer)
+			{
+				regions.push_back(m_bufferCopies[last].region);
+				++last;
+			}
+
+			vkCmdCopyBuffer(commandBuffer, m_stagingBuffer, m_bufferCopies[first].buffer, (uint32_t)regions.size(), regions.data());
+			first = last;
+		}
+
+		for (const ImageCopy& copy : m_imageCopies)
+		{
+			vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+		}
+
+		//release to the graphics family, images also move to their final layout here. Without a family change this is
+		//only the layout transition, the timeline wait on the graphics queue makes the writes visible.
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		imageBarriers.clear();
+		uint32_t srcFamily = OwnershipTransfer() ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+		uint32_t dstFamily = OwnershipTransfer() ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+
+		for (const Destination& destination : m_destinations)
+		{
+			if (destination.image != VK_NULL_HANDLE)
+			{
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = destination.finalLayout;
+				barrier.srcQueueFamilyIndex = srcFamily;
+				barrier.dstQueueFamilyIndex = dstFamily;
+				barrier.image = destination.image;
+				barrier.subresourceRange = destination.range;
+				imageBarriers.push_back(barrier);
+			}
+			else if (OwnershipTransfer())
+			{
+				VkBufferMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				barrier.srcQueueFamilyIndex = srcFamily;
+				barrier.dstQueueFamilyIndex = dstFamily;
+				barrier.buffer = destination.buffer;
+				barrier.offset = destination.offset;
+				barrier.size = destination.size;
+				bufferBarriers.push_back(barrier);
+			}
+		}
+
+		if (!bufferBarriers.empty() || !imageBarriers.empty())
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+				(uint32_t)bufferBarriers.size(), bufferBarriers.data(), (uint32_t)imageBarriers.size(), imageBarriers.data());
+		}
+
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Record Command Buffer!");
+		}
+
+		uint64_t value = m_nextValue;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &value;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &m_timeline;
+
+		if (vkQueueSubmit(m_transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to submit upload Command buffer");
+		}
+
+		m_inFlight.push_back({ value, m_stagingHead, commandBuffer });
+		m_pendingAcquires.insert(m_pendingAcquires.end(), m_destinations.begin(), m_destinations.end());
+		m_bufferCopies.clear();
+		m_imageCopies.clear();
+		m_destinations.clear();
+
+		m_lastSubmittedValue = value;
+		++m_nextValue;
+		++m_batchCount;
+		return value;
+	}
+
+	bool UploadService::IsComplete(uint64_t value) const
+	{
+		return GetCompletedValue() >= value;
+	}
+
+	void UploadService::Wait(uint64_t value)
+	{
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &m_timeline;
+		waitInfo.pValues = &value;
+
+		vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX);
+	}
+
+	uint64_t UploadService::RecordAcquireBarriers(VkCommandBuffer commandBuffer, VkPipelineStageFlags& waitStages)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		waitStages = 0;
+		if (m_pendingAcquires.empty())
+			return 0;
+
+		std::vector<VkBufferMemoryBarrier> bufferBarriers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+
+		for (const Destination& destination : m_pendingAcquires)
+		{
+			waitStages |= destination.dstStage;
+			if (!OwnershipTransfer())
+				continue;
+
+			//must match the release in FlushLocked
+			if (destination.image != VK_NULL_HANDLE)
+			{
+				VkImageMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = destination.dstAccess;
+				barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				barrier.newLayout = destination.finalLayout;
+				barrier.srcQueueFamilyIndex = m_transferFamily;
+				barrier.dstQueueFamilyIndex = m_graphicsFamily;
+				barrier.image = destination.image;
+				barrier.subresourceRange = destination.range;
+				imageBarriers.push_back(barrier);
+			}
+			else
+			{
+				VkBufferMemoryBarrier barrier{};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = destination.dstAccess;
+				barrier.srcQueueFamilyIndex = m_transferFamily;
+				barrier.dstQueueFamilyIndex = m_graphicsFamily;
+				barrier.buffer = destination.buffer;
+				barrier.offset = destination.offset;
+				barrier.size = destination.size;
+				bufferBarriers.push_back(barrier);
+			}
+		}
+
+		if (!bufferBarriers.empty() || !imageBarriers.empty())
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, waitStages, 0, 0, nullptr,
+				(uint32_t)bufferBarriers.size(), bufferBarriers.data(), (uint32_t)imageBarriers.size(), imageBarriers.data());
+		}
+
+		m_pendingAcquires.clear();
+		return m_lastSubmittedValue;
+	}
+}
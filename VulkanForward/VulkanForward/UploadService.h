@@ -0,0 +1,122 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <vulkan/vulkan.h>
+#include "MemoryAllocator.h"
+
+namespace Graphics
+{
+	//Streams buffer and image data to the GPU on the transfer queue. Uploads are copied into a staging ring right away
+	//and recorded as copy regions; Flush turns everything queued since the last flush into one submission that signals
+	//a timeline semaphore. When the transfer queue is its own family, every batch releases ownership of its destinations
+	//and the graphics queue acquires them in RecordAcquireBarriers before first use. Destinations must not be in use
+	//by the GPU while they are uploaded to. Thread safe.
+	class UploadService
+	{
+	public:
+		static const VkDeviceSize DefaultStagingSize = 32ull * 1024 * 1024;
+
+	private:
+		struct BufferCopy
+		{
+			VkBuffer buffer;
+			VkBufferCopy region;
+		};
+
+		struct ImageCopy
+		{
+			VkImage image;
+			VkBufferImageCopy region;
+		};
+
+		//ownership moves per buffer range, so uploads into a buffer the graphics queue is already using are fine
+		struct Destination
+		{
+			VkBuffer buffer;
+			VkDeviceSize offset;
+			VkDeviceSize size;
+			VkImage image;
+			VkImageSubresourceRange range;
+			VkImageLayout finalLayout;
+			VkPipelineStageFlags dstStage;
+			VkAccessFlags dstAccess;
+		};
+
+		struct Batch
+		{
+			uint64_t value;
+			uint64_t stagingEnd;
+			VkCommandBuffer commandBuffer;
+		};
+
+		VkDevice m_device;
+		DeviceMemoryAllocator& m_allocator;
+		VkQueue m_transferQueue;
+		uint32_t m_transferFamily;
+		uint32_t m_graphicsFamily;
+
+		VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+		Allocation m_stagingAllocation;
+		VkDeviceSize m_stagingSize;
+		uint64_t m_stagingHead = 0;		//bytes ever written, position is modulo m_stagingSize
+		uint64_t m_stagingTail = 0;		//start of the oldest range the GPU may still read
+
+		VkCommandPool m_commandPool = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> m_freeCommandBuffers;
+		VkSemaphore m_timeline = VK_NULL_HANDLE;
+		uint64_t m_nextValue = 1;		//value the open batch will signal
+
+		std::mutex m_mutex;
+		std::vector<BufferCopy> m_bufferCopies;
+		std::vector<ImageCopy> m_imageCopies;
+		std::vector<Destination> m_destinations;
+		std::deque<Batch> m_inFlight;
+
+		//destinations of submitted batches the graphics queue has not acquired yet
+		std::vector<Destination> m_pendingAcquires;
+		uint64_t m_lastSubmittedValue = 0;
+
+		uint64_t m_batchCount = 0;
+		uint64_t m_copyCount = 0;
+		uint64_t m_uploadedBytes = 0;
+
+		inline bool OwnershipTransfer() const { return m_transferFamily != m_graphicsFamily; }
+
+		uint64_t GetCompletedValue() const;
+		void Reclaim();
+		VkDeviceSize AllocateStaging(VkDeviceSize size);
+		void AddDestination(const Destination& destination);
+		uint64_t FlushLocked();
+
+	public:
+		UploadService(VkDevice device, DeviceMemoryAllocator& allocator, VkQueue transferQueue, uint32_t transferFamily, uint32_t graphicsFamily, VkDeviceSize stagingSize = DefaultStagingSize);
+		~UploadService();
+
+		UploadService(const UploadService&) = delete;
+		UploadService& operator=(const UploadService&) = delete;
+
+		//each returns the timeline value that signals when the data is in place. dstStage/dstAccess describe the
+		//first use on the graphics queue.
+		uint64_t UploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		//whole mip level or layer range of an image, left in finalLayout
+		uint64_t UploadImage(VkImage image, const VkImageSubresourceLayers& subresource, VkExtent3D extent, const void* data, VkDeviceSize size,
+			VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+		//submits everything queued so far as one batch, returns its timeline value (or the last one when nothing was queued)
+		uint64_t Flush();
+
+		bool IsComplete(uint64_t value) const;
+		void Wait(uint64_t value);
+
+		//records the graphics side of the ownership transfer for every submitted batch. The command buffer's submission
+		//must wait on GetSemaphore() for the returned value (0 when there is nothing to wait for) at waitStages.
+		uint64_t RecordAcquireBarriers(VkCommandBuffer commandBuffer, VkPipelineStageFlags& waitStages);
+
+		inline VkSemaphore GetSemaphore() const { return m_timeline; }
+		inline uint64_t GetBatchCount() const { return m_batchCount; }
+		inline uint64_t GetCopyCount() const { return m_copyCount; }
+		inline uint64_t GetUploadedBytes() const { return m_uploadedBytes; }
+	};
+}
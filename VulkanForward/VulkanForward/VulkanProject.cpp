@@ -8,6 +8,15 @@
 
 
 #include "VulkanProject.h"
+#include "Benchmarks.h"
+#include "FrameBenchmark.h"
+#include "UnitTests.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <random>
+#include <iterator>
+#include <limits>
+#include <tuple>
+#include <algorithm>
 
 
 namespace Graphics
@@ -25,26 +34,6 @@ namespace Graphics
 		return VK_FALSE;
 	}
 
-	static std::vector<char> readFile(const std::string& filename)
-	{
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-		if (!file.is_open())
-		{
-			throw std::runtime_error("FAILED TO OPEN FILE");
-		}
-
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> buffer(fileSize);
-
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-
-		file.close();
-
-		return buffer;
-	}
-
 	//////////////////////////static helper space till here
 
 	//initialize GLFW
@@ -64,34 +53,86 @@ namespace Graphics
 	}
 
 	//initialize vulkan
-	bool VulkanProject::VP_InitVulkan()
+	bool VulkanProject::VP_InitVulkan(const RenderSettings& settings)
 	{
+		m_lightCullingMode = settings.lightCullingMode;
+		m_depthPrePass = settings.depthPrePass;
+		m_occlusionCulling = settings.occlusionCulling && settings.depthPrePass;
+		m_countOverdraw = settings.countOverdraw;
+		m_headless = settings.headless;
+		m_traceFile = settings.traceFile;
+		m_jobSystem = std::make_unique<JobSystem>(JobSystem::DefaultWorkerCount());
+
+		//nothing is presented, so a device without any window system support will do
+		if (m_headless)
+		{
+			m_deviceExtensions.clear();
+		}
+
 		CreateInstance();
 		SetupDebugMessenger();
-		CreateSurface();
+		if (!m_headless)
+		{
+			CreateSurface();
+		}
 		PickPhysicalDevice();
+		m_pipelineStatistics = settings.pipelineStatistics && m_instrumentation.pipelineStatistics;
+		if (settings.pipelineStatistics && !m_pipelineStatistics)
+		{
+			std::cout << "pipeline statistics: not supported by this device, the queries are off\n";
+		}
+		m_inheritedQueries = m_pipelineStatistics && m_instrumentation.inheritedQueries;
+		if (m_pipelineStatistics && !m_inheritedQueries)
+		{
+			std::cout << "pipeline statistics: no inherited queries on this device, draw passes are recorded inline\n";
+		}
 		CreateLogicalDevice();
-		CreateSwapChain();
+		CreatePipelineCache();
+		m_shaderLibrary = std::make_unique<ShaderLibrary>(m_logicalDevice);
+		CreateMemoryAllocator();
+		CreateUploadService();
+		if (m_headless)
+		{
+			CreateOffscreenTargets();
+		}
+		else
+		{
+			CreateSwapChain();
+		}
 		CreateImageViews();
+		CreateDepthResources();
+		CreateHiZResources();
 		CreateRenderPass();
-		CreateGraphicsPipeline();
+		CreateDepthRenderPass();
+		CreateDescriptorSetLayout();
+		CreatePipelineLayout();
+		CreatePipelines();
 		CreateFrameBuffer();
 		CreateCommandPools();
+		CreateLights();
+		CreateScene();
+		CreateDrawBuffers();
+		CreateLightBuffers();
+		CreateOverdrawCounter();
+		CreateDescriptorSets();
+		BuildClusterBounds();
 		CreateCommandBuffers();
 		CreateSyncObjects();
+		CreateGpuProfiler();
+		CreatePipelineStatisticsQueries();
 		return true;
 	}
 
 	//checks if all class members have been populated
 	bool VulkanProject::VP_CheckUP()
 	{
-		if (m_window == nullptr)
+		if (!m_headless && m_window == nullptr)
 			return false;
 		if (m_MainInstance == nullptr)
 			return false;
 		if (m_debugMessenger == nullptr)
 			return false;
-		if (m_surface == nullptr)
+		if (!m_headless && m_surface == nullptr)
 			return false;
 		if (m_physicalDevice == nullptr)
 			return false;
@@ -101,7 +142,7 @@ namespace Graphics
 			return false;
 		if (m_presentationQueue == nullptr)
 			return false;
-		if (m_swapChain == nullptr)
+		if (!m_headless && m_swapChain == nullptr)
 			return false;
 		if (m_pipelineLayout == VK_NULL_HANDLE) 
 			return false;
@@ -109,8 +150,14 @@ namespace Graphics
 			return false;
 		if (m_graphicsPipeline == VK_NULL_HANDLE)
 			return false;
+		if (m_depthPrePass && m_depthPipeline == VK_NULL_HANDLE)
+			return false;
 		if (m_commandPool == VK_NULL_HANDLE)
 			return false;
+		if (m_lightCullingPipeline == VK_NULL_HANDLE)
+			return false;
+		if (m_depthPrePass && m_hiZPipeline == VK_NULL_HANDLE)
+			return false;
 
 		return true;
 	}
@@ -125,16 +172,77 @@ namespace Graphics
 			vkDestroyFence(m_logicalDevice, inFlightFences[i], nullptr);
 		}
 			
+		m_parallelRecorder.reset();
+		m_gpuProfiler.reset();
+		m_statisticsQueries.reset();
+		m_pipelineRegistry.reset();
+		m_shaderLibrary.reset();
+		m_jobSystem.reset();
 		vkDestroyCommandPool(m_logicalDevice, m_commandPool, nullptr);
+		for (VkCommandPool pool : m_frameCommandPools)
+		{
+			vkDestroyCommandPool(m_logicalDevice, pool, nullptr);
+		}
+
+		vkDestroyDescriptorPool(m_logicalDevice, m_descriptorPool, nullptr);
+		m_frameUploadBuffer.reset();
+		m_meshPool.reset();
+		m_uploadService.reset();
+		vkDestroyBuffer(m_logicalDevice, m_lightGridCountBuffer, nullptr);
+		m_memoryAllocator->Free(m_lightGridCountBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_lightGridIndexBuffer, nullptr);
+		m_memoryAllocator->Free(m_lightGridIndexBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_lightGridCandidateBuffer, nullptr);
+		m_memoryAllocator->Free(m_lightGridCandidateBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_lightGridDepthRangeBuffer, nullptr);
+		m_memoryAllocator->Free(m_lightGridDepthRangeBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_clusterBoundsBuffer, nullptr);
+		m_memoryAllocator->Free(m_clusterBoundsBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_overdrawCounterBuffer, nullptr);
+		m_memoryAllocator->Free(m_overdrawCounterBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_overdrawReadbackBuffer, nullptr);
+		m_memoryAllocator->Free(m_overdrawReadbackBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_hiZCounterBuffer, nullptr);
+		m_memoryAllocator->Free(m_hiZCounterBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_drawDataBuffer, nullptr);
+		m_memoryAllocator->Free(m_drawDataBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_drawCullBuffer, nullptr);
+		m_memoryAllocator->Free(m_drawCullBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_drawCommandBuffer, nullptr);
+		m_memoryAllocator->Free(m_drawCommandBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_visibleDrawCommandBuffer, nullptr);
+		m_memoryAllocator->Free(m_visibleDrawCommandBufferAllocation);
+		vkDestroyBuffer(m_logicalDevice, m_visibleDrawCountBuffer, nullptr);
+		m_memoryAllocator->Free(m_visibleDrawCountBufferAllocation);
 
 		for (auto framebuff : m_swapChainFrameBuffers) 
 		{
 			vkDestroyFramebuffer(m_logicalDevice, framebuff, nullptr);
 		}
+		vkDestroyFramebuffer(m_logicalDevice, m_depthFrameBuffer, nullptr);
+		for (VkImageView view : m_hiZLevelViews)
+		{
+			vkDestroyImageView(m_logicalDevice, view, nullptr);
+		}
+		vkDestroyImageView(m_logicalDevice, m_hiZView, nullptr);
+		vkDestroyImage(m_logicalDevice, m_hiZImage, nullptr);
+		m_memoryAllocator->Free(m_hiZImageAllocation);
+		vkDestroySampler(m_logicalDevice, m_pointSampler, nullptr);
+		vkDestroyImageView(m_logicalDevice, m_depthSampleView, nullptr);
+		vkDestroyImageView(m_logicalDevice, m_depthImageView, nullptr);
+		vkDestroyImage(m_logicalDevice, m_depthImage, nullptr);
+		m_memoryAllocator->Free(m_depthImageAllocation);
+
+		if (!m_pipelineCache->Save())
+		{
+			std::cerr << "failed to write " << PipelineCacheFile << std::endl;
+		}
+		m_pipelineCache.reset();
 
-		vkDestroyPipeline(m_logicalDevice, m_graphicsPipeline, nullptr);
 		vkDestroyPipelineLayout(m_logicalDevice, m_pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(m_logicalDevice, m_descriptorSetLayout, nullptr);
 		vkDestroyRenderPass(m_logicalDevice, m_traingleRenderPass, nullptr);
+		vkDestroyRenderPass(m_logicalDevice, m_depthRenderPass, nullptr);
 
 		for (auto imageView : m_swapChainImageViews)
 		{
@@ -142,6 +250,13 @@ namespace Graphics
 		}
 
 		vkDestroySwapchainKHR(m_logicalDevice, m_swapChain, nullptr);
+		for (size_t i = 0; i < m_offscreenAllocations.size(); ++i)
+		{
+			vkDestroyImage(m_logicalDevice, m_swapChainImages[i], nullptr);
+			m_memoryAllocator->Free(m_offscreenAllocations[i]);
+		}
+		m_memoryAllocator.reset();
+		m_memoryBackend.reset();
 		vkDestroyDevice(m_logicalDevice, nullptr);
 
 		if (m_enableValidationLayers)
@@ -150,20 +265,162 @@ namespace Graphics
 		}
 		vkDestroySurfaceKHR(m_MainInstance, m_surface, nullptr);
 		vkDestroyInstance(m_MainInstance, nullptr);
-		glfwDestroyWindow(m_window);
-		glfwTerminate();
+		if (!m_headless)
+		{
+			glfwDestroyWindow(m_window);
+			glfwTerminate();
+		}
 	}
 
 	//main update for project
-	void VulkanProject::VP_Run()
+	void VulkanProject::VP_Run(uint32_t frameCount)
 	{
-		while (!glfwWindowShouldClose(m_window))
+		if (m_headless && frameCount == 0)
+			throw std::runtime_error("a headless run needs a frame count");
+
+		//a headless run renders what is on disk, nobody is there to edit shaders
+		if (!m_headless)
+		{
+			m_shaderWatcher = std::make_unique<ShaderWatcher>(ShaderDirectory, EngineShaderSources, std::size(EngineShaderSources), ShaderWatcher::FindCompiler());
+			std::cout << "shader hot reload: watching " << ShaderDirectory << (m_shaderWatcher->UsesInotify() ? " through inotify\n" : " by polling\n");
+		}
+
+		for (uint32_t frame = 0; frameCount == 0 || frame < frameCount; ++frame)
 		{
-			glfwPollEvents();
+			if (!m_headless)
+			{
+				glfwPollEvents();
+				if (glfwWindowShouldClose(m_window))
+					break;
+			}
 			DrawFrame();
 		}
 
+		m_shaderWatcher.reset();
+		vkDeviceWaitIdle(m_logicalDevice);
+
+		m_frameStats.Print(std::cout);
+		m_memoryAllocator->GetStats().Print(std::cout);
+		m_pipelineRegistry->GetStats().Print(std::cout);
+		if (m_gpuProfiler)
+		{
+			m_gpuProfiler->Print(std::cout);
+		}
+		m_instrumentation.Print(std::cout);
+		if (m_statisticsQueries)
+		{
+			m_statisticsQueries->Print(std::cout, (uint64_t)m_swapChainExtent.width * m_swapChainExtent.height);
+		}
+		std::cout << "shaders: " << m_shaderLibrary->GetModuleCount() << " modules from " << m_shaderLibrary->GetFileLoadCount() << " file loads, " << m_shaderLibrary->GetRequestCount() << " requests\n";
+		std::cout << "frame upload high water mark: " << m_frameUploadBuffer->GetHighWaterMark() / 1024 << " / " << m_frameUploadBuffer->GetFrameSize() / 1024 << " KiB\n";
+		if (m_countOverdraw)
+		{
+			std::cout << "depth pre-pass " << (m_depthPrePass ? "on" : "off") << ", occlusion culling " << (m_occlusionCulling ? "on\n" : "off\n");
+			m_overdrawStats.Print(std::cout, (uint64_t)m_swapChainExtent.width * m_swapChainExtent.height, m_occlusionCulling ? m_culledDrawCount : 0);
+		}
+
+		//GPU scopes on track 0, a track per CPU thread after it. The job workers are idle once the device is.
+		if (!m_traceFile.empty())
+		{
+			std::vector<TraceEvent> events;
+			std::vector<std::string> trackNames = { "GPU" };
+			if (m_gpuProfiler)
+			{
+				events = m_gpuProfiler->GetTraceEvents();
+			}
+			CpuTrace::Collect(events, trackNames);
+
+			if (WriteChromeTrace(m_traceFile, events, trackNames))
+			{
+				std::cout << "trace: " << events.size() << " events written to " << m_traceFile << "\n";
+			}
+			else
+			{
+				std::cerr << "failed to write " << m_traceFile << std::endl;
+			}
+		}
+	}
+
+	void VulkanProject::VP_RenderFrame()
+	{
+		DrawFrame();
+	}
+
+	//CPU cost of recording a frame as the draw count grows, single threaded vs secondary buffers on all cores.
+	//nothing is submitted, frame slot 0 is reused for every iteration.
+	void VulkanProject::VP_RunRecordingBenchmark()
+	{
+		const uint32_t drawCounts[] = { 256, 1024, 4096, 16384, 65536, 262144 };
+		const uint32_t iterations = 20;
+
+		vkDeviceWaitIdle(m_logicalDevice);
+		std::vector<DrawItem> sceneDraws = m_drawItems;
+		bool parallelRecording = m_parallelRecording;
+
+		//measures draws recorded one by one, the GPU submitted path records a call per bucket whatever the count
+		bool occlusionCulling = m_occlusionCulling;
+		m_occlusionCulling = false;
+
+		std::cout << "recording benchmark, " << m_parallelRecorder->GetSliceCount() << " slices\n";
+		std::cout << "draws\tsingle ms\tparallel ms\tspeedup\n";
+
+		for (uint32_t drawCount : drawCounts)
+		{
+			m_drawItems.resize(drawCount);
+			for (uint32_t i = 0; i < drawCount; ++i)
+			{
+				m_drawItems[i] = sceneDraws[i % sceneDraws.size()];
+			}
+			double milliseconds[2] = {};
+
+			for (int parallel = 0; parallel < 2; ++parallel)
+			{
+				m_parallelRecording = (parallel == 1);
+				FrameClock::time_point start = FrameClock::now();
+
+				for (uint32_t i = 0; i < iterations; ++i)
+				{
+					vkResetCommandPool(m_logicalDevice, m_frameCommandPools[0], 0);
+					RecordCommandBuffer(m_frameCommandBuffers[0], 0, 0);
+				}
+
+				milliseconds[parallel] = ElapsedMicroseconds(start, FrameClock::now()) / 1000.0 / iterations;
+			}
+
+			std::cout << drawCount << "\t" << milliseconds[0] << "\t" << milliseconds[1] << "\t" << milliseconds[0] / milliseconds[1] << "x\n";
+		}
+
+		m_drawItems = sceneDraws;
+		m_parallelRecording = parallelRecording;
+		m_occlusionCulling = occlusionCulling;
+	}
+
+	//permutations of the forward pipeline's render state in both light culling modes, built at 1..N threads
+	void VulkanProject::VP_RunPipelineBenchmark()
+	{
+		const VkCullModeFlags cullModes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_AND_BACK };
+		const VkFrontFace frontFaces[] = { VK_FRONT_FACE_COUNTER_CLOCKWISE, VK_FRONT_FACE_CLOCKWISE };
+		const VkPrimitiveTopology topologies[] = { VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP };
+		const LightCullingMode lightCullingModes[] = { LightCullingMode::Tiled, LightCullingMode::Clustered };
+
+		std::vector<GraphicsPipelineDesc> descs;
+		GraphicsPipelineDesc desc = GetForwardPipelineDesc();
+		for (LightCullingMode lightCullingMode : lightCullingModes)
+			for (VkCullModeFlags cullMode : cullModes)
+				for (VkFrontFace frontFace : frontFaces)
+					for (VkPrimitiveTopology topology : topologies)
+						for (int blend = 0; blend < 2; ++blend)
+						{
+							desc.specialization = GetLightingConstants(lightCullingMode);
+							desc.cullMode = cullMode;
+							desc.frontFace = frontFace;
+							desc.topology = topology;
+							desc.alphaBlend = (blend == 1);
+							descs.push_back(desc);
+						}
+
 		vkDeviceWaitIdle(m_logicalDevice);
+		RunPipelineBenchmark(std::cout, m_logicalDevice, *m_shaderLibrary, descs);
 	}
 
 	//creates a VKInstance with desired attirbs
@@ -180,7 +437,7 @@ namespace Graphics
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 		auto allExtentions = GetRequiredExtentions();
 
@@ -247,11 +504,14 @@ namespace Graphics
 	//Gets the required extensions for validation layer support
 	std::vector<const char*> VulkanProject::GetRequiredExtentions()
 	{
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		std::vector<const char*> extensions;
+		if (!m_headless)
+		{
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
 		if (m_enableValidationLayers) {
 			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -326,9 +586,10 @@ namespace Graphics
 			deviceCandidates.insert(std::make_pair(score, device));
 		}
 
-		if (deviceCandidates.rbegin()->first >= 0)
+		if (deviceCandidates.rbegin()->first > 0)
 		{
 			m_physicalDevice = deviceCandidates.rbegin()->second;
+			m_instrumentation = QueryInstrumentationFeatures(m_physicalDevice);
 		}
 		else
 		{
@@ -363,18 +624,75 @@ namespace Graphics
 		bool swapChainSupportAdequate = false;
 
 		//TODO:: swap chain support format/presentation count should influence score.
-		if (deviceExtensionsSupported)
+		if (m_headless)
+		{
+			swapChainSupportAdequate = true;
+		}
+		else if (deviceExtensionsSupported)
 		{
 			SwapChainSupportDetails swapChainDetails = QuerySwapChainSupport(device);
 			swapChainSupportAdequate = !swapChainDetails.formats.empty() || !swapChainDetails.presentationModes.empty();
 		}
 
+		//the upload service tracks completion with timeline semaphores
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features2.pNext = &vulkan12Features;
+
+		bool timelineSupported = deviceProperties.apiVersion >= VK_API_VERSION_1_2;
+		if (timelineSupported)
+		{
+			vkGetPhysicalDeviceFeatures2(device, &features2);
+			timelineSupported = vulkan12Features.timelineSemaphore == VK_TRUE;
+		}
+
+		//the depth pyramid is a two channel float storage image
+		bool storageFormatsSupported = deviceFeatures.shaderStorageImageExtendedFormats == VK_TRUE;
+
+		//draws are submitted in buckets from the GPU, each command's first instance picks its draw data
+		bool indirectSupported = deviceFeatures.multiDrawIndirect == VK_TRUE && deviceFeatures.drawIndirectFirstInstance == VK_TRUE &&
+			vulkan12Features.drawIndirectCount == VK_TRUE;
+
 		//do not use card if some desired queuefamilies are missing. Can lower the score instead if you have alternatives.
-		if (!indices.IsComplete() || !deviceExtensionsSupported || !swapChainSupportAdequate) return 0;
+		//a usable card scores at least its maxImageDimension2D, so anything up to 0 is rejected by PickPhysicalDevice
+		if (!indices.IsComplete() || !deviceExtensionsSupported || !swapChainSupportAdequate || !timelineSupported || !storageFormatsSupported || !indirectSupported) return -1;
 
 		return score;
 	}
 
+	//features the device is not picked by, but that decide which measurements it can take
+	InstrumentationFeatures VulkanProject::QueryInstrumentationFeatures(VkPhysicalDevice device)
+	{
+		InstrumentationFeatures instrumentation;
+
+		VkPhysicalDeviceFeatures deviceFeatures;
+		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+		instrumentation.pipelineStatistics = deviceFeatures.pipelineStatisticsQuery == VK_TRUE;
+		instrumentation.inheritedQueries = deviceFeatures.inheritedQueries == VK_TRUE;
+		instrumentation.occlusionQueryPrecise = deviceFeatures.occlusionQueryPrecise == VK_TRUE;
+
+		QueueFamilyIndices indices = FindQueueFamilies(device);
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+		if (indices.graphicsFamily.has_value())
+		{
+			instrumentation.timestampValidBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+		}
+
+		return instrumentation;
+	}
+
+	void InstrumentationFeatures::Print(std::ostream& out) const
+	{
+		out << "instrumentation: timestamps " << (timestampValidBits > 0 ? std::to_string(timestampValidBits) + " bits" : "no")
+			<< ", pipeline statistics " << (pipelineStatistics ? "yes" : "no") << ", inherited queries " << (inheritedQueries ? "yes" : "no")
+			<< ", precise occlusion queries " << (occlusionQueryPrecise ? "yes\n" : "no\n");
+	}
+
 	// Queries and lists all queuefamilies inside the desired structure format. 
 	QueueFamilyIndices VulkanProject::FindQueueFamilies(VkPhysicalDevice device)
 	{
@@ -390,25 +708,46 @@ namespace Graphics
 
 		for (const auto& queueFamily : queueFamilies)
 		{
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (!indices.IsComplete())
 			{
-				indices.graphicsFamily = i;
-			}
+				//light culling is dispatched on the graphics queue, so it must accept compute work too
+				if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+				{
+					indices.graphicsFamily = i;
+				}
+
+				//without a surface nothing is presented, the graphics queue stands in
+				VkBool32 presentSupport = false;
+				if (m_headless)
+				{
+					presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == (uint32_t)i;
+				}
+				else
+				{
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+				}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+				if (presentSupport)
+				{
+					indices.presentationFamily = i;
+				}
+			}
 
-			if (presentSupport)
+			//transfer only families are the DMA engines, uploads there run alongside rendering
+			bool transferOnly = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+			if (transferOnly && !indices.transferFamily.has_value())
 			{
-				indices.presentationFamily = i;
+				indices.transferFamily = i;
 			}
 
-			if (indices.IsComplete())
-				break;
-
 			++i;
 		}
 
+		if (!indices.transferFamily.has_value())
+		{
+			indices.transferFamily = indices.graphicsFamily;
+		}
+
 		return indices;
 	}
 
@@ -417,25 +756,47 @@ namespace Graphics
 		QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
 
 		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
-		std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentationFamily.value() };
+		std::set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentationFamily.value(), indices.transferFamily.value() };
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+		//without a transfer family uploads take a second graphics queue if there is one, so they never share a queue with the frame
+		uint32_t transferQueueIndex = 0;
+		if (indices.transferFamily == indices.graphicsFamily && queueFamilies[indices.graphicsFamily.value()].queueCount > 1)
+		{
+			transferQueueIndex = 1;
+		}
 
-		float queuePriority = 1.0f;
+		float queuePriorities[2] = { 1.0f, 0.5f };
 
 		for (uint32_t queueFamily : uniqueQueueFamilies)
 		{
 			VkDeviceQueueCreateInfo queueCreateInfo{};
 			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 			queueCreateInfo.queueFamilyIndex = queueFamily;
-			queueCreateInfo.queueCount = 1;
-			queueCreateInfo.pQueuePriorities = &queuePriority;
+			queueCreateInfo.queueCount = (queueFamily == indices.graphicsFamily.value()) ? transferQueueIndex + 1 : 1;
+			queueCreateInfo.pQueuePriorities = queuePriorities;
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		vkGetPhysicalDeviceFeatures(m_physicalDevice, &deviceFeatures);
 
+		//queries that cost something to keep available are only enabled on demand
+		deviceFeatures.pipelineStatisticsQuery = m_pipelineStatistics ? VK_TRUE : VK_FALSE;
+		deviceFeatures.inheritedQueries = m_inheritedQueries ? VK_TRUE : VK_FALSE;
+
+		VkPhysicalDeviceVulkan12Features vulkan12Features{};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		vulkan12Features.timelineSemaphore = VK_TRUE;
+		vulkan12Features.drawIndirectCount = VK_TRUE;
+
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &vulkan12Features;
 		createInfo.queueCreateInfoCount = static_cast<uint32_t> (queueCreateInfos.size());
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
@@ -459,6 +820,7 @@ namespace Graphics
 
 		vkGetDeviceQueue(m_logicalDevice, indices.graphicsFamily.value(), 0, &m_graphicsQueue);
 		vkGetDeviceQueue(m_logicalDevice, indices.presentationFamily.value(), 0, &m_presentationQueue);
+		vkGetDeviceQueue(m_logicalDevice, indices.transferFamily.value(), transferQueueIndex, &m_transferQueue);
 	}
 
 	void VulkanProject::CreateSurface()
@@ -528,6 +890,42 @@ namespace Graphics
 		vkGetSwapchainImagesKHR(m_logicalDevice, m_swapChain, &imageCount, m_swapChainImages.data());
 	}
 
+	//headless stand in for the swap chain, in the format a desktop surface would most likely give
+	void VulkanProject::CreateOffscreenTargets()
+	{
+		m_swapChainExtent = { Width, Height };
+		m_swapChainFormat = VK_FORMAT_B8G8R8A8_SRGB;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_swapChainFormat;
+		imageInfo.extent = { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		m_swapChainImages.resize(FramesInFlight);
+		m_offscreenAllocations.resize(FramesInFlight);
+		for (uint32_t i = 0; i < FramesInFlight; ++i)
+		{
+			if (vkCreateImage(m_logicalDevice, &imageInfo, nullptr, &m_swapChainImages[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Create Offscreen Image!");
+			}
+
+			VkMemoryRequirements memRequirements;
+			vkGetImageMemoryRequirements(m_logicalDevice, m_swapChainImages[i], &memRequirements);
+
+			m_offscreenAllocations[i] = m_memoryAllocator->Allocate(memRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+			vkBindImageMemory(m_logicalDevice, m_swapChainImages[i], m_offscreenAllocations[i].memory, m_offscreenAllocations[i].offset);
+		}
+	}
+
 	void VulkanProject::CreateImageViews()
 	{
 		m_swapChainImageViews.resize(m_swapChainImages.size());
@@ -644,306 +1042,964 @@ namespace Graphics
 	}
 	/////////////////Initial setup till here.
 
-	VkShaderModule VulkanProject::CreateShaderModule(const std::vector<char>& code)
+	//pipeline layout shared by the forward pass and the light culling compute passes, push constants come from reflection
+	void VulkanProject::CreatePipelineLayout()
 	{
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-
-		
-		createInfo.codeSize = code.size();
-
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-		VkShaderModule shaderModule;
-		if (vkCreateShaderModule(m_logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create shader module!");
-		}
-		return shaderModule;
-	}
-
-	void VulkanProject::CreateGraphicsPipeline()
-	{
-		//Shader vShader = Shader("Shaders/vShader.vert", m_logicalDevice);
-		auto vertexcode = readFile("Shaders/vert.spv");
-		VkShaderModule vertexModule = CreateShaderModule(vertexcode);
-		VkPipelineShaderStageCreateInfo vertStageInfo{};
-		vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertStageInfo.module = vertexModule;
-		vertStageInfo.pName = "main";
-
-		auto fragCode = readFile("Shaders/frag.spv");
-		VkShaderModule fragModule = CreateShaderModule(fragCode);
-		VkPipelineShaderStageCreateInfo fragStageInfo{};
-		fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragStageInfo.module = fragModule;
-		fragStageInfo.pName = "main";
-
-		VkPipelineShaderStageCreateInfo shaderStages[] = { vertStageInfo, fragStageInfo };
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 0;
-		vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-		vertexInputInfo.vertexAttributeDescriptionCount = 0;
-		vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)m_swapChainExtent.width;
-		viewport.height = (float)m_swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = m_swapChainExtent;
-
-		VkPipelineViewportStateCreateInfo viewportState{};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-		rasterizer.depthBiasClamp = 0.0f; // Optional
-		rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisampling.minSampleShading = 1.0f; // Optional
-		multisampling.pSampleMask = nullptr; // Optional
-		multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-		multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-		VkPipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f; // Optional
-		colorBlending.blendConstants[1] = 0.0f; // Optional
-		colorBlending.blendConstants[2] = 0.0f; // Optional
-		colorBlending.blendConstants[3] = 0.0f; // Optional
-
-		VkDynamicState dynamicStates[] = 
-		{
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
-		};
-
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = 2;
-		dynamicState.pDynamicStates = dynamicStates;
-
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 0; // Optional
-		pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+		m_pipelineLayout = m_shaderLayout.CreatePipelineLayout(m_logicalDevice, { m_descriptorSetLayout });
+		m_pipelineLayoutKey = HashPipelineLayoutCompatibility(m_shaderLayout);
+	}
 
-		if (vkCreatePipelineLayout(m_logicalDevice, &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout!");
-		}
+	//one SPIR-V file per shader, the light culling mode and list sizes are folded in when the pipeline is built
+	SpecializationConstants VulkanProject::GetLightingConstants(LightCullingMode mode)
+	{
+		SpecializationConstants constants;
+		constants.Set(LightCullingModeConstantId, static_cast<uint32_t>(mode));
+		constants.Set(TileSizeConstantId, TileSize);
+		constants.Set(MaxLightsPerTileConstantId, MaxLightsPerTile);
+		constants.Set(MaxLightsPerClusterConstantId, MaxLightsPerCluster);
+		constants.Set(HiZDepthBoundsConstantId, m_depthPrePass ? 1 : 0);
+		return constants;
+	}
 
-		
+	GraphicsPipelineDesc VulkanProject::GetForwardPipelineDesc()
+	{
 		assert(m_traingleRenderPass != VK_NULL_HANDLE);
 
-		VkGraphicsPipelineCreateInfo graphicsPipelineInfo{};
-		graphicsPipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		graphicsPipelineInfo.stageCount = 2;
-		graphicsPipelineInfo.pStages = shaderStages;
-		graphicsPipelineInfo.pVertexInputState = &vertexInputInfo;
-		graphicsPipelineInfo.pInputAssemblyState = &inputAssembly;
-		graphicsPipelineInfo.pViewportState = &viewportState;
-		graphicsPipelineInfo.pRasterizationState = &rasterizer;
-		graphicsPipelineInfo.pMultisampleState = &multisampling;
-		graphicsPipelineInfo.pDepthStencilState = nullptr;
-		graphicsPipelineInfo.pColorBlendState = &colorBlending;
-		graphicsPipelineInfo.pDynamicState = nullptr;
-		graphicsPipelineInfo.layout = m_pipelineLayout;
-		graphicsPipelineInfo.renderPass = m_traingleRenderPass;
-		graphicsPipelineInfo.subpass = 0;
-		graphicsPipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-		graphicsPipelineInfo.basePipelineIndex = -1;
-
-		if (vkCreateGraphicsPipelines(m_logicalDevice, VK_NULL_HANDLE, 1,&graphicsPipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to Create Graphics Pipeline");
-		}
-
-		vkDestroyShaderModule(m_logicalDevice, vertexModule, nullptr);
-		vkDestroyShaderModule(m_logicalDevice, fragModule, nullptr);
+		GraphicsPipelineDesc desc;
+		desc.vertexShader = "Shaders/vert.spv";
+		desc.fragmentShader = "Shaders/frag.spv";
+		desc.vertexLayout = VertexLayout::Packed();
+		desc.specialization = GetLightingConstants(m_lightCullingMode);
+		desc.specialization.Set(CountOverdrawConstantId, m_countOverdraw ? 1 : 0);
+		desc.layout = m_pipelineLayout;
+		desc.layoutKey = m_pipelineLayoutKey;
+		desc.renderPass = m_traingleRenderPass;
+		desc.renderPassKey = m_renderPassKey;
+		desc.extent = m_swapChainExtent;
+
+		//after the pre-pass depth is final and only the front most fragment of a pixel passes
+		desc.depthTest = true;
+		desc.depthWrite = !m_depthPrePass;
+		desc.depthCompare = m_depthPrePass ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
+		return desc;
 	}
 
-	void VulkanProject::CreateRenderPass() 
+	//the forward vertex stage without a fragment shader, so the pre-pass costs little more than rasterization
+	GraphicsPipelineDesc VulkanProject::GetDepthPipelineDesc()
 	{
-		VkAttachmentDescription colorAttachment{};
-		colorAttachment.format = m_swapChainFormat;
-		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-		VkAttachmentReference colorAttachmentRef {};
-		colorAttachmentRef.attachment = 0;
-		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		assert(m_depthRenderPass != VK_NULL_HANDLE);
+
+		GraphicsPipelineDesc desc = GetForwardPipelineDesc();
+		desc.fragmentShader.clear();
+		desc.renderPass = m_depthRenderPass;
+		desc.renderPassKey = m_depthRenderPassKey;
+		desc.colorAttachmentCount = 0;
+		desc.depthWrite = true;
+		desc.depthCompare = VK_COMPARE_OP_LESS;
+		return desc;
+	}
 
-		VkSubpassDescription subpass{};
-		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-		subpass.colorAttachmentCount = 1;
-		subpass.pColorAttachments = &colorAttachmentRef;
+	//every pipeline is started at once on the job system, then collected
+	void VulkanProject::CreatePipelines()
+	{
+		m_pipelineRegistry = std::make_unique<PipelineRegistry>(m_logicalDevice, *m_jobSystem, *m_shaderLibrary, m_pipelineCache->Get());
 
-		VkRenderPassCreateInfo renderPassInfo{};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-		renderPassInfo.attachmentCount = 1; 
-		renderPassInfo.pAttachments = &colorAttachment;
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
+		m_forwardDesc = GetForwardPipelineDesc();
 
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		//the ground is double sided
+		m_groundDesc = m_forwardDesc;
+		m_groundDesc.cullMode = VK_CULL_MODE_NONE;
 
-		if (vkCreateRenderPass(m_logicalDevice, &renderPassInfo, nullptr, &m_traingleRenderPass) != VK_SUCCESS) 
+		if (m_depthPrePass)
 		{
-			throw std::runtime_error("Failed to Create RenderPass");
+			m_depthDesc = GetDepthPipelineDesc();
+			m_groundDepthDesc = m_depthDesc;
+			m_groundDepthDesc.cullMode = VK_CULL_MODE_NONE;
 		}
-		
+
+		m_lightCullingDesc.shader = m_lightCullingMode == LightCullingMode::Clustered ? "Shaders/clusterAssign.spv" : "Shaders/lightCulling.spv";
+		m_lightCullingDesc.layout = m_pipelineLayout;
+		m_lightCullingDesc.layoutKey = m_pipelineLayoutKey;
+		m_lightCullingDesc.specialization = GetLightingConstants(m_lightCullingMode);
+		m_clusterBoundsDesc.shader = "Shaders/clusterBounds.spv";
+		m_clusterBoundsDesc.layout = m_pipelineLayout;
+		m_clusterBoundsDesc.layoutKey = m_pipelineLayoutKey;
+		m_hiZDesc.shader = "Shaders/hizDownsample.spv";
+		m_hiZDesc.layout = m_pipelineLayout;
+		m_hiZDesc.layoutKey = m_pipelineLayoutKey;
+		m_occlusionCullDesc.shader = "Shaders/occlusionCull.spv";
+		m_occlusionCullDesc.layout = m_pipelineLayout;
+		m_occlusionCullDesc.layoutKey = m_pipelineLayoutKey;
+
+		RequestPipelines();
+		ResolvePipelines();
 	}
 
-	void VulkanProject::CreateFrameBuffer() 
+	//descriptions are file names, so after a shader reload the same descriptions key the new pipelines
+	void VulkanProject::RequestPipelines()
 	{
-		m_swapChainFrameBuffers.resize(m_swapChainImageViews.size());
-		for (size_t i = 0; i < m_swapChainImageViews.size(); ++i)
+		m_pipelineRegistry->Prefetch(m_forwardDesc);
+		m_pipelineRegistry->Prefetch(m_groundDesc);
+		m_pipelineRegistry->Prefetch(m_lightCullingDesc);
+		if (m_depthPrePass)
 		{
-			VkImageView attachments[] = {m_swapChainImageViews[i]};
-			
-			VkFramebufferCreateInfo frameBufferInfo{};
-			frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-			frameBufferInfo.renderPass = m_traingleRenderPass;
-			frameBufferInfo.attachmentCount = 1;
-			frameBufferInfo.pAttachments = attachments;
-			frameBufferInfo.width = m_swapChainExtent.width;
-			frameBufferInfo.height = m_swapChainExtent.height;
-			frameBufferInfo.layers = 1;
-			
-			if (vkCreateFramebuffer(m_logicalDevice, &frameBufferInfo, nullptr, &m_swapChainFrameBuffers[i]) != VK_SUCCESS) 
-			{
-				throw std::runtime_error("Failed To Create FrameBuffer!");
-			}
+			m_pipelineRegistry->Prefetch(m_depthDesc);
+			m_pipelineRegistry->Prefetch(m_groundDepthDesc);
+			m_pipelineRegistry->Prefetch(m_hiZDesc);
+		}
+		if (m_occlusionCulling)
+		{
+			m_pipelineRegistry->Prefetch(m_occlusionCullDesc);
+		}
+		if (m_lightCullingMode == LightCullingMode::Clustered)
+		{
+			m_pipelineRegistry->Prefetch(m_clusterBoundsDesc);
 		}
 	}
 
-	void VulkanProject::CreateCommandPools() 
+	bool VulkanProject::ArePipelinesReady()
 	{
-		QueueFamilyIndices queueFamilies = FindQueueFamilies(m_physicalDevice);
+		if (m_lightCullingMode == LightCullingMode::Clustered && !m_pipelineRegistry->IsReady(m_clusterBoundsDesc))
+			return false;
+		if (m_depthPrePass && (!m_pipelineRegistry->IsReady(m_depthDesc) || !m_pipelineRegistry->IsReady(m_groundDepthDesc) || !m_pipelineRegistry->IsReady(m_hiZDesc)))
+			return false;
+		if (m_occlusionCulling && !m_pipelineRegistry->IsReady(m_occlusionCullDesc))
+			return false;
 
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.queueFamilyIndex = queueFamilies.graphicsFamily.value();
-		poolInfo.flags = 0;
+		return m_pipelineRegistry->IsReady(m_forwardDesc) && m_pipelineRegistry->IsReady(m_groundDesc) && m_pipelineRegistry->IsReady(m_lightCullingDesc);
+	}
 
-		if (vkCreateCommandPool(m_logicalDevice, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) 
+	void VulkanProject::ResolvePipelines()
+	{
+		m_graphicsPipeline = m_pipelineRegistry->GetGraphics(m_forwardDesc);
+		m_groundPipeline = m_pipelineRegistry->GetGraphics(m_groundDesc);
+		m_lightCullingPipeline = m_pipelineRegistry->GetCompute(m_lightCullingDesc);
+		if (m_depthPrePass)
 		{
-			throw std::runtime_error("Failed to Create Command Pool!");
+			m_depthPipeline = m_pipelineRegistry->GetGraphics(m_depthDesc);
+			m_groundDepthPipeline = m_pipelineRegistry->GetGraphics(m_groundDepthDesc);
+			m_hiZPipeline = m_pipelineRegistry->GetCompute(m_hiZDesc);
+		}
+		if (m_occlusionCulling)
+		{
+			m_occlusionCullPipeline = m_pipelineRegistry->GetCompute(m_occlusionCullDesc);
+		}
+		if (m_lightCullingMode == LightCullingMode::Clustered)
+		{
+			m_clusterBoundsPipeline = m_pipelineRegistry->GetCompute(m_clusterBoundsDesc);
 		}
 	}
 
-	void VulkanProject::CreateCommandBuffers() 
+	//Called at the start of a frame. Shaders the watcher recompiled are loaded, and their pipelines are built on the
+	//job system while frames keep rendering with the old ones. Once all of them are ready they are swapped in together
+	//and the old pipelines retired until the frames in flight are done with them.
+	void VulkanProject::ApplyShaderReloads()
 	{
-		m_commandBuffers.resize(m_swapChainFrameBuffers.size());
-		
-		VkCommandBufferAllocateInfo cmdBuffInfo{};
-		cmdBuffInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		cmdBuffInfo.commandPool = m_commandPool;
-		cmdBuffInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		cmdBuffInfo.commandBufferCount = (uint32_t)m_commandBuffers.size();
+		if (m_shaderWatcher)
+		{
+			bool reloaded = false;
+			for (const std::string& filename : m_shaderWatcher->TakeCompiled())
+			{
+				try
+				{
+					//the pipeline layout is fixed, a shader that needs a new binding or push constant waits for a restart
+					MappedFile file = ShaderLibrary::MapSpirv(filename);
+					ShaderReflection reflection = ReflectSpirv(static_cast<const uint32_t*>(file.GetData()), file.GetSize() / sizeof(uint32_t));
+					if (!m_shaderLayout.Covers(reflection))
+					{
+						std::cerr << "shader reload: " << filename << " does not fit the pipeline layout, restart to use it\n";
+						continue;
+					}
+
+					reloaded |= m_shaderLibrary->Reload(filename);
+				}
+				catch (const std::exception& e)
+				{
+					std::cerr << "shader reload: " << e.what() << "\n";
+				}
+			}
 
-		if (vkAllocateCommandBuffers(m_logicalDevice, &cmdBuffInfo, m_commandBuffers.data()) != VK_SUCCESS) 
+			if (reloaded)
+			{
+				RequestPipelines();
+				m_pipelinesPending = true;
+			}
+		}
+
+		if (!m_pipelinesPending || !ArePipelinesReady())
+			return;
+		m_pipelinesPending = false;
+
+		//draw pipelines first, each draw holds a forward and a depth one from this list
+		VkPipeline* pipelines[] = { &m_graphicsPipeline, &m_groundPipeline, &m_depthPipeline, &m_groundDepthPipeline, &m_lightCullingPipeline, &m_hiZPipeline,
+			&m_occlusionCullPipeline, &m_clusterBoundsPipeline };
+		const uint32_t drawPipelineCount = 4;
+		const uint32_t pipelineCount = static_cast<uint32_t>(std::size(pipelines));
+		VkPipeline previous[pipelineCount];
+		for (uint32_t i = 0; i < pipelineCount; ++i)
 		{
-			throw std::runtime_error("Failed to Allocate Command Buffers!");
+			previous[i] = *pipelines[i];
 		}
 
-		for (size_t i = 0; i < m_commandBuffers.size(); ++i) 
+		try
+		{
+			ResolvePipelines();
+		}
+		catch (const std::exception& e)
 		{
-			VkCommandBufferBeginInfo cmdBeginInfo{};
-			cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			cmdBeginInfo.flags = 0;
-			cmdBeginInfo.pInheritanceInfo = nullptr;
+			std::cerr << "shader reload: " << e.what() << "\n";
+			for (uint32_t i = 0; i < pipelineCount; ++i)
+			{
+				*pipelines[i] = previous[i];
+			}
+			return;
+		}
 
-			if (vkBeginCommandBuffer(m_commandBuffers[i], &cmdBeginInfo) != VK_SUCCESS) 
+		auto replace = [&](VkPipeline pipeline)
+		{
+			for (uint32_t i = 0; i < drawPipelineCount; ++i)
 			{
-				throw std::runtime_error("failed to begin recording command  buffer");
+				if (pipeline == previous[i])
+					return *pipelines[i];
 			}
+			return pipeline;
+		};
+		for (DrawItem& draw : m_drawItems)
+		{
+			draw.pipeline = replace(draw.pipeline);
+			draw.depthPipeline = replace(draw.depthPipeline);
+		}
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = m_traingleRenderPass;
-			renderPassInfo.framebuffer = m_swapChainFrameBuffers[i];
+		for (uint32_t i = 0; i < pipelineCount; ++i)
+		{
+			if (*pipelines[i] != previous[i])
+			{
+				m_pipelineRegistry->Retire(previous[i], FramesInFlight);
+			}
+		}
+
+		//the bounds are built once, a new bounds shader has to run again. Rare enough to wait for the GPU.
+		if (m_clusterBoundsPipeline != previous[pipelineCount - 1])
+		{
+			vkDeviceWaitIdle(m_logicalDevice);
+			m_clusterBoundsDirty = true;
+			BuildClusterBounds();
+		}
+	}
+
+	//the first of the usual depth formats the device can render to and sample with optimal tiling
+	VkFormat VulkanProject::FindDepthFormat()
+	{
+		const VkFormat candidates[] = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+		for (VkFormat format : candidates)
+		{
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &properties);
+			VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+			if ((properties.optimalTilingFeatures & required) == required)
+				return format;
+		}
+
+		throw std::runtime_error("Failed to find a supported depth format!");
+	}
+
+	//One depth image shared by all frames in flight. Frames are submitted to one queue, and the pre-pass render pass's
+	//external dependency makes each frame's clear wait for the previous frame's forward pass and pyramid build, so
+	//they never overlap on it. Without the pre-pass the forward pass's own external dependency does the same.
+	void VulkanProject::CreateDepthResources()
+	{
+		m_depthFormat = FindDepthFormat();
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = m_depthFormat;
+		imageInfo.extent = { m_swapChainExtent.width, m_swapChainExtent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_logicalDevice, &imageInfo, nullptr, &m_depthImage) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Depth Image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_logicalDevice, m_depthImage, &memRequirements);
+
+		m_depthImageAllocation = m_memoryAllocator->Allocate(memRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+		vkBindImageMemory(m_logicalDevice, m_depthImage, m_depthImageAllocation.memory, m_depthImageAllocation.offset);
+
+		//an attachment view of a combined format covers the stencil aspect as well
+		bool hasStencil = m_depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || m_depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_depthImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = m_depthFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_logicalDevice, &viewInfo, nullptr, &m_depthImageView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("UNABLE TO CREATE IMAGE VIEW!");
+		}
+
+		//a sampled view may only cover one aspect
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (vkCreateImageView(m_logicalDevice, &viewInfo, nullptr, &m_depthSampleView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("UNABLE TO CREATE IMAGE VIEW!");
+		}
+	}
+
+	//level 0 is half the screen rounded up to whole downsample groups, so the groups own every level up to 5 outright.
+	//the levels are written through one storage view each and read through a view over all of them.
+	void VulkanProject::CreateHiZResources()
+	{
+		m_hiZGroupCountX = (m_swapChainExtent.width + HiZGroupSize - 1) / HiZGroupSize;
+		m_hiZGroupCountY = (m_swapChainExtent.height + HiZGroupSize - 1) / HiZGroupSize;
+		uint32_t width = m_hiZGroupCountX * HiZGroupSize / 2;
+		uint32_t height = m_hiZGroupCountY * HiZGroupSize / 2;
+
+		//the same count Shaders/hizDownsample.comp works out
+		uint32_t levelCount = 1;
+		while ((std::max(width, height) >> levelCount) > 0 && levelCount < HiZMaxLevels)
+		{
+			++levelCount;
+		}
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R32G32_SFLOAT;
+		imageInfo.extent = { width, height, 1 };
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(m_logicalDevice, &imageInfo, nullptr, &m_hiZImage) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Depth Pyramid!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(m_logicalDevice, m_hiZImage, &memRequirements);
+
+		m_hiZImageAllocation = m_memoryAllocator->Allocate(memRequirements, MemoryUsage::GpuOnly, ResourceKind::Optimal);
+		vkBindImageMemory(m_logicalDevice, m_hiZImage, m_hiZImageAllocation.memory, m_hiZImageAllocation.offset);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = m_hiZImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32G32_SFLOAT;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = levelCount;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(m_logicalDevice, &viewInfo, nullptr, &m_hiZView) != VK_SUCCESS)
+		{
+			throw std::runtime_error("UNABLE TO CREATE IMAGE VIEW!");
+		}
+
+		m_hiZLevelViews.resize(levelCount);
+		for (uint32_t level = 0; level < levelCount; ++level)
+		{
+			viewInfo.subresourceRange.baseMipLevel = level;
+			viewInfo.subresourceRange.levelCount = 1;
+			if (vkCreateImageView(m_logicalDevice, &viewInfo, nullptr, &m_hiZLevelViews[level]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("UNABLE TO CREATE IMAGE VIEW!");
+			}
+		}
+
+		//every read is a texelFetch, the sampler only completes the combined descriptors
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+		if (vkCreateSampler(m_logicalDevice, &samplerInfo, nullptr, &m_pointSampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Sampler!");
+		}
+
+		//the last group of a build knows it is last once the counter reaches the group count
+		CreateBuffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_hiZCounterBuffer, m_hiZCounterBufferAllocation);
+	}
+
+	void VulkanProject::CreateRenderPass() 
+	{
+		VkAttachmentDescription attachments[2] = {};
+		VkAttachmentDescription& colorAttachment = attachments[0];
+		colorAttachment.format = m_swapChainFormat;
+		colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		colorAttachment.finalLayout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		//the pre-pass leaves the final depth behind and it is only tested here, without it the pass clears and writes its own
+		VkImageLayout depthLayout = m_depthPrePass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		VkAttachmentDescription& depthAttachment = attachments[1];
+		depthAttachment.format = m_depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = m_depthPrePass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = m_depthPrePass ? depthLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = depthLayout;
+
+		VkAttachmentReference colorAttachmentRef {};
+		colorAttachmentRef.attachment = 0;
+		colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 1;
+		depthAttachmentRef.layout = depthLayout;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &colorAttachmentRef;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 2; 
+		renderPassInfo.pAttachments = attachments;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+
+		//depth comes from the pre-pass or from the previous frame's forward pass
+		VkSubpassDependency dependency{};
+		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependency.dstSubpass = 0;
+		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		
+		renderPassInfo.dependencyCount = 1;
+		renderPassInfo.pDependencies = &dependency;
+
+		m_renderPassKey = HashRenderPassCompatibility(renderPassInfo);
+		if (vkCreateRenderPass(m_logicalDevice, &renderPassInfo, nullptr, &m_traingleRenderPass) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to Create RenderPass");
+		}
+		
+	}
+
+	//depth only, cleared and written by the pre-pass and handed to the forward pass read only
+	void VulkanProject::CreateDepthRenderPass()
+	{
+		if (!m_depthPrePass)
+			return;
+
+		VkAttachmentDescription depthAttachment{};
+		depthAttachment.format = m_depthFormat;
+		depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+		VkAttachmentReference depthAttachmentRef{};
+		depthAttachmentRef.attachment = 0;
+		depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 0;
+		subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+		VkSubpassDependency dependencies[2] = {};
+
+		//the previous frame's forward pass and pyramid build must be done with it before the clear
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[0].srcAccessMask = 0;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		//the writes and the transition to read only land before anything later tests against them or builds the pyramid
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &depthAttachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 2;
+		renderPassInfo.pDependencies = dependencies;
+
+		m_depthRenderPassKey = HashRenderPassCompatibility(renderPassInfo);
+		if (vkCreateRenderPass(m_logicalDevice, &renderPassInfo, nullptr, &m_depthRenderPass) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create RenderPass");
+		}
+	}
+
+	void VulkanProject::CreateFrameBuffer() 
+	{
+		m_swapChainFrameBuffers.resize(m_swapChainImageViews.size());
+		for (size_t i = 0; i < m_swapChainImageViews.size(); ++i)
+		{
+			VkImageView attachments[] = { m_swapChainImageViews[i], m_depthImageView };
+			
+			VkFramebufferCreateInfo frameBufferInfo{};
+			frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			frameBufferInfo.renderPass = m_traingleRenderPass;
+			frameBufferInfo.attachmentCount = 2;
+			frameBufferInfo.pAttachments = attachments;
+			frameBufferInfo.width = m_swapChainExtent.width;
+			frameBufferInfo.height = m_swapChainExtent.height;
+			frameBufferInfo.layers = 1;
+			
+			if (vkCreateFramebuffer(m_logicalDevice, &frameBufferInfo, nullptr, &m_swapChainFrameBuffers[i]) != VK_SUCCESS) 
+			{
+				throw std::runtime_error("Failed To Create FrameBuffer!");
+			}
+		}
+
+		if (m_depthPrePass)
+		{
+			VkFramebufferCreateInfo frameBufferInfo{};
+			frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			frameBufferInfo.renderPass = m_depthRenderPass;
+			frameBufferInfo.attachmentCount = 1;
+			frameBufferInfo.pAttachments = &m_depthImageView;
+			frameBufferInfo.width = m_swapChainExtent.width;
+			frameBufferInfo.height = m_swapChainExtent.height;
+			frameBufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(m_logicalDevice, &frameBufferInfo, nullptr, &m_depthFrameBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed To Create FrameBuffer!");
+			}
+		}
+	}
+
+	void VulkanProject::CreateCommandPools() 
+	{
+		QueueFamilyIndices queueFamilies = FindQueueFamilies(m_physicalDevice);
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = queueFamilies.graphicsFamily.value();
+		poolInfo.flags = 0;
+
+		if (vkCreateCommandPool(m_logicalDevice, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("Failed to Create Command Pool!");
+		}
+
+		//one transient pool per frame in flight, reset wholesale once that frame's fence has signaled
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		m_frameCommandPools.resize(FramesInFlight);
+
+		for (uint32_t i = 0; i < FramesInFlight; ++i)
+		{
+			if (vkCreateCommandPool(m_logicalDevice, &poolInfo, nullptr, &m_frameCommandPools[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to Create Command Pool!");
+			}
+		}
+	}
+
+	void VulkanProject::CreateCommandBuffers() 
+	{
+		m_frameCommandBuffers.resize(FramesInFlight);
+
+		for (uint32_t i = 0; i < FramesInFlight; ++i)
+		{
+			VkCommandBufferAllocateInfo cmdBuffInfo{};
+			cmdBuffInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cmdBuffInfo.commandPool = m_frameCommandPools[i];
+			cmdBuffInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+			cmdBuffInfo.commandBufferCount = 1;
 
-			renderPassInfo.renderArea.offset = { 0,0 };
-			renderPassInfo.renderArea.extent = m_swapChainExtent;
+			if (vkAllocateCommandBuffers(m_logicalDevice, &cmdBuffInfo, &m_frameCommandBuffers[i]) != VK_SUCCESS) 
+			{
+				throw std::runtime_error("Failed to Allocate Command Buffers!");
+			}
+		}
 
-			VkClearValue clearColor = { 0.0f, 0.0f,0.0f, 0.0f };
-			renderPassInfo.clearValueCount = 1;
-			renderPassInfo.pClearValues = &clearColor;
+		QueueFamilyIndices queueFamilies = FindQueueFamilies(m_physicalDevice);
+		m_parallelRecorder = std::make_unique<ParallelCommandRecorder>(m_logicalDevice, queueFamilies.graphicsFamily.value(), *m_jobSystem, FramesInFlight, (uint32_t)DrawPass::Count);
+	}
+
+	//binds the pass' state and issues a slice of the draw list, secondary buffers inherit no state so this is self contained
+	void VulkanProject::RecordDraws(VkCommandBuffer commandBuffer, DrawPass pass, uint32_t firstDraw, uint32_t drawCount)
+	{
+		//every forward pipeline shares m_pipelineLayout, so the set stays bound across pipeline changes
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 2, m_frameDynamicOffsets);
+		PipelineBindState bindState;
 
-			vkCmdBeginRenderPass(m_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		VkBuffer vertexBuffer = m_meshPool->GetVertexBuffer();
+		VkDeviceSize vertexOffset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
 
-			vkCmdBindPipeline(m_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-			vkCmdDraw(m_commandBuffers[i], 3, 1, 0, 0);
+		//the index buffer only changes when the index width does
+		VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+		for (uint32_t i = firstDraw; i < firstDraw + drawCount; ++i)
+		{
+			const DrawItem& draw = m_drawItems[i];
+			const MeshRange& mesh = m_meshPool->GetMesh(draw.mesh);
+			bindState.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (pass == DrawPass::Depth) ? draw.depthPipeline : draw.pipeline);
+			if (mesh.indexType != boundIndexType)
+			{
+				vkCmdBindIndexBuffer(commandBuffer, m_meshPool->GetIndexBuffer(mesh.indexType), 0, mesh.indexType);
+				boundIndexType = mesh.indexType;
+			}
+
+			//the instance index finds the draw data, like in the indirect commands
+			vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, i);
+		}
+
+		m_pipelineRegistry->CountBinds(bindState.GetBinds(), bindState.GetSkipped());
+	}
+
+	//one indirect call per bucket whatever the draw count. The pre-pass draws every command, the forward pass the ones
+	//RecordOcclusionCulling compacted into the bucket's range, with their count read from the GPU.
+	void VulkanProject::RecordIndirectDraws(VkCommandBuffer commandBuffer, DrawPass pass)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 2, m_frameDynamicOffsets);
+		PipelineBindState bindState;
 
-			vkCmdEndRenderPass(m_commandBuffers[i]);
+		VkBuffer vertexBuffer = m_meshPool->GetVertexBuffer();
+		VkDeviceSize vertexOffset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
 
-			if (vkEndCommandBuffer(m_commandBuffers[i]) != VK_SUCCESS)
+		const uint32_t commandStride = sizeof(VkDrawIndexedIndirectCommand);
+		for (uint32_t bucket = 0; bucket < (uint32_t)m_drawBuckets.size(); ++bucket)
+		{
+			const DrawBucket& range = m_drawBuckets[bucket];
+			const DrawItem& draw = m_drawItems[range.firstDraw];
+			VkIndexType indexType = m_meshPool->GetMesh(draw.mesh).indexType;
+			bindState.Bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, (pass == DrawPass::Depth) ? draw.depthPipeline : draw.pipeline);
+			vkCmdBindIndexBuffer(commandBuffer, m_meshPool->GetIndexBuffer(indexType), 0, indexType);
+
+			VkDeviceSize offset = (VkDeviceSize)range.firstDraw * commandStride;
+			if (pass == DrawPass::Depth)
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, m_drawCommandBuffer, offset, range.drawCount, commandStride);
+			}
+			else
 			{
-				throw std::runtime_error("Failed to Record Command Buffer!");
+				vkCmdDrawIndexedIndirectCount(commandBuffer, m_visibleDrawCommandBuffer, offset, m_visibleDrawCountBuffer, bucket * sizeof(uint32_t), range.drawCount, commandStride);
 			}
+		}
 
+		m_pipelineRegistry->CountBinds(bindState.GetBinds(), bindState.GetSkipped());
+	}
+
+	//one render pass over the whole draw list, recorded inline or in slices on the job system. Draws the GPU submits
+	//take a handful of commands, so they are always recorded inline. Secondaries may only run inside the pass's
+	//statistics query when the device inherits queries, otherwise the pass is recorded inline too.
+	void VulkanProject::RecordDrawPass(VkCommandBuffer commandBuffer, DrawPass pass, const VkRenderPassBeginInfo& renderPassInfo, uint32_t frameIndex)
+	{
+		uint32_t drawCount = static_cast<uint32_t>(m_drawItems.size());
+		bool recordInParallel = m_parallelRecording && m_parallelRecorder && drawCount >= ParallelRecordThreshold && (!m_statisticsQueries || m_inheritedQueries);
+
+		if (m_occlusionCulling)
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			RecordIndirectDraws(commandBuffer, pass);
+		}
+		else if (recordInParallel)
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+			VkCommandBufferInheritanceInfo inheritanceInfo{};
+			inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+			inheritanceInfo.renderPass = renderPassInfo.renderPass;
+			inheritanceInfo.subpass = 0;
+			inheritanceInfo.framebuffer = renderPassInfo.framebuffer;
+			inheritanceInfo.pipelineStatistics = m_statisticsQueries ? PipelineStatisticsQueries::Statistics : 0;
+
+			const std::vector<VkCommandBuffer>& secondaries = m_parallelRecorder->Record(frameIndex, (uint32_t)pass, inheritanceInfo, drawCount,
+				[this, pass](VkCommandBuffer secondary, uint32_t first, uint32_t count) { RecordDraws(secondary, pass, first, count); });
+
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		}
+		else
+		{
+			vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			RecordDraws(commandBuffer, pass, 0, drawCount);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	//Builds the depth pyramid from the pre-pass and, when culling, compacts the draws visible against it into the
+	//forward pass' indirect commands. The pyramid is rebuilt from scratch, so its layout is reset every frame, even
+	//without a pre-pass since the light culling shaders declare it.
+	void VulkanProject::RecordOcclusionCulling(VkCommandBuffer commandBuffer)
+	{
+		//the previous frame's readers of the pyramid, the counters and the visible draws are done before they are rewritten
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		//the pyramid build finds its last group and the culling pass its slots through counters that start at 0
+		VkBuffer counters[2] = { m_hiZCounterBuffer, m_visibleDrawCountBuffer };
+		uint32_t counterCount = m_occlusionCulling ? 2 : (m_depthPrePass ? 1 : 0);
+		VkBufferMemoryBarrier counterBarriers[2] = {};
+		for (uint32_t i = 0; i < counterCount; ++i)
+		{
+			vkCmdFillBuffer(commandBuffer, counters[i], 0, VK_WHOLE_SIZE, 0);
+
+			counterBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			counterBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			counterBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			counterBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			counterBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			counterBarriers[i].buffer = counters[i];
+			counterBarriers[i].offset = 0;
+			counterBarriers[i].size = VK_WHOLE_SIZE;
+		}
+
+		VkImageMemoryBarrier pyramidBarrier{};
+		pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		pyramidBarrier.srcAccessMask = 0;
+		pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		pyramidBarrier.image = m_hiZImage;
+		pyramidBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1 };
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+			counterCount, counterBarriers, 1, &pyramidBarrier);
+
+		if (!m_depthPrePass)
+			return;
+
+		{
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "hi-z build");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_hiZPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 2, m_frameDynamicOffsets);
+			vkCmdDispatch(commandBuffer, m_hiZGroupCountX, m_hiZGroupCountY, 1);
+		}
+
+		//light culling reads the pyramid right after, the occlusion test before it
+		VkMemoryBarrier pyramidWritten{};
+		pyramidWritten.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		pyramidWritten.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		pyramidWritten.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &pyramidWritten, 0, nullptr, 0, nullptr);
+
+		if (!m_occlusionCulling)
+			return;
+
+		{
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "draw culling");
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_occlusionCullPipeline);
+			vkCmdDispatch(commandBuffer, (m_culledDrawCount + 63) / 64, 1, 1);
+		}
+
+		VkBufferMemoryBarrier commandBarriers[2] = { counterBarriers[1], counterBarriers[1] };
+		for (VkBufferMemoryBarrier& commandBarrier : commandBarriers)
+		{
+			commandBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			commandBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		}
+		commandBarriers[0].buffer = m_visibleDrawCommandBuffer;		//[1] is the counts
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 0, nullptr, 2, commandBarriers, 0, nullptr);
+	}
+
+	//records the whole frame for the given swapchain image, called every frame after the frame's pool was reset
+	void VulkanProject::RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex)
+	{
+		VkCommandBufferBeginInfo cmdBeginInfo{};
+		cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		cmdBeginInfo.pInheritanceInfo = nullptr;
+
+		if (vkBeginCommandBuffer(commandBuffer, &cmdBeginInfo) != VK_SUCCESS) 
+		{
+			throw std::runtime_error("failed to begin recording command  buffer");
+		}
+
+		if (m_gpuProfiler)
+		{
+			m_gpuProfiler->BeginFrame(commandBuffer, frameIndex, "frame");
+		}
+		if (m_statisticsQueries)
+		{
+			m_statisticsQueries->BeginFrame(commandBuffer, frameIndex);
+		}
+		PipelineStatisticsQueries* statistics = m_statisticsQueries.get();
+
+		//streamed resources become usable once their upload batch is done, the submit waits on it
+		m_uploadWaitValue = m_uploadService->RecordAcquireBarriers(commandBuffer, m_uploadWaitStages);
+
+		VkBufferMemoryBarrier counterBarrier{};
+		counterBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		counterBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counterBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		counterBarrier.buffer = m_overdrawCounterBuffer;
+		counterBarrier.offset = 0;
+		counterBarrier.size = VK_WHOLE_SIZE;
+
+		if (m_countOverdraw)
+		{
+			//the previous frame's copy of the counter must be done before it is cleared
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+			vkCmdFillBuffer(commandBuffer, m_overdrawCounterBuffer, 0, VK_WHOLE_SIZE, 0);
+
+			counterBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			counterBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 1, &counterBarrier, 0, nullptr);
+		}
+
+		//final depth first, so the forward pass shades each visible pixel once
+		if (m_depthPrePass)
+		{
+			VkClearValue clearDepth{};
+			clearDepth.depthStencil = { 1.0f, 0 };
+
+			VkRenderPassBeginInfo depthPassInfo{};
+			depthPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			depthPassInfo.renderPass = m_depthRenderPass;
+			depthPassInfo.framebuffer = m_depthFrameBuffer;
+			depthPassInfo.renderArea.offset = { 0,0 };
+			depthPassInfo.renderArea.extent = m_swapChainExtent;
+			depthPassInfo.clearValueCount = 1;
+			depthPassInfo.pClearValues = &clearDepth;
+
+			CPU_TRACE_SCOPE("record depth pre-pass");
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "depth pre-pass");
+			PipelineStatisticsScope statisticsScope(statistics, commandBuffer, frameIndex, (uint32_t)StatisticsPass::DepthPrePass);
+			RecordDrawPass(commandBuffer, DrawPass::Depth, depthPassInfo, frameIndex);
+		}
+
+		{
+			CPU_TRACE_SCOPE("record occlusion culling");
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "occlusion culling");
+			PipelineStatisticsScope statisticsScope(statistics, commandBuffer, frameIndex, (uint32_t)StatisticsPass::OcclusionCulling);
+			RecordOcclusionCulling(commandBuffer);
+		}
+
+		//the previous frame's fragment shader may still be reading the light grid
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+		{
+			CPU_TRACE_SCOPE("record light culling");
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "light culling");
+			PipelineStatisticsScope statisticsScope(statistics, commandBuffer, frameIndex, (uint32_t)StatisticsPass::LightCulling);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_lightCullingPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 2, m_frameDynamicOffsets);
+			if (m_lightCullingMode == LightCullingMode::Clustered)
+			{
+				vkCmdDispatch(commandBuffer, ClusterCount, 1, 1);
+			}
+			else
+			{
+				vkCmdDispatch(commandBuffer, m_tileCountX, m_tileCountY, 1);
+			}
+		}
+
+		VkBufferMemoryBarrier gridBarriers[2] = {};
+		for (uint32_t b = 0; b < 2; ++b)
+		{
+			gridBarriers[b].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			gridBarriers[b].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			gridBarriers[b].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			gridBarriers[b].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			gridBarriers[b].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			gridBarriers[b].offset = 0;
+			gridBarriers[b].size = VK_WHOLE_SIZE;
+		}
+		gridBarriers[0].buffer = m_lightGridCountBuffer;
+		gridBarriers[1].buffer = m_lightGridIndexBuffer;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 2, gridBarriers, 0, nullptr);
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = m_traingleRenderPass;
+		renderPassInfo.framebuffer = m_swapChainFrameBuffers[imageIndex];
+
+		renderPassInfo.renderArea.offset = { 0,0 };
+		renderPassInfo.renderArea.extent = m_swapChainExtent;
+
+		VkClearValue clearValues[2] = {};
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+		renderPassInfo.clearValueCount = 2;
+		renderPassInfo.pClearValues = clearValues;
+
+		{
+			CPU_TRACE_SCOPE("record forward");
+			GpuProfileScope scope(m_gpuProfiler.get(), commandBuffer, "forward");
+			PipelineStatisticsScope statisticsScope(statistics, commandBuffer, frameIndex, (uint32_t)StatisticsPass::Forward);
+			RecordDrawPass(commandBuffer, DrawPass::Forward, renderPassInfo, frameIndex);
+		}
+
+		//copied to this frame's slot, the CPU reads it once the frame's fence has signaled
+		if (m_countOverdraw)
+		{
+			counterBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			counterBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &counterBarrier, 0, nullptr);
+
+			VkBufferCopy region{};
+			region.srcOffset = 0;
+			region.dstOffset = frameIndex * OverdrawCounterSize;
+			region.size = OverdrawCounterSize;
+			vkCmdCopyBuffer(commandBuffer, m_overdrawCounterBuffer, m_overdrawReadbackBuffer, 1, &region);
+
+			VkBufferMemoryBarrier readbackBarrier = counterBarrier;
+			readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+			readbackBarrier.buffer = m_overdrawReadbackBuffer;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &readbackBarrier, 0, nullptr);
+		}
+
+		if (m_gpuProfiler)
+		{
+			m_gpuProfiler->EndFrame(commandBuffer);
+		}
 
-		}	
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Record Command Buffer!");
+		}
 	}
 
 	void VulkanProject::CreateSyncObjects() 
@@ -972,45 +2028,795 @@ namespace Graphics
 		
 	}
 
+	/////////////////Forward+ light culling
+
+	//warm pipeline cache from the last run, only used when it was written by this driver on this device
+	void VulkanProject::CreatePipelineCache()
+	{
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+		m_pipelineCache = std::make_unique<PipelineCache>(m_logicalDevice, deviceProperties, PipelineCacheFile);
+		if (m_pipelineCache->WasLoaded())
+		{
+			std::cout << "pipeline cache: loaded " << m_pipelineCache->GetLoadedBytes() / 1024 << " KiB\n";
+		}
+		else
+		{
+			std::cout << "pipeline cache: cold start\n";
+		}
+	}
+
+	//every buffer and image is sub-allocated from a few large blocks instead of one vkAllocateMemory each
+	void VulkanProject::CreateMemoryAllocator()
+	{
+		VkPhysicalDeviceMemoryProperties memProperties;
+		vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
+
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+		m_memoryBackend = std::make_unique<VulkanMemoryBackend>(m_logicalDevice);
+		m_memoryAllocator = std::make_unique<DeviceMemoryAllocator>(*m_memoryBackend, memProperties, deviceProperties.limits);
+	}
+
+	//on a device with one graphics queue and no transfer family the uploads share m_graphicsQueue,
+	//so they may only be issued from the render thread there
+	void VulkanProject::CreateUploadService()
+	{
+		QueueFamilyIndices indices = FindQueueFamilies(m_physicalDevice);
+		m_uploadService = std::make_unique<UploadService>(m_logicalDevice, *m_memoryAllocator, m_transferQueue, indices.transferFamily.value(), indices.graphicsFamily.value());
+	}
+
+	void VulkanProject::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage, VkBuffer& buffer, Allocation& allocation)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateBuffer(m_logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(m_logicalDevice, buffer, &memRequirements);
+
+		allocation = m_memoryAllocator->Allocate(memRequirements, memoryUsage, ResourceKind::Linear);
+		vkBindBufferMemory(m_logicalDevice, buffer, allocation.memory, allocation.offset);
+	}
+
+	//one set shared by the culling compute passes and the forward pass, the union of what every engine shader declares
+	//whichever light culling mode runs. Camera and lights are rewritten every frame, so they are bound with dynamic
+	//offsets into the frame upload buffer, which reflection can not know.
+	void VulkanProject::CreateDescriptorSetLayout()
+	{
+		m_shaderLayout = ReflectedLayout();
+		for (const char* filename : EngineShaders)
+		{
+			m_shaderLayout.Add(m_shaderLibrary->Load(filename).GetReflection());
+		}
+
+		if (m_shaderLayout.sets.size() != 1)
+		{
+			throw std::runtime_error("engine shaders must only use descriptor set 0");
+		}
+		m_shaderLayout.SetDescriptorType(0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+		m_shaderLayout.SetDescriptorType(0, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC);
+
+		m_descriptorSetLayout = m_shaderLayout.CreateSetLayout(m_logicalDevice, 0);
+	}
+
+	//cluster AABBs only depend on the projection, so they are built with a one off submit instead of every frame
+	void VulkanProject::BuildClusterBounds()
+	{
+		if (m_lightCullingMode != LightCullingMode::Clustered || !m_clusterBoundsDirty)
+			return;
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Command Buffers!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		//no frame is in flight, at startup or after a wait for idle, so slot 0 of the upload buffer is free
+		UploadFrameData(0);
+		m_frameUploadBuffer->EndFrame();
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_clusterBoundsPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 2, m_frameDynamicOffsets);
+		vkCmdDispatch(commandBuffer, (ClusterCount + 63) / 64, 1, 1);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		//queue submission order plus the wait below makes the bounds visible to every later assignment dispatch
+		vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(m_graphicsQueue);
+
+		vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &commandBuffer);
+		m_clusterBoundsDirty = false;
+	}
+
+	//waits for the GPU, then copies the last frame's image through a host visible buffer
+	RgbImage VulkanProject::VP_ReadbackFrame()
+	{
+		if (!m_headless)
+			throw std::runtime_error("frame readback needs a headless run, swap chain images can not be copied from");
+		if (m_lastImageIndex == UINT32_MAX)
+			throw std::runtime_error("no frame has been rendered yet");
+
+		vkDeviceWaitIdle(m_logicalDevice);
+
+		uint32_t width = m_swapChainExtent.width;
+		uint32_t height = m_swapChainExtent.height;
+		VkDeviceSize size = (VkDeviceSize)width * height * 4;
+
+		VkBuffer readbackBuffer;
+		Allocation readbackAllocation;
+		CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu, readbackBuffer, readbackAllocation);
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Command Buffers!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		//the render pass left the image in TRANSFER_SRC, the attachment writes still have to be made visible to the copy
+		VkImageMemoryBarrier imageBarrier{};
+		imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageBarrier.image = m_swapChainImages[m_lastImageIndex];
+		imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkBufferImageCopy region{};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { width, height, 1 };
+		vkCmdCopyImageToBuffer(commandBuffer, m_swapChainImages[m_lastImageIndex], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readbackBuffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(m_graphicsQueue);
+		vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &commandBuffer);
+
+		//the offscreen targets are BGRA
+		m_memoryAllocator->Invalidate(readbackAllocation, 0, size);
+		const uint8_t* texels = static_cast<const uint8_t*>(readbackAllocation.mapped);
+		RgbImage image;
+		image.width = width;
+		image.height = height;
+		image.pixels.resize((size_t)width * height * 3);
+		for (size_t i = 0; i < (size_t)width * height; ++i)
+		{
+			image.pixels[i * 3 + 0] = texels[i * 4 + 2];
+			image.pixels[i * 3 + 1] = texels[i * 4 + 1];
+			image.pixels[i * 3 + 2] = texels[i * 4 + 0];
+		}
+
+		vkDestroyBuffer(m_logicalDevice, readbackBuffer, nullptr);
+		m_memoryAllocator->Free(readbackAllocation);
+		return image;
+	}
+
+	//Copies the light grid of the last frame back and builds the same lists with the CPU reference. The depth ranges the
+	//GPU bounded its tiles and clusters by are copied back with it, so with or without the depth pre-pass the lists must
+	//match exactly. A full list may hold any of its candidates, the GPU keeps whichever win the race for its slots.
+	//Camera and lights are static, any frame's grid will do.
+	uint32_t VulkanProject::VP_ValidateLightCulling(std::ostream& out)
+	{
+		if (m_lastImageIndex == UINT32_MAX)
+			throw std::runtime_error("no frame has been rendered yet");
+
+		vkDeviceWaitIdle(m_logicalDevice);
+
+		bool clustered = m_lightCullingMode == LightCullingMode::Clustered;
+		uint32_t listCount = clustered ? ClusterCount : m_tileCountX * m_tileCountY;
+		uint32_t listStride = clustered ? MaxLightsPerCluster : MaxLightsPerTile;
+		VkDeviceSize countSize = sizeof(uint32_t) * (VkDeviceSize)listCount;
+		VkDeviceSize indexSize = countSize * listStride;
+		VkDeviceSize rangeSize = sizeof(glm::vec2) * (VkDeviceSize)listCount;
+		VkDeviceSize readbackSize = countSize * 2 + indexSize + rangeSize;
+
+		VkBuffer readbackBuffer;
+		Allocation readbackAllocation;
+		CreateBuffer(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu, readbackBuffer, readbackAllocation);
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(m_logicalDevice, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Command Buffers!");
+		}
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		VkMemoryBarrier gridBarrier{};
+		gridBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		gridBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		gridBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &gridBarrier, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy countRegion{ 0, 0, countSize };
+		VkBufferCopy indexRegion{ 0, countSize, indexSize };
+		VkBufferCopy candidateRegion{ 0, countSize + indexSize, countSize };
+		VkBufferCopy rangeRegion{ 0, countSize * 2 + indexSize, rangeSize };
+		vkCmdCopyBuffer(commandBuffer, m_lightGridCountBuffer, readbackBuffer, 1, &countRegion);
+		vkCmdCopyBuffer(commandBuffer, m_lightGridIndexBuffer, readbackBuffer, 1, &indexRegion);
+		vkCmdCopyBuffer(commandBuffer, m_lightGridCandidateBuffer, readbackBuffer, 1, &candidateRegion);
+		vkCmdCopyBuffer(commandBuffer, m_lightGridDepthRangeBuffer, readbackBuffer, 1, &rangeRegion);
+
+		VkBufferMemoryBarrier bufferBarrier{};
+		bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		bufferBarrier.buffer = readbackBuffer;
+		bufferBarrier.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 0, nullptr);
+		vkEndCommandBuffer(commandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		vkQueueWaitIdle(m_graphicsQueue);
+		vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &commandBuffer);
+
+		m_memoryAllocator->Invalidate(readbackAllocation, 0, readbackSize);
+		const uint32_t* gpuCounts = static_cast<const uint32_t*>(readbackAllocation.mapped);
+		const uint32_t* gpuIndices = gpuCounts + listCount;
+		const uint32_t* gpuCandidates = gpuIndices + (size_t)listCount * listStride;
+		const glm::vec2* gpuDepthRanges = reinterpret_cast<const glm::vec2*>(gpuCandidates + listCount);
+
+		//the reference runs a few times so its time is not a cold cache
+		const uint32_t referenceRuns = 8;
+		TileLightCuller tileCuller(m_swapChainExtent.width, m_swapChainExtent.height);
+		ClusteredLightAssigner clusterAssigner;
+		FrameClock::time_point referenceStart = FrameClock::now();
+		if (clustered)
+		{
+			clusterAssigner.BuildClusters(m_camera.projection, m_camera.nearPlane, m_camera.farPlane);
+			for (uint32_t run = 0; run < referenceRuns; ++run)
+			{
+				clusterAssigner.Assign(m_lights, m_camera.view, gpuDepthRanges);
+			}
+		}
+		else
+		{
+			for (uint32_t run = 0; run < referenceRuns; ++run)
+			{
+				tileCuller.Cull(m_lights, m_camera.view, m_camera.projection, m_camera.nearPlane, m_camera.farPlane, gpuDepthRanges);
+			}
+		}
+		double referenceMilliseconds = ElapsedMicroseconds(referenceStart, FrameClock::now()) / referenceRuns / 1000.0;
+
+		const std::vector<uint32_t>& cpuCounts = clustered ? clusterAssigner.GetLightCounts() : tileCuller.GetLightCounts();
+		const std::vector<uint32_t>& cpuIndices = clustered ? clusterAssigner.GetLightIndices() : tileCuller.GetLightIndices();
+		const std::vector<LightListOverflow>& cpuOverflow = clustered ? clusterAssigner.GetOverflow() : tileCuller.GetOverflow();
+
+		uint32_t failed = CountMismatchedLightLists(cpuCounts.data(), cpuIndices.data(), gpuCounts, gpuIndices, listCount, listStride, cpuOverflow);
+
+		uint64_t gpuReferences = 0;
+		uint64_t cpuReferences = 0;
+		uint32_t gpuFullLists = 0;
+		for (uint32_t list = 0; list < listCount; ++list)
+		{
+			gpuReferences += gpuCounts[list];
+			cpuReferences += cpuCounts[list];
+			gpuFullLists += gpuCandidates[list] > listStride ? 1 : 0;
+		}
+
+		std::vector<bool> cpuFull(listCount, false);
+		for (const LightListOverflow& overflow : cpuOverflow)
+		{
+			cpuFull[overflow.list] = true;
+		}
+		uint32_t cpuFullLists = (uint32_t)std::count(cpuFull.begin(), cpuFull.end(), true);
+
+		vkDestroyBuffer(m_logicalDevice, readbackBuffer, nullptr);
+		m_memoryAllocator->Free(readbackAllocation);
+
+		out << "light culling validation, " << (clustered ? "clustered, " : "tiled, ") << m_lights.size() << " lights in " << listCount << " lists: " << failed
+			<< " lists differ from the reference\n";
+		out << "  light references: " << gpuReferences << " GPU, " << cpuReferences << " CPU reference" << (m_depthPrePass ? ", both bounded by the depth pyramid\n" : "\n");
+		if (gpuFullLists > 0 || cpuFullLists > 0)
+		{
+			out << "  lists with more than " << listStride << " lights, the rest were dropped: " << gpuFullLists << " GPU, " << cpuFullLists << " CPU reference\n";
+		}
+		out << "  CPU reference: " << referenceMilliseconds << " ms";
+		if (GetGpuFrameCount() > 0)
+		{
+			for (const GpuScopeTiming& scope : m_gpuProfiler->GetLastFrame())
+			{
+				if (strcmp(scope.name, "light culling") == 0)
+				{
+					out << ", GPU: " << scope.durationMicroseconds / 1000.0 << " ms";
+				}
+			}
+		}
+		out << "\n";
+
+		return failed;
+	}
+
+	//scatters point and spot lights over the scene with a fixed seed so runs are reproducible
+	void VulkanProject::CreateLights()
+	{
+		const uint32_t lightCount = 1024;
+
+		std::mt19937 generator(1337);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		m_lights.resize(lightCount);
+		for (uint32_t i = 0; i < lightCount; ++i)
+		{
+			Light& light = m_lights[i];
+			light.position = glm::vec3(unit(generator) * 20.0f - 10.0f, unit(generator) * 20.0f - 10.0f, 0.25f + unit(generator) * 1.5f);
+			light.radius = 0.5f + unit(generator) * 1.5f;
+			light.color = glm::vec3(unit(generator), unit(generator), unit(generator));
+			light.intensity = 1.0f;
+			light.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			light.spotCosOuter = (i % 4 == 0) ? std::cos(glm::radians(35.0f)) : -1.0f;
+		}
+	}
+
+	//a ground plane under a grid of spheres, the lights float between them
+	void VulkanProject::CreateScene()
+	{
+		const uint32_t gridSize = 16;
+		const float spacing = 1.2f;
+		const float radius = 0.4f;
+
+		m_meshPool = std::make_unique<MeshPool>(m_logicalDevice, *m_memoryAllocator, *m_uploadService, 256 * 1024, 1024 * 1024, 64 * 1024);
+		uint32_t plane = m_meshPool->AddMesh(CreatePlane(24.0f, 16));
+		uint32_t sphere = m_meshPool->AddMesh(CreateSphere(radius, 32, 16));
+
+		m_drawItems.clear();
+		m_drawItems.push_back({ plane, m_groundPipeline, m_groundDepthPipeline, { glm::mat4(1.0f), glm::vec4(0.6f, 0.6f, 0.6f, 1.0f) } });
+
+		for (uint32_t y = 0; y < gridSize; ++y)
+		{
+			for (uint32_t x = 0; x < gridSize; ++x)
+			{
+				glm::vec3 position((x - (gridSize - 1) * 0.5f) * spacing, (y - (gridSize - 1) * 0.5f) * spacing, radius);
+				glm::vec4 color(0.3f + 0.7f * x / (gridSize - 1), 0.5f, 0.3f + 0.7f * y / (gridSize - 1), 1.0f);
+				m_drawItems.push_back({ sphere, m_graphicsPipeline, m_depthPipeline, { glm::translate(glm::mat4(1.0f), position), color } });
+			}
+		}
+	}
+
+	//Sorts the draw items into buckets and uploads what the GPU needs to draw them on its own: per item draw data,
+	//world space boxes and indirect commands. The scene is static, so this happens once. Every command's first
+	//instance is its item's index, which is how the vertex shader finds the draw data.
+	void VulkanProject::CreateDrawBuffers()
+	{
+		auto bucketKey = [this](const DrawItem& draw)
+		{
+			return std::make_tuple(draw.pipeline, draw.depthPipeline, m_meshPool->GetMesh(draw.mesh).indexType);
+		};
+		std::stable_sort(m_drawItems.begin(), m_drawItems.end(), [&](const DrawItem& a, const DrawItem& b) { return bucketKey(a) < bucketKey(b); });
+
+		m_drawBuckets.clear();
+		for (uint32_t i = 0; i < (uint32_t)m_drawItems.size(); ++i)
+		{
+			if (m_drawBuckets.empty() || bucketKey(m_drawItems[i]) != bucketKey(m_drawItems[m_drawBuckets.back().firstDraw]))
+			{
+				m_drawBuckets.push_back({ i, 0 });
+			}
+			++m_drawBuckets.back().drawCount;
+		}
+
+		m_culledDrawCount = static_cast<uint32_t>(m_drawItems.size());
+		std::vector<DrawData> drawData(m_culledDrawCount);
+		std::vector<DrawCullData> cullData(m_culledDrawCount);
+		std::vector<VkDrawIndexedIndirectCommand> commands(m_culledDrawCount);
+		for (uint32_t bucket = 0; bucket < (uint32_t)m_drawBuckets.size(); ++bucket)
+		{
+			const DrawBucket& range = m_drawBuckets[bucket];
+			for (uint32_t i = range.firstDraw; i < range.firstDraw + range.drawCount; ++i)
+			{
+				const DrawItem& draw = m_drawItems[i];
+				const MeshRange& mesh = m_meshPool->GetMesh(draw.mesh);
+
+				glm::vec3 boundsMin(std::numeric_limits<float>::max());
+				glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+				for (uint32_t corner = 0; corner < 8; ++corner)
+				{
+					glm::vec3 local((corner & 1) ? mesh.boundsMax.x : mesh.boundsMin.x, (corner & 2) ? mesh.boundsMax.y : mesh.boundsMin.y, (corner & 4) ? mesh.boundsMax.z : mesh.boundsMin.z);
+					glm::vec3 world = glm::vec3(draw.data.model * glm::vec4(local, 1.0f));
+					boundsMin = glm::min(boundsMin, world);
+					boundsMax = glm::max(boundsMax, world);
+				}
+
+				drawData[i] = draw.data;
+				cullData[i] = { boundsMin, bucket, boundsMax, range.firstDraw };
+				commands[i] = { mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset, i };
+			}
+		}
+
+		VkDeviceSize drawDataSize = sizeof(DrawData) * (VkDeviceSize)m_culledDrawCount;
+		VkDeviceSize cullDataSize = sizeof(DrawCullData) * (VkDeviceSize)m_culledDrawCount;
+		VkDeviceSize commandsSize = sizeof(VkDrawIndexedIndirectCommand) * (VkDeviceSize)m_culledDrawCount;
+		VkDeviceSize countsSize = sizeof(uint32_t) * (VkDeviceSize)m_drawBuckets.size();
+		CreateBuffer(drawDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_drawDataBuffer, m_drawDataBufferAllocation);
+		CreateBuffer(cullDataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_drawCullBuffer, m_drawCullBufferAllocation);
+		CreateBuffer(commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_drawCommandBuffer, m_drawCommandBufferAllocation);
+		CreateBuffer(commandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly, m_visibleDrawCommandBuffer, m_visibleDrawCommandBufferAllocation);
+		CreateBuffer(countsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_visibleDrawCountBuffer, m_visibleDrawCountBufferAllocation);
+
+		m_uploadService->UploadBuffer(m_drawDataBuffer, 0, drawData.data(), drawDataSize, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		m_uploadService->UploadBuffer(m_drawCullBuffer, 0, cullData.data(), cullDataSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		m_uploadService->UploadBuffer(m_drawCommandBuffer, 0, commands.data(), commandsSize, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+	}
+
+	void VulkanProject::UpdateCamera()
+	{
+		float aspect = m_swapChainExtent.width / (float)m_swapChainExtent.height;
+
+		m_camera.nearPlane = 0.1f;
+		m_camera.farPlane = 100.0f;
+		m_camera.position = glm::vec4(0.0f, 0.0f, 12.0f, 1.0f);
+		m_camera.view = glm::lookAt(glm::vec3(m_camera.position), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		m_camera.projection = glm::perspective(glm::radians(45.0f), aspect, m_camera.nearPlane, m_camera.farPlane);
+		m_camera.projection[1][1] *= -1;
+		m_camera.inverseProjection = glm::inverse(m_camera.projection);
+		m_camera.screenSize = glm::vec2((float)m_swapChainExtent.width, (float)m_swapChainExtent.height);
+		m_camera.lightCount = static_cast<uint32_t>(m_lights.size());
+		m_camera.tileCountX = m_tileCountX;
+		m_camera.tileCountY = m_tileCountY;
+	}
+
+	void VulkanProject::CreateLightBuffers()
+	{
+		assert(m_lights.size() <= MaxLights);
+
+		m_tileCountX = (m_swapChainExtent.width + TileSize - 1) / TileSize;
+		m_tileCountY = (m_swapChainExtent.height + TileSize - 1) / TileSize;
+		VkDeviceSize tileCount = (VkDeviceSize)m_tileCountX * m_tileCountY;
+
+		//sized for whichever mode needs more lists, both modes share the bindings
+		VkDeviceSize gridListCount = std::max(tileCount, (VkDeviceSize)ClusterCount);
+		VkDeviceSize gridIndexCount = std::max(tileCount * MaxLightsPerTile, (VkDeviceSize)ClusterCount * MaxLightsPerCluster);
+
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+		VkBufferUsageFlags uploadUsage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		m_frameUploadBuffer = std::make_unique<FrameUploadBuffer>(m_logicalDevice, *m_memoryAllocator, deviceProperties.limits, FrameUploadSize, FramesInFlight, uploadUsage);
+		//the grid is copied out by VP_ValidateLightCulling
+		VkBufferUsageFlags gridUsage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		CreateBuffer(sizeof(uint32_t) * gridListCount, gridUsage, MemoryUsage::GpuOnly, m_lightGridCountBuffer, m_lightGridCountBufferAllocation);
+		CreateBuffer(sizeof(uint32_t) * gridIndexCount, gridUsage, MemoryUsage::GpuOnly, m_lightGridIndexBuffer, m_lightGridIndexBufferAllocation);
+		CreateBuffer(sizeof(uint32_t) * gridListCount, gridUsage, MemoryUsage::GpuOnly, m_lightGridCandidateBuffer, m_lightGridCandidateBufferAllocation);
+		CreateBuffer(sizeof(glm::vec2) * gridListCount, gridUsage, MemoryUsage::GpuOnly, m_lightGridDepthRangeBuffer, m_lightGridDepthRangeBufferAllocation);
+		CreateBuffer(sizeof(ClusterAABB) * ClusterCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, m_clusterBoundsBuffer, m_clusterBoundsBufferAllocation);
+	}
+
+	//the counter exists even when not counting, the forward shader declares its binding either way
+	void VulkanProject::CreateOverdrawCounter()
+	{
+		CreateBuffer(OverdrawCounterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, m_overdrawCounterBuffer, m_overdrawCounterBufferAllocation);
+		CreateBuffer(OverdrawCounterSize * FramesInFlight, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuToCpu, m_overdrawReadbackBuffer, m_overdrawReadbackBufferAllocation);
+	}
+
+	//the slot holds the counts of the last frame that used frameIndex, its fence must have signaled
+	void VulkanProject::ReadOverdrawCounter(uint32_t frameIndex)
+	{
+		m_memoryAllocator->Invalidate(m_overdrawReadbackBufferAllocation, frameIndex * OverdrawCounterSize, OverdrawCounterSize);
+		const uint32_t* slot = static_cast<const uint32_t*>(m_overdrawReadbackBufferAllocation.mapped) + frameIndex * 2;
+		m_overdrawStats.Record(slot[0], slot[1]);
+	}
+
+	//after the command pools, the calibration is a one off submission
+	void VulkanProject::CreateGpuProfiler()
+	{
+		uint32_t validBits = m_instrumentation.timestampValidBits;
+		if (validBits == 0)
+		{
+			std::cout << "gpu profiler: the graphics queue has no timestamps, GPU timings are off\n";
+			return;
+		}
+
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+		m_gpuProfiler = std::make_unique<GpuProfiler>(m_logicalDevice, deviceProperties.limits, validBits, FramesInFlight);
+		m_gpuProfiler->Calibrate(m_graphicsQueue, m_commandPool);
+		m_gpuProfiler->SetCapture(!m_traceFile.empty());
+	}
+
+	void VulkanProject::CreatePipelineStatisticsQueries()
+	{
+		if (!m_pipelineStatistics)
+			return;
+
+		static const char* const passNames[(uint32_t)StatisticsPass::Count] = { "depth pre-pass", "occlusion culling", "light culling", "forward" };
+		m_statisticsQueries = std::make_unique<PipelineStatisticsQueries>(m_logicalDevice, passNames, (uint32_t)StatisticsPass::Count, FramesInFlight);
+	}
+
+	//writes this frame's camera and lights into its upload partition, the frame's fence must have signaled
+	void VulkanProject::UploadFrameData(uint32_t frameIndex)
+	{
+		CPU_TRACE_SCOPE("upload frame data");
+		m_frameUploadBuffer->BeginFrame(frameIndex);
+
+		UpdateCamera();
+		m_frameDynamicOffsets[0] = m_frameUploadBuffer->Upload(&m_camera, sizeof(CameraData));
+
+		//the descriptor range covers MaxLights, so that much is reserved even when fewer lights are live
+		UploadAllocation lights = m_frameUploadBuffer->Allocate(sizeof(Light) * MaxLights);
+		memcpy(lights.data, m_lights.data(), sizeof(Light) * m_lights.size());
+		m_frameDynamicOffsets[1] = lights.offset;
+	}
+
+	void VulkanProject::CreateDescriptorSets()
+	{
+		VkDescriptorPoolSize poolSizes[5] = {};
+		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSizes[0].descriptorCount = 1;
+		poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		poolSizes[1].descriptorCount = 1;
+		poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		poolSizes[2].descriptorCount = 12;
+		poolSizes[3].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSizes[3].descriptorCount = 2;
+		poolSizes[4].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		poolSizes[4].descriptorCount = HiZMaxLevels;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = 5;
+		poolInfo.pPoolSizes = poolSizes;
+		poolInfo.maxSets = 1;
+
+		if (vkCreateDescriptorPool(m_logicalDevice, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Create Descriptor Pool!");
+		}
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(m_logicalDevice, &allocInfo, &m_descriptorSet) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to Allocate Descriptor Sets!");
+		}
+
+		//bindings 6 to 8 are the images, the buffers come first and last
+		const uint32_t bufferBindings[14] = { 0, 1, 2, 3, 4, 5, 9, 10, 11, 12, 13, 14, 15, 16 };
+		VkDescriptorBufferInfo bufferInfos[14] = {};
+		bufferInfos[0] = { m_frameUploadBuffer->GetBuffer(), 0, sizeof(CameraData) };
+		bufferInfos[1] = { m_frameUploadBuffer->GetBuffer(), 0, sizeof(Light) * MaxLights };
+		bufferInfos[2] = { m_lightGridCountBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[3] = { m_lightGridIndexBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[4] = { m_clusterBoundsBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[5] = { m_overdrawCounterBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[6] = { m_hiZCounterBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[7] = { m_drawCullBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[8] = { m_drawCommandBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[9] = { m_drawDataBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[10] = { m_visibleDrawCommandBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[11] = { m_visibleDrawCountBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[12] = { m_lightGridCandidateBuffer, 0, VK_WHOLE_SIZE };
+		bufferInfos[13] = { m_lightGridDepthRangeBuffer, 0, VK_WHOLE_SIZE };
+
+		//the depth image is only sampled after the pre-pass left it read only, the pyramid stays in the general layout.
+		//storage elements past the pyramid's top level repeat it, the downsampler never writes them.
+		VkDescriptorImageInfo depthInfo = { m_pointSampler, m_depthSampleView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL };
+		VkDescriptorImageInfo hiZInfo = { m_pointSampler, m_hiZView, VK_IMAGE_LAYOUT_GENERAL };
+		VkDescriptorImageInfo hiZLevelInfos[HiZMaxLevels] = {};
+		for (uint32_t level = 0; level < HiZMaxLevels; ++level)
+		{
+			hiZLevelInfos[level].imageView = m_hiZLevelViews[std::min(level, (uint32_t)m_hiZLevelViews.size() - 1)];
+			hiZLevelInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+		}
+
+		VkWriteDescriptorSet writes[17] = {};
+		for (uint32_t i = 0; i < 17; ++i)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = m_descriptorSet;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorCount = 1;
+		}
+
+		for (uint32_t i = 0; i < 14; ++i)
+		{
+			writes[i].dstBinding = bufferBindings[i];
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &bufferInfos[i];
+		}
+
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+		writes[14].dstBinding = 6;
+		writes[14].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[14].pImageInfo = &depthInfo;
+		writes[15].dstBinding = 7;
+		writes[15].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[15].pImageInfo = &hiZInfo;
+		writes[16].dstBinding = 8;
+		writes[16].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[16].descriptorCount = HiZMaxLevels;
+		writes[16].pImageInfo = hiZLevelInfos;
+
+		vkUpdateDescriptorSets(m_logicalDevice, 17, writes, 0, nullptr);
+	}
+
 	void VulkanProject::DrawFrame()
 	{
-		vkWaitForFences(m_logicalDevice, 1, &inFlightFences[currentFrameIndex], VK_TRUE, UINT64_MAX);
+		CPU_TRACE_SCOPE("DrawFrame");
+		FrameClock::time_point frameStart = FrameClock::now();
+		if (m_frameStats.fenceWait.GetCount() > 0)
+		{
+			m_frameStats.frameInterval.Record(ElapsedMicroseconds(m_lastFrameStart, frameStart));
+		}
+		m_lastFrameStart = frameStart;
 
+		//the only CPU/GPU throttle: the GPU must be done with the frame that last used this slot
+		{
+			CPU_TRACE_SCOPE("fence wait");
+			vkWaitForFences(m_logicalDevice, 1, &inFlightFences[currentFrameIndex], VK_TRUE, UINT64_MAX);
+		}
+		FrameClock::time_point fenceDone = FrameClock::now();
 
-		uint32_t imageIndex;
-		vkAcquireNextImageKHR(m_logicalDevice, m_swapChain, UINT64_MAX, imageAvailableSemaphore[currentFrameIndex], VK_NULL_HANDLE, &imageIndex);
+		//offscreen images belong to their frame slot, the fence above already covers them
+		uint32_t imageIndex = (uint32_t)currentFrameIndex;
+		if (!m_headless)
+		{
+			CPU_TRACE_SCOPE("acquire");
+			vkAcquireNextImageKHR(m_logicalDevice, m_swapChain, UINT64_MAX, imageAvailableSemaphore[currentFrameIndex], VK_NULL_HANDLE, &imageIndex);
+		}
+		FrameClock::time_point acquireDone = FrameClock::now();
 
+		double fenceWaitMicroseconds = ElapsedMicroseconds(frameStart, fenceDone);
 		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) 
 		{
 			vkWaitForFences(m_logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
 		}
 
 		imagesInFlight[imageIndex] = inFlightFences[currentFrameIndex];
+		FrameClock::time_point recordStart = FrameClock::now();
+		fenceWaitMicroseconds += ElapsedMicroseconds(acquireDone, recordStart);
+
+		//frame boundary: retired pipelines age by a frame, reloaded ones may be swapped in
+		m_pipelineRegistry->BeginFrame();
+		ApplyShaderReloads();
+
+		//frames before the first FramesInFlight left nothing in their slot
+		if (m_countOverdraw && m_frameStats.fenceWait.GetCount() >= FramesInFlight)
+		{
+			ReadOverdrawCounter((uint32_t)currentFrameIndex);
+		}
+		if (m_gpuProfiler && m_frameStats.fenceWait.GetCount() >= FramesInFlight && m_gpuProfiler->ReadFrame((uint32_t)currentFrameIndex))
+		{
+			m_frameStats.gpuFrame.Record(m_gpuProfiler->GetLastFrame()[0].durationMicroseconds);
+		}
+		if (m_statisticsQueries && m_frameStats.fenceWait.GetCount() >= FramesInFlight)
+		{
+			m_statisticsQueries->ReadFrame((uint32_t)currentFrameIndex);
+		}
+
+		//the fence above guarantees the GPU is done with everything allocated from this pool and upload partition
+		UploadFrameData((uint32_t)currentFrameIndex);
+
+		//everything streamed since the last frame goes out as one transfer submission
+		m_uploadService->Flush();
+		VkCommandBuffer commandBuffer = m_frameCommandBuffers[currentFrameIndex];
+		vkResetCommandPool(m_logicalDevice, m_frameCommandPools[currentFrameIndex], 0);
+		{
+			CPU_TRACE_SCOPE("record");
+			RecordCommandBuffer(commandBuffer, (uint32_t)currentFrameIndex, imageIndex);
+		}
+		m_frameUploadBuffer->EndFrame();
 
 
 		VkSubmitInfo info{};
 		info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore drawSemaphore[] = { imageAvailableSemaphore[currentFrameIndex] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-
-		info.waitSemaphoreCount = 1;
-		info.pWaitSemaphores = drawSemaphore;
-		info.pWaitDstStageMask = waitStages;
+		VkSemaphore drawSemaphore[] = { imageAvailableSemaphore[currentFrameIndex], m_uploadService->GetSemaphore() };
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, m_uploadWaitStages };
+
+		//the binary semaphore's value is ignored, headless frames have no acquire to wait for
+		uint64_t waitValues[] = { 0, m_uploadWaitValue };
+		uint32_t firstWait = m_headless ? 1 : 0;
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = ((m_uploadWaitValue > 0) ? 2 : 1) - firstWait;
+		timelineInfo.pWaitSemaphoreValues = waitValues + firstWait;
+
+		info.pNext = &timelineInfo;
+		info.waitSemaphoreCount = timelineInfo.waitSemaphoreValueCount;
+		info.pWaitSemaphores = drawSemaphore + firstWait;
+		info.pWaitDstStageMask = waitStages + firstWait;
 		info.commandBufferCount = 1;
-		info.pCommandBuffers = &m_commandBuffers[imageIndex];
+		info.pCommandBuffers = &commandBuffer;
 
 		VkSemaphore signalSemaphore[] = { renderFinishedSemaphore[currentFrameIndex] };
-		info.signalSemaphoreCount = 1;
+		info.signalSemaphoreCount = m_headless ? 0 : 1;
 		info.pSignalSemaphores = signalSemaphore;
 		
 		vkResetFences(m_logicalDevice, 1, &inFlightFences[currentFrameIndex]);
 
-		if (vkQueueSubmit(m_graphicsQueue, 1, &info, inFlightFences[currentFrameIndex]) != VK_SUCCESS)
 		{
-			throw std::runtime_error("Failed to submit draw Command buffer");
+			CPU_TRACE_SCOPE("submit");
+			if (vkQueueSubmit(m_graphicsQueue, 1, &info, inFlightFences[currentFrameIndex]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to submit draw Command buffer");
+			}
 		}
 
+		m_frameStats.fenceWait.Record(fenceWaitMicroseconds);
+		m_frameStats.acquire.Record(ElapsedMicroseconds(fenceDone, acquireDone));
+		m_frameStats.cpuRecord.Record(ElapsedMicroseconds(recordStart, FrameClock::now()));
+
+		m_lastImageIndex = imageIndex;
+		currentFrameIndex = (currentFrameIndex + 1) % FramesInFlight;
+		if (m_headless)
+			return;
+
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		presentInfo.waitSemaphoreCount = 1;
@@ -1021,31 +2827,128 @@ namespace Graphics
 		presentInfo.pSwapchains = swapChains;
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr;
-	
-
-		currentFrameIndex = (currentFrameIndex + 1) % FramesInFlight;
 
+		//no queue idle here: the next frame records while the GPU is still working on this one
+		CPU_TRACE_SCOPE("present");
 		vkQueuePresentKHR(m_presentationQueue, &presentInfo);
-		vkQueueWaitIdle(m_presentationQueue);
-
-	
 	} 
 }
 
 
 
 
-int main() {
+int main(int argc, char** argv) {
+
+	CPU_TRACE_THREAD_NAME("main");
+	bool recordingBenchmark = false;
+	bool pipelineBenchmark = false;
+	uint32_t frameCount = 0;
+	const char* screenshotFile = nullptr;
+	bool validateLightCulling = false;
+	bool frameBenchmark = false;
+	Graphics::FrameBenchmarkOptions benchOptions;
+	Graphics::RenderSettings settings;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--no-depth-prepass") == 0)
+			settings.depthPrePass = false;
+		if (strcmp(argv[i], "--no-occlusion-culling") == 0)
+			settings.occlusionCulling = false;
+		if (strcmp(argv[i], "--count-overdraw") == 0)
+			settings.countOverdraw = true;
+		if (strcmp(argv[i], "--bench-recording") == 0)
+			recordingBenchmark = true;
+		if (strcmp(argv[i], "--bench-pipelines") == 0)
+			pipelineBenchmark = true;
+		if (strcmp(argv[i], "--headless") == 0)
+			settings.headless = true;
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			frameCount = (uint32_t)strtoul(argv[++i], nullptr, 10);
+		if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc)
+			screenshotFile = argv[++i];
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			settings.traceFile = argv[++i];
+		if (strcmp(argv[i], "--pipeline-statistics") == 0)
+			settings.pipelineStatistics = true;
+		if (strcmp(argv[i], "--validate-light-culling") == 0)
+			validateLightCulling = true;
+		if (strcmp(argv[i], "--vf-bench") == 0)
+			frameBenchmark = true;
+		if (strcmp(argv[i], "--update-golden") == 0)
+			benchOptions.updateGolden = true;
+		if (strcmp(argv[i], "--require-golden") == 0)
+			benchOptions.requireGolden = true;
+		if (strcmp(argv[i], "--golden-dir") == 0 && i + 1 < argc)
+			benchOptions.goldenDirectory = argv[++i];
+
+		//cpu only, no window or device needed
+		if (strcmp(argv[i], "--bench-jobs") == 0)
+		{
+			Graphics::RunJobSystemBenchmark(std::cout);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-cpu-trace") == 0)
+		{
+			Graphics::RunCpuTraceBenchmark(std::cout);
+			return 0;
+		}
+		if (strcmp(argv[i], "--bench-light-assignment") == 0)
+		{
+			Graphics::RunLightAssignmentBenchmark(std::cout);
+			return 0;
+		}
+		if (strcmp(argv[i], "--unit-tests") == 0)
+		{
+			return Graphics::RunUnitTests(std::cout) == 0 ? 0 : 1;
+		}
+	}
+
+	//headless scenes on a device of their own each, the exit code tells CI whether every golden matched
+	if (frameBenchmark)
+	{
+		benchOptions.frameCount = frameCount;
+		return Graphics::RunFrameBenchmark(std::cout, benchOptions) == 0 ? 0 : 1;
+	}
+
+	//without a window a run has to end by itself
+	if (settings.headless && frameCount == 0)
+	{
+		frameCount = 100;
+	}
 
+	int exitCode = 0;
 	Graphics::VulkanProject project = Graphics::VulkanProject();
-	project.VP_InitGLFW();
-	project.VP_InitVulkan();
+	if (!settings.headless)
+	{
+		project.VP_InitGLFW();
+	}
+	project.VP_InitVulkan(settings);
 	if (!project.VP_CheckUP()) 
 	{
 		std::cout << "Something went wrong!";
 	}
-	project.VP_Run();
+
+	if (recordingBenchmark)
+	{
+		project.VP_RunRecordingBenchmark();
+	}
+	else if (pipelineBenchmark)
+	{
+		project.VP_RunPipelineBenchmark();
+	}
+	else
+	{
+		project.VP_Run(frameCount);
+		if (settings.headless && screenshotFile != nullptr && !Graphics::WritePpm(screenshotFile, project.VP_ReadbackFrame()))
+		{
+			std::cerr << "failed to write " << screenshotFile << std::endl;
+		}
+		if (validateLightCulling && project.VP_ValidateLightCulling(std::cout) != 0)
+		{
+			exitCode = 1;
+		}
+	}
 	project.VP_CleanUP();
 
-	return 0;
+	return exitCode;
 }
\ No newline at end of file
@@ -3,6 +3,21 @@
 #include "Shader.h"
 #include <GLFW/glfw3.h>
 #include "Types.h"
+#include "LightClustering.h"
+#include "FrameStats.h"
+#include "CommandRecorder.h"
+#include "MemoryAllocator.h"
+#include "FrameUploadBuffer.h"
+#include "UploadService.h"
+#include "Mesh.h"
+#include "PipelineCache.h"
+#include "PipelineRegistry.h"
+#include "ShaderWatcher.h"
+#include "ImageFile.h"
+#include "GpuProfiler.h"
+#include "CpuTrace.h"
+#include "PipelineStatistics.h"
+#include <memory>
 
 namespace Graphics
 {
@@ -10,18 +25,122 @@ namespace Graphics
 	const uint32_t Width = 1280;
 	const uint32_t Height = 720;
 	const uint32_t FramesInFlight = 2;
+	const uint32_t ParallelRecordThreshold = 2 * ParallelCommandRecorder::MinDrawsPerSlice;
+	const VkDeviceSize FrameUploadSize = 1024 * 1024;
+	const char* const PipelineCacheFile = "pipeline_cache.bin";
+	const uint32_t CountOverdrawConstantId = 4;		//COUNT_OVERDRAW in Shaders/pShader.frag
+	const VkDeviceSize OverdrawCounterSize = 2 * sizeof(uint32_t);		//OverdrawCounter in Shaders/pShader.frag
+	const uint32_t HiZMaxLevels = 12;				//HIZ_MAX_LEVELS in Shaders/common.glsl
+	const uint32_t HiZGroupSize = 64;				//pixels per side one Shaders/hizDownsample.comp workgroup reduces
+	const char* const EngineShaders[] = { "Shaders/vert.spv", "Shaders/frag.spv", "Shaders/lightCulling.spv", "Shaders/clusterBounds.spv", "Shaders/clusterAssign.spv",
+		"Shaders/hizDownsample.spv", "Shaders/occlusionCull.spv" };
+
+	//what the project build step and Shaders/CompileShaders.bat compile, recompiled by the ShaderWatcher while running
+	const char* const ShaderDirectory = "Shaders";
+	const ShaderSource EngineShaderSources[] = { { "vShader.vert", "vert.spv" }, { "pShader.frag", "frag.spv" }, { "lightCulling.comp", "lightCulling.spv" },
+		{ "clusterBounds.comp", "clusterBounds.spv" }, { "clusterAssign.comp", "clusterAssign.spv" }, { "hizDownsample.comp", "hizDownsample.spv" },
+		{ "occlusionCull.comp", "occlusionCull.spv" } };
 	
 
+	//what VP_InitVulkan sets up, fixed for the life of the device
+	struct RenderSettings
+	{
+		LightCullingMode lightCullingMode = LightCullingMode::Tiled;
+		bool depthPrePass = true;
+		bool occlusionCulling = true;		//needs the depth pre-pass, its depth pyramid is what draws are tested against
+		bool countOverdraw = false;
+		bool headless = false;		//offscreen color targets instead of a window and swap chain, VP_InitGLFW is not needed
+		std::string traceFile;		//Chrome trace of the GPU and CPU scopes written at the end of VP_Run when set
+		bool pipelineStatistics = false;		//per pass pipeline statistics queries, ignored when the device has none
+	};
+
+	//what the picked device offers for measuring itself, queries are only enabled when a setting asks for them
+	struct InstrumentationFeatures
+	{
+		uint32_t timestampValidBits = 0;		//of the graphics family, 0 when it can not write timestamps
+		bool pipelineStatistics = false;
+		bool inheritedQueries = false;
+		bool occlusionQueryPrecise = false;
+
+		void Print(std::ostream& out) const;
+	};
+
 	struct QueueFamilyIndices
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentationFamily;
+		std::optional<uint32_t> transferFamily;		//a transfer only family when there is one, the graphics family otherwise
 		bool IsComplete()
 		{
 			return graphicsFamily.has_value() && presentationFamily.has_value();
 		}
 	};
 
+	//std140 layout of the CameraData uniform block in Shaders/common.glsl
+	struct CameraData
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 inverseProjection;
+		glm::vec4 position;
+		glm::vec2 screenSize;
+		float nearPlane;
+		float farPlane;
+		uint32_t lightCount;
+		uint32_t tileCountX;
+		uint32_t tileCountY;
+		uint32_t padding;
+	};
+
+	//std430 DrawData in Shaders/vShader.vert, read by each draw's first instance index
+	struct DrawData
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+	};
+
+	struct DrawItem
+	{
+		uint32_t mesh;
+		VkPipeline pipeline;
+		VkPipeline depthPipeline;		//same geometry and cull state in the depth pre-pass
+		DrawData data;
+	};
+
+	//std430 layout of the DrawCullData in Shaders/occlusionCull.comp, world space box of one draw
+	struct DrawCullData
+	{
+		glm::vec3 minPoint;
+		uint32_t bucket;
+		glm::vec3 maxPoint;
+		uint32_t firstSlot;		//first visible list slot of the bucket
+	};
+
+	//consecutive draw items sharing pipelines and index width, issued with one indirect call per pass
+	struct DrawBucket
+	{
+		uint32_t firstDraw;
+		uint32_t drawCount;
+	};
+
+	//passes whose draws are recorded, each has its own secondary buffers when recording in parallel
+	enum class DrawPass : uint32_t
+	{
+		Depth,
+		Forward,
+		Count
+	};
+
+	//passes counted by the pipeline statistics queries
+	enum class StatisticsPass : uint32_t
+	{
+		DepthPrePass,
+		OcclusionCulling,
+		LightCulling,
+		Forward,
+		Count
+	};
+
 	struct SwapChainSupportDetails
 	{
 		VkSurfaceCapabilitiesKHR capabilities;
@@ -35,46 +154,183 @@ namespace Graphics
 		std::vector<VkFence> inFlightFences;
 		std::vector<VkFence> imagesInFlight;
 		size_t currentFrameIndex = 0;
+		FrameStats m_frameStats;
+		FrameClock::time_point m_lastFrameStart;
 
-		GLFWwindow* m_window;
+		GLFWwindow* m_window = nullptr;
 		VkInstance m_MainInstance;
 		VkDebugUtilsMessengerEXT m_debugMessenger;
-		VkSurfaceKHR m_surface;
+		VkSurfaceKHR m_surface = VK_NULL_HANDLE;
 		VkPhysicalDevice m_physicalDevice;
 		VkDevice m_logicalDevice;
-		VkSwapchainKHR m_swapChain;
+		VkSwapchainKHR m_swapChain = VK_NULL_HANDLE;
 		std::vector<VkSemaphore> imageAvailableSemaphore, renderFinishedSemaphore;
 		
 		
 		VkQueue m_graphicsQueue;
 		VkQueue m_presentationQueue;
+		VkQueue m_transferQueue;
 		VkFormat m_swapChainFormat;
 		VkExtent2D m_swapChainExtent;
 		VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+		uint64_t m_pipelineLayoutKey = 0;
 		VkRenderPass m_traingleRenderPass = VK_NULL_HANDLE;
 		VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
+		VkPipeline m_groundPipeline = VK_NULL_HANDLE;
+		VkPipeline m_depthPipeline = VK_NULL_HANDLE;
+		VkPipeline m_groundDepthPipeline = VK_NULL_HANDLE;
+		GraphicsPipelineDesc m_forwardDesc;
+		GraphicsPipelineDesc m_groundDesc;
+		GraphicsPipelineDesc m_depthDesc;
+		GraphicsPipelineDesc m_groundDepthDesc;
+		ComputePipelineDesc m_lightCullingDesc;
+		ComputePipelineDesc m_clusterBoundsDesc;
+		ComputePipelineDesc m_hiZDesc;
+		ComputePipelineDesc m_occlusionCullDesc;
+		std::unique_ptr<ShaderWatcher> m_shaderWatcher;
+		bool m_pipelinesPending = false;		//a shader reload is waiting for its pipelines to build
+		std::unique_ptr<PipelineCache> m_pipelineCache;
+		std::unique_ptr<PipelineRegistry> m_pipelineRegistry;
+		std::unique_ptr<ShaderLibrary> m_shaderLibrary;
+		ReflectedLayout m_shaderLayout;
+		uint64_t m_renderPassKey = 0;
 		VkCommandPool m_commandPool = VK_NULL_HANDLE;
 
-		std::vector<VkCommandBuffer> m_commandBuffers;
+		//depth pre-pass, the forward pass then shades only fragments that pass an EQUAL test against it
+		bool m_depthPrePass = true;
+		VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+		VkImage m_depthImage = VK_NULL_HANDLE;
+		Allocation m_depthImageAllocation;
+		VkImageView m_depthImageView = VK_NULL_HANDLE;
+		VkRenderPass m_depthRenderPass = VK_NULL_HANDLE;
+		uint64_t m_depthRenderPassKey = 0;
+		VkFramebuffer m_depthFrameBuffer = VK_NULL_HANDLE;
+		VkImageView m_depthSampleView = VK_NULL_HANDLE;		//depth aspect only, for the pyramid build
+
+		//min/max depth pyramid of the pre-pass, rebuilt every frame. The light culler bounds its tiles and clusters by it.
+		//With occlusion culling the draws are submitted by the GPU: both passes issue one indirect call per bucket, and
+		//the forward pass only gets the draws a compute pass found visible against the pyramid.
+		bool m_occlusionCulling = true;
+		VkSampler m_pointSampler = VK_NULL_HANDLE;
+		VkImage m_hiZImage = VK_NULL_HANDLE;
+		Allocation m_hiZImageAllocation;
+		VkImageView m_hiZView = VK_NULL_HANDLE;
+		std::vector<VkImageView> m_hiZLevelViews;
+		uint32_t m_hiZGroupCountX = 0;
+		uint32_t m_hiZGroupCountY = 0;
+		VkBuffer m_hiZCounterBuffer = VK_NULL_HANDLE;
+		Allocation m_hiZCounterBufferAllocation;
+		VkPipeline m_hiZPipeline = VK_NULL_HANDLE;
+		VkPipeline m_occlusionCullPipeline = VK_NULL_HANDLE;
+		std::vector<DrawBucket> m_drawBuckets;
+		VkBuffer m_drawDataBuffer = VK_NULL_HANDLE;
+		Allocation m_drawDataBufferAllocation;
+		VkBuffer m_drawCullBuffer = VK_NULL_HANDLE;
+		Allocation m_drawCullBufferAllocation;
+		VkBuffer m_drawCommandBuffer = VK_NULL_HANDLE;		//one VkDrawIndexedIndirectCommand per draw item
+		Allocation m_drawCommandBufferAllocation;
+		VkBuffer m_visibleDrawCommandBuffer = VK_NULL_HANDLE;		//compacted per bucket, in the bucket's range of draws
+		Allocation m_visibleDrawCommandBufferAllocation;
+		VkBuffer m_visibleDrawCountBuffer = VK_NULL_HANDLE;		//one count per bucket
+		Allocation m_visibleDrawCountBufferAllocation;
+		uint32_t m_culledDrawCount = 0;
+
+		//fragments shaded by the forward pass and draws left after culling, copied to one readback slot per frame in flight
+		bool m_countOverdraw = false;
+		VkBuffer m_overdrawCounterBuffer = VK_NULL_HANDLE;
+		Allocation m_overdrawCounterBufferAllocation;
+		VkBuffer m_overdrawReadbackBuffer = VK_NULL_HANDLE;
+		Allocation m_overdrawReadbackBufferAllocation;
+		OverdrawStats m_overdrawStats;
+
+		//timestamp scopes around the passes of every frame, none when the graphics queue can not write timestamps
+		std::unique_ptr<GpuProfiler> m_gpuProfiler;
+		std::string m_traceFile;
+
+		//pipeline statistics per pass, only when asked for and the device supports them
+		InstrumentationFeatures m_instrumentation;
+		bool m_pipelineStatistics = false;
+		bool m_inheritedQueries = false;		//secondary command buffers may run inside a statistics query
+		std::unique_ptr<PipelineStatisticsQueries> m_statisticsQueries;
+
+		//forward+ light culling, the light grid holds per tile or per cluster lists depending on the mode
+		VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+		VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+		LightCullingMode m_lightCullingMode = LightCullingMode::Tiled;
+		VkPipeline m_lightCullingPipeline = VK_NULL_HANDLE;
+		VkPipeline m_clusterBoundsPipeline = VK_NULL_HANDLE;
+		bool m_clusterBoundsDirty = true;
+		std::unique_ptr<UploadService> m_uploadService;
+		uint64_t m_uploadWaitValue = 0;
+		VkPipelineStageFlags m_uploadWaitStages = 0;
+		std::unique_ptr<FrameUploadBuffer> m_frameUploadBuffer;
+		uint32_t m_frameDynamicOffsets[2] = {};		//camera and lights in m_frameUploadBuffer
+		VkBuffer m_lightGridCountBuffer = VK_NULL_HANDLE;
+		Allocation m_lightGridCountBufferAllocation;
+		VkBuffer m_lightGridIndexBuffer = VK_NULL_HANDLE;
+		Allocation m_lightGridIndexBufferAllocation;
+		VkBuffer m_lightGridCandidateBuffer = VK_NULL_HANDLE;		//uncapped light count of every list
+		Allocation m_lightGridCandidateBufferAllocation;
+		VkBuffer m_lightGridDepthRangeBuffer = VK_NULL_HANDLE;		//view depth range every list was built for
+		Allocation m_lightGridDepthRangeBufferAllocation;
+		VkBuffer m_clusterBoundsBuffer = VK_NULL_HANDLE;
+		Allocation m_clusterBoundsBufferAllocation;
+		uint32_t m_tileCountX = 0;
+		uint32_t m_tileCountY = 0;
+		CameraData m_camera{};
+		std::vector<Light> m_lights;
+
+		std::vector<VkCommandPool> m_frameCommandPools;
+		std::vector<VkCommandBuffer> m_frameCommandBuffers;
+		std::unique_ptr<MeshPool> m_meshPool;
+		std::vector<DrawItem> m_drawItems;
+		std::unique_ptr<JobSystem> m_jobSystem;
+		std::unique_ptr<VulkanMemoryBackend> m_memoryBackend;
+		std::unique_ptr<DeviceMemoryAllocator> m_memoryAllocator;
+		std::unique_ptr<ParallelCommandRecorder> m_parallelRecorder;
+		bool m_parallelRecording = true;
 		std::vector<VkImage> m_swapChainImages;
 		std::vector<VkImageView> m_swapChainImageViews;
 		std::vector<VkExtensionProperties> m_extensionList;
 		std::vector<VkFramebuffer> m_swapChainFrameBuffers;
-		const std::vector<const char*> m_deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		std::vector<const char*> m_deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+		//headless: one offscreen image per frame in flight stands in for the swap chain, frame slot i renders into image i.
+		//Nothing is presented, the images are left in TRANSFER_SRC layout for readback.
+		bool m_headless = false;
+		std::vector<Allocation> m_offscreenAllocations;
+		uint32_t m_lastImageIndex = UINT32_MAX;
 		const std::vector<const char*> m_validationLayers = { "VK_LAYER_KHRONOS_validation" };
 		
 #ifdef NDEBUG
-		const bool m_enablevalidationLayers = false;
+		const bool m_enableValidationLayers = false;
 #else
 		const bool m_enableValidationLayers = true;
 #endif // !NDebug
 
 	public:
 		bool VP_InitGLFW();
-		bool VP_InitVulkan();
+		bool VP_InitVulkan(const RenderSettings& settings = RenderSettings());
 		void VP_CleanUP();
-		void VP_Run();
+		//until the window is closed, or frameCount frames when it is not 0. Headless runs need a frame count.
+		void VP_Run(uint32_t frameCount = 0);
 		bool VP_CheckUP();
+		//copies the image of the last frame back to the CPU, headless only. Throws std::runtime_error before the first frame.
+		RgbImage VP_ReadbackFrame();
+		//checks the last frame's light grid against the CPU reference culler and times both, returns the lists that failed
+		uint32_t VP_ValidateLightCulling(std::ostream& out);
+		//a single frame, for callers running their own loop
+		void VP_RenderFrame();
+		inline const FrameStats& GetFrameStats() const { return m_frameStats; }
+		inline MemoryStats GetMemoryStats() const { return m_memoryAllocator->GetStats(); }
+		inline VkDeviceSize GetUploadHighWaterMark() const { return m_frameUploadBuffer->GetHighWaterMark(); }
+		//GPU time of the latest frame read back, the count tells whether a new one arrived since the last call
+		inline double GetLastGpuFrameMicroseconds() const { return GetGpuFrameCount() > 0 ? m_gpuProfiler->GetLastFrame()[0].durationMicroseconds : 0.0; }
+		inline uint64_t GetGpuFrameCount() const { return m_gpuProfiler ? m_gpuProfiler->GetFrameCount() : 0; }
+		inline const InstrumentationFeatures& GetInstrumentationFeatures() const { return m_instrumentation; }
+		void VP_RunRecordingBenchmark();
+		void VP_RunPipelineBenchmark();
 
 	private:
 		//setup functions for vulkan
@@ -85,18 +341,53 @@ namespace Graphics
 		void CreateSurface();
 		void CreateLogicalDevice();
 		void CreateSwapChain();
+		void CreateOffscreenTargets();
 		void CreateImageViews();
+		VkFormat FindDepthFormat();
+		void CreateDepthResources();
+		void CreateHiZResources();
 		void CreateRenderPass();
+		void CreateDepthRenderPass();
 		void CreateFrameBuffer();
 		void CreateCommandPools();
 		void CreateCommandBuffers();
+		void RecordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t frameIndex, uint32_t imageIndex);
+		void RecordDraws(VkCommandBuffer commandBuffer, DrawPass pass, uint32_t firstDraw, uint32_t drawCount);
+		void RecordIndirectDraws(VkCommandBuffer commandBuffer, DrawPass pass);
+		void RecordDrawPass(VkCommandBuffer commandBuffer, DrawPass pass, const VkRenderPassBeginInfo& renderPassInfo, uint32_t frameIndex);
 		void DrawFrame();
 		void CreateSyncObjects();
+		void CreateDescriptorSetLayout();
+		void BuildClusterBounds();
+		void CreateLights();
+		void CreateLightBuffers();
+		void CreateOverdrawCounter();
+		void ReadOverdrawCounter(uint32_t frameIndex);
+		void CreateGpuProfiler();
+		void CreatePipelineStatisticsQueries();
+		void CreateDescriptorSets();
+		void UpdateCamera();
+		void UploadFrameData(uint32_t frameIndex);
+		void CreatePipelineCache();
+		void CreateMemoryAllocator();
+		void CreateUploadService();
+		void CreateScene();
+		void CreateDrawBuffers();
+		void RecordOcclusionCulling(VkCommandBuffer commandBuffer);
+		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, MemoryUsage memoryUsage, VkBuffer& buffer, Allocation& allocation);
 
 		//setup functions for graphics'
-		VkShaderModule CreateShaderModule(const std::vector<char>& code);
-		void CreateGraphicsPipeline();
+		void CreatePipelineLayout();
+		SpecializationConstants GetLightingConstants(LightCullingMode mode);
+		GraphicsPipelineDesc GetForwardPipelineDesc();
+		GraphicsPipelineDesc GetDepthPipelineDesc();
+		void CreatePipelines();
+		void RequestPipelines();
+		bool ArePipelinesReady();
+		void ResolvePipelines();
+		void ApplyShaderReloads();
 		int GetDeviceScore(VkPhysicalDevice device);
+		InstrumentationFeatures QueryInstrumentationFeatures(VkPhysicalDevice device);
 		void PickPhysicalDevice();
 		VkSurfaceFormatKHR ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
 		VkPresentModeKHR ChooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availableModes);